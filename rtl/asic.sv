@@ -525,6 +525,14 @@ assign asic_ram_rd   = asic_ram_rd_mux;
 assign asic_ram_wr   = asic_ram_wr_mux;
 assign asic_ram_din  = asic_ram_din_mux;
 
+// The write the block below applies to asic_ram; also probed by sim_events.v
+wire        asic_ram_we    = asic_ram_wr && (cpu_addr >= 16'h6000) && (cpu_addr <= 16'h7FFF) &&
+                             plus_mode && use_asic && asic_enabled && mrer_mode[4] && mrer_mode[3];
+wire [13:0] asic_ram_waddr = cpu_addr[12:0] + 13'h2000;
+// Palette writes: odd offsets in 0x0400..0x043F only keep 4 bits
+wire [7:0]  asic_ram_wdata = ((cpu_addr[11:0] >= 12'h400) && (cpu_addr[11:0] < 12'h440) && cpu_addr[0]) ?
+                             {4'b0000, cpu_data_in[3:0]} : cpu_data_in;
+
 // ASIC RAM write logic for 0x6000-0x7FFF region
 always @(posedge clk_sys) begin
     if (reset) begin
@@ -547,16 +555,7 @@ always @(posedge clk_sys) begin
         // Enhanced ASIC RAM write logic for 0x6000-0x7FFF
         if (asic_ram_wr && (cpu_addr >= 16'h6000) && (cpu_addr <= 16'h7FFF)) begin
             if (plus_mode && use_asic && asic_enabled && (mrer_mode[4] && mrer_mode[3])) begin
-                // Offset into ASIC RAM for 0x6000 region
-                logic [13:0] asic_offset;
-                asic_offset = cpu_addr[12:0] + 13'h2000;
-                
-                // Palette writes: odd offsets in 0x0400..0x043F
-                if ((cpu_addr[11:0] >= 12'h400) && (cpu_addr[11:0] < 12'h440) && cpu_addr[0]) begin
-                    asic_ram[asic_offset] <= {4'b0000, cpu_data_in[3:0]};
-                end else begin
-                    asic_ram[asic_offset] <= cpu_data_in;
-                end
+                asic_ram[asic_ram_waddr] <= asic_ram_wdata;
 
                 // Programmable raster interrupt
                 if (cpu_addr[12:0] == 13'h800) begin
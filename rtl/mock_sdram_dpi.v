@@ -0,0 +1,105 @@
+// mock_sdram_dpi.v - DPI-C backed SDRAM module for verilator simulation
+// Drop-in replacement for mock_sdram.v. The 8MB array lives on the host side
+// (verilator_macOSSilicon/sim/sim_sdram.cpp) as lazily allocated pages, so
+// only touched pages are resident and ROM images can be mapped in read-only.
+
+module mock_sdram (
+	// SDRAM interface stubs (unused in simulation)
+	inout  [15:0] SDRAM_DQ,   // 16 bit bidirectional data bus
+	output [12:0] SDRAM_A,    // 13 bit multiplexed address bus
+	output        SDRAM_DQML, // byte mask
+	output        SDRAM_DQMH, // byte mask
+	output  [1:0] SDRAM_BA,   // two banks
+	output        SDRAM_nCS,  // a single chip select
+	output        SDRAM_nWE,  // write enable
+	output        SDRAM_nRAS, // row address select
+	output        SDRAM_nCAS, // columns address select
+	output        SDRAM_CLK,
+	output        SDRAM_CKE,
+
+	// cpu/chipset interface
+	input         init,       // init signal after FPGA config to initialize RAM
+	input         clk,        // sdram is accessed at up to 128MHz
+	input         clkref,     // reference clock to sync to
+
+	input   [1:0] bank,
+	input   [7:0] din,        // data input from chipset/cpu
+	output  [7:0] dout,       // data output to chipset/cpu
+	input  [22:0] addr,       // 23 bit byte address
+	input         oe,         // cpu/chipset requests read
+	input         we,         // cpu/chipset requests write
+
+	output [15:0] vram_dout,
+	input  [22:0] vram_addr,
+
+	input  [22:0] tape_addr,
+	input   [7:0] tape_din,
+	output  [7:0] tape_dout,
+
+	input         tape_wr,
+	output        tape_wr_ack,
+
+	input         tape_rd,
+	output reg    tape_rd_ack
+);
+
+// The host routes these to the SimSDRAM made active for the calling thread
+import "DPI-C" function byte unsigned sdram_dpi_read(input int unsigned a);
+import "DPI-C" function shortint unsigned sdram_dpi_read16(input int unsigned a);
+import "DPI-C" function void sdram_dpi_write(input int unsigned a, input byte unsigned d);
+
+// Drive unused outputs to reasonable values
+assign SDRAM_A = 13'h0;
+assign SDRAM_BA = 2'b00;
+assign SDRAM_nWE = 1'b1;
+assign SDRAM_nRAS = 1'b1;
+assign SDRAM_nCAS = 1'b1;
+assign SDRAM_nCS = 1'b1;
+assign SDRAM_CLK = 1'b0;
+assign SDRAM_CKE = 1'b1;
+assign SDRAM_DQML = 1'b0;
+assign SDRAM_DQMH = 1'b0;
+assign SDRAM_DQ = 16'hZZZZ;
+
+reg [7:0] out_data;
+
+// Simple memory read/write logic
+assign dout = oe ? out_data : 8'hFF;
+
+// Video RAM data
+reg [15:0] vram_data;
+assign vram_dout = vram_data;
+
+// Tape interface
+reg [7:0] tape_data;
+assign tape_dout = tape_data;
+assign tape_wr_ack = tape_wr; // Immediate acknowledgment in simulation
+
+// Memory access logic
+// Reads are issued before writes so a read and write to the same address in
+// one cycle still returns the old data, as with the array in mock_sdram.v
+always @(posedge clk) begin
+    if (oe) begin
+        out_data <= sdram_dpi_read({9'd0, addr});
+    end
+
+    // Video memory read
+    vram_data <= sdram_dpi_read16({9'd0, vram_addr});
+
+    if (tape_rd) begin
+        tape_data <= sdram_dpi_read({9'd0, tape_addr});
+        tape_rd_ack <= ~tape_rd_ack; // Toggle ack to indicate completion
+    end
+
+    // CPU/chipset write
+    if (we) begin
+        sdram_dpi_write({9'd0, addr}, din);
+    end
+
+    // Tape interface
+    if (tape_wr) begin
+        sdram_dpi_write({9'd0, tape_addr}, tape_din);
+    end
+end
+
+endmodule
@@ -1,9 +1,10 @@
 verilator \
--cc -exe --public --trace-fst --savable --build \
+-cc -exe --public --vpi --trace-fst --savable --build \
 -O3 --x-assign fast --x-initial fast --noassert \
 --converge-limit 6000 \
 -Wno-fatal \
 --top-module top sim.v \
+    sim_events.v \
     ../rtl/Amstrad_motherboard.v \
     ../rtl/Amstrad_MMU.v \
     ../rtl/crt_filter.v \
@@ -43,6 +44,26 @@ verilator \
     ../sim/sim_clock.cpp \
     ../sim/sim_video.cpp \
     ../sim/sim_input.cpp \
+    ../sim/sim_sdram.cpp \
+    ../sim/sim_fork.cpp \
+    ../sim/sim_events.cpp \
+    ../sim/sim_breakpoints.cpp \
+    ../sim/sim_expr.cpp \
+    ../sim/sim_signals.cpp \
+    ../sim/sim_pacer.cpp \
+    ../sim/sim_shm.cpp \
+    ../sim/sim_analyzer.cpp \
+    ../sim/sim_z80.cpp \
+    ../sim/sim_lockstep.cpp \
+    ../sim/sim_fastfwd.cpp \
+    ../sim/sim_sna.cpp \
+    ../sim/sim_amstrad.cpp \
+    ../sim/sim_control.cpp \
+    ../sim/sim_gdb.cpp \
+    ../sim/sim_watchdog.cpp \
+    ../sim/sim_cache.cpp \
+    ../sim/sim_bisect.cpp \
+    ../sim/sim_diff.cpp \
     ../sim/imgui/imgui.cpp \
     ../sim/imgui/imgui_draw.cpp \
     ../sim/imgui/imgui_widgets.cpp \
@@ -106,7 +106,6 @@ always @(posedge clk_48) begin
         if (!download_started) begin
             download_started <= 1;
             download_addr <= 0;  // Start from 0
-            $display("DEBUG: Starting new download");
         end else begin
             download_addr <= download_addr + 1;
         end
@@ -127,8 +126,6 @@ always @(posedge clk_48) begin
         end
         download_started <= 0;
         RESET <= 0;
-        $display("DEBUG: Download complete at addr=%h, plus_download=%b, plus_valid=%b", 
-                 download_addr, plus_download, plus_valid);
     end
     
     // Only reset when explicitly requested
@@ -139,7 +136,6 @@ always @(posedge clk_48) begin
         download_started <= 0;
         download_addr <= 0;
         last_addr <= 0;
-        $display("DEBUG: External reset requested");
     end
 end
 //----------------------------------------------------------------
@@ -700,4 +696,27 @@ assign VGA_VS = cmix_VS;
 assign VGA_HB = cmix_HB;
 assign VGA_VB = cmix_VB;
 
+// Debug events for the host (sim/sim_events.cpp)
+sim_events events
+(
+    .clk(clk_48),
+    .reset(reset),
+
+    .ioctl_download(ioctl_download),
+    .ioctl_wr(ioctl_wr),
+    .ioctl_index(ioctl_index),
+    .download_started(download_started),
+    .download_addr(download_addr),
+    .plus_download(plus_download),
+    .plus_valid(plus_valid),
+
+    .acid_state(asic_inst.acid_inst.state),
+    .acid_seq_index(asic_inst.acid_inst.seq_index),
+    .dma_status(asic_inst.dma_status_audio),
+    .asic_ram_we(asic_inst.asic_ram_we),
+    .asic_ram_waddr(asic_inst.asic_ram_waddr),
+    .asic_ram_wdata(asic_inst.asic_ram_wdata),
+    .sprite_collision(asic_inst.collision_reg)
+);
+
 endmodule
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "sim_amstrad.h"
+#include "sim_console.h"
+#include <string.h>
+
+static DebugConsole console;
+
+// Models take $time from their own context, which Step() keeps at
+// main_time; Verilator only asks here while a context's time is still 0
+double sc_time_stamp() {
+	return 0;
+}
+
+AmstradSim::AmstradSim() :
+	bus(DebugConsole()),
+	video(AMSTRAD_VGA_WIDTH, AMSTRAD_VGA_HEIGHT, AMSTRAD_VGA_ROTATE),
+	audio(AMSTRAD_CLK_SYS, true),
+	input(AMSTRAD_INPUTS)
+{
+	context = new VerilatedContext;
+	top = NULL;
+	main_time = 0;
+	clk_48 = SimClock(1);
+	rising = NULL;
+	risingData = NULL;
+	ce_pix = NULL;
+#ifdef SIM_SDRAM_DPI
+	downloadsShared = 0;
+	shareAt = 0;
+#endif
+
+	input.time = &main_time;
+	events.time = &main_time;
+	video.time = &main_time;
+}
+
+AmstradSim::~AmstradSim() {
+	if (top) {
+		top->final();
+		delete top;
+	}
+	delete context;
+}
+
+// Build the model; trace must be set here for FST dumps to work later
+void AmstradSim::Create(const char* name, bool trace) {
+	context->traceEverOn(trace);
+#ifdef SIM_SDRAM_DPI
+	sdram.MakeActive();
+#endif
+	events.MakeActive();
+	top = new Vtop(context, name);
+	signals.context = context;
+	signals.root = name;
+	ce_pix = signals.Get("ce_pix");
+
+	bus.ioctl_addr     = &top->ioctl_addr;
+	bus.ioctl_index    = &top->ioctl_index;
+	bus.ioctl_wait     = &top->ioctl_wait;
+	bus.ioctl_download = &top->ioctl_download;
+	bus.ioctl_upload   = &top->ioctl_upload;
+	bus.ioctl_wr       = &top->ioctl_wr;
+	bus.ioctl_dout     = &top->ioctl_dout;
+	bus.ioctl_din      = &top->ioctl_din;
+
+	input.ps2_key      = &top->ps2_key;
+	input.joystick     = &top->inputs;
+	const SimSignal* portC = signals.Get("motherboard.portC");
+	input.kbd_row      = portC ? (CData*)portC->ptr : NULL;
+}
+
+// Restart time and the clock divider; the RTL itself is reset through top->reset
+void AmstradSim::Reset() {
+	main_time = 0;
+	context->time(0);
+	clk_48.Reset();
+}
+
+// One half clock. Returns false once the RTL has called $finish.
+bool AmstradSim::Step() {
+	if (context->gotFinish()) { return false; }
+#ifdef SIM_SDRAM_DPI
+	sdram.MakeActive();
+#endif
+	events.MakeActive();
+
+	clk_48.Tick();
+	top->clk_48 = clk_48.clk;
+	bool rise = clk_48.IsRising();
+	context->time(main_time);
+
+	if (rise) {
+		input.BeforeEval();
+		bus.BeforeEval();
+	}
+
+	top->eval_step();
+
+	if (rise) {
+		bus.AfterEval();
+#ifdef SIM_SDRAM_DPI
+		// The RTL's SDRAM writes trail the ioctl bytes, so give them 1ms
+		if (bus.downloadsDone != downloadsShared) {
+			downloadsShared = bus.downloadsDone;
+			shareAt = main_time + AMSTRAD_CLK_SYS / 1000;
+		}
+		if (shareAt && main_time >= shareAt) {
+			shareAt = 0;
+			ShareDownload(bus.lastDownload);
+		}
+#endif
+		if (rising) { rising(risingData); }
+
+#ifndef DISABLE_AUDIO
+		audio.Clock(top->AUDIO_L, top->AUDIO_R);
+#endif
+
+		if (ce_pix && ce_pix->Read()) {
+			// Scale the 2 bit colour up to 8 bits
+			uint8_t r_val = top->VGA_R * 0x55;
+			uint8_t g_val = top->VGA_G * 0x55;
+			uint8_t b_val = top->VGA_B * 0x55;
+			uint32_t colour = 0xFF000000 | (b_val << 16) | (g_val << 8) | r_val;
+			video.Clock(top->VGA_HB, top->VGA_VB, top->VGA_HS, top->VGA_VS, colour);
+		}
+
+		// Advance main_time here (so next rising edge is a new time)
+		main_time++;
+	}
+	return true;
+}
+
+// Run until 'frames' more vsyncs. False when maxCycles (main_time ticks,
+// 0 = no limit) run out first or the RTL finishes.
+bool AmstradSim::RunFrames(int frames, vluint64_t maxCycles) {
+	int target = video.count_frame + frames;
+	vluint64_t end = main_time + maxCycles;
+	while (video.count_frame < target) {
+		if (maxCycles && main_time >= end) { return false; }
+		if (!Step()) { return false; }
+	}
+	return true;
+}
+
+// Queue a file for the ioctl download at 'index' (5 = cartridge)
+void AmstradSim::Load(std::string file, int index) {
+	bus.QueueDownload(file, index, true);
+}
+
+#ifdef SIM_SDRAM_DPI
+static uint32_t le32(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Point the SDRAM pages a finished download filled at the file itself.
+// ROMs (index 0-3) land at their ioctl address while the RTL is in reset;
+// a CPR's "cbNN" chunks land at block NN * 16K. Where the RTL put something
+// else (no reset, a different layout) the bytes differ and nothing is shared.
+void AmstradSim::ShareDownload(const SimBus_DownloadChunk& download) {
+	if (download.index > 5 || download.index == 4 || download.addr < 0) { return; }
+	std::shared_ptr<SimSDRAM_Image> image = SimSDRAM::OpenImage(download.file);
+	if (!image) { return; }
+	int shared = 0;
+	if (download.index < 4) {
+		shared = sdram.ShareImage((uint32_t)download.addr, image, 0, image->size);
+	}
+	else if (image->size >= 12 && memcmp(image->data, "RIFF", 4) == 0 && memcmp(image->data + 8, "AMS!", 4) == 0) {
+		size_t at = 12;
+		while (at + 8 <= image->size) {
+			const uint8_t* chunk = image->data + at;
+			uint32_t size = le32(chunk + 4);
+			if (chunk[0] == 'c' && chunk[1] == 'b' && chunk[2] >= '0' && chunk[2] <= '9' && chunk[3] >= '0' && chunk[3] <= '9') {
+				int block = (chunk[2] - '0') * 10 + (chunk[3] - '0');
+				if (block <= 31) { shared += sdram.ShareImage(block * 16384, image, at + 8, size < 16384 ? size : 16384); }
+			}
+			at += 8 + (size_t)size + (size & 1);
+		}
+	}
+	if (shared) { console.Log(LOG_DEBUG, LOG_BUS, "SDRAM: %d pages shared with %s", shared, download.file.c_str()); }
+}
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "Vtop.h"
+#include "sim_bus.h"
+#include "sim_video.h"
+#include "sim_audio.h"
+#include "sim_input.h"
+#include "sim_clock.h"
+#include "sim_sdram.h"
+#include "sim_events.h"
+#include "sim_signals.h"
+#include <string>
+
+// One complete model: a Vtop in its own VerilatedContext plus the host side
+// that drives it (ioctl bus, video, audio, input, event probes, signal
+// lookup and, built with SDRAM=dpi, the SDRAM). Each instance keeps its
+// own time in its context and finds its signals through its context's
+// scopes, so a process can hold several and step each from its own thread.
+// What they do share is thread safe: the log ring and the image mappings.
+//
+// Step() is one half clock of clk_48, as verilate() always was. The RTL's
+// DPI calls find their SimSDRAM and SimEvents through thread-local pointers,
+// which Step() points at this instance first, so instances may also be
+// interleaved on one thread. Video is headless: the frame is in
+// video.output_ptr, video.count_frame counts vsyncs.
+//
+// ROM and cartridge images go in through Load() (the ioctl download). In
+// the SDRAM=dpi build, once a download has settled, the pages it filled
+// are handed to sdram.ShareImage(), so every instance that loaded the same
+// file ends up reading one read-only mapping of it.
+//
+// sim_main runs one AmstradSim and hangs the debugger off rising: it is
+// called every rising edge after the bus, before audio and video sample the
+// outputs, while main_time still holds the edge's time.
+
+#define AMSTRAD_CLK_SYS    64000000
+#define AMSTRAD_VGA_WIDTH  320
+#define AMSTRAD_VGA_HEIGHT 200
+#define AMSTRAD_VGA_ROTATE 0
+#define AMSTRAD_INPUTS     12
+
+typedef void (*AmstradSim_Hook)(void* data);
+
+struct AmstradSim {
+public:
+	VerilatedContext* context;
+	Vtop* top;
+	vluint64_t main_time;
+	SimClock clk_48;
+
+	SimBus bus;
+	SimVideo video;
+	SimAudio audio;
+	SimInput input;
+	SimEvents events;
+	SimSignals signals;
+#ifdef SIM_SDRAM_DPI
+	SimSDRAM sdram;
+#endif
+
+	AmstradSim_Hook rising;
+	void* risingData;
+
+	void Create(const char* name = "top", bool trace = false);
+	void Reset();
+	bool Step();
+	bool RunFrame(vluint64_t maxCycles = 0) { return RunFrames(1, maxCycles); }
+	bool RunFrames(int frames, vluint64_t maxCycles = 0);
+	void Load(std::string file, int index);
+	bool Finished() { return context->gotFinish(); }
+
+	AmstradSim();
+	~AmstradSim();
+
+private:
+	const SimSignal* ce_pix;
+#ifdef SIM_SDRAM_DPI
+	int downloadsShared;
+	vluint64_t shareAt;
+	void ShareDownload(const SimBus_DownloadChunk& download);
+#endif
+};
@@ -0,0 +1,244 @@
+#include "sim_analyzer.h"
+#include "sim_console.h"
+#include "implot.h"
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+
+static DebugConsole console;
+
+SimAnalyzer::SimAnalyzer() {
+	signals = NULL;
+	time = NULL;
+	capturing = false;
+	words = NULL;
+	depthLog2 = 20;
+	depth = (uint64_t)1 << depthLog2;
+	stride = 0;
+	mask = 0;
+	count = 0;
+	waiting = false;
+	triggered = false;
+	triggerSample = 0;
+	triggerTime = 0;
+	postLeft = 0;
+	prePercent = 50;
+	addName[0] = 0;
+	triggerText[0] = 0;
+	fit = false;
+}
+
+SimAnalyzer::~SimAnalyzer() {
+	free(words);
+}
+
+uint64_t SimAnalyzer::Load(uint64_t index) {
+	uint64_t bit = index * stride;
+	size_t w = bit >> 6;
+	int off = bit & 63;
+	uint64_t v = words[w] >> off;
+	if (off + stride > 64) { v |= words[w + 1] << (64 - off); }
+	return v & mask;
+}
+
+// Pack the channels into a sample and size the ring to match
+void SimAnalyzer::Layout() {
+	capturing = false;
+	stride = 0;
+	for (size_t i = 0; i < channels.size(); i++) {
+		channels[i].shift = stride;
+		stride += channels[i].width;
+		channels[i].xs.clear();
+		channels[i].ys.clear();
+		channels[i].values.clear();
+	}
+	mask = stride == 64 ? ~(uint64_t)0 : ((uint64_t)1 << stride) - 1;
+	free(words);
+	words = (uint64_t*)calloc((size_t)(depth * stride / 64 + 2), sizeof(uint64_t));
+	count = 0;
+	triggered = false;
+}
+
+bool SimAnalyzer::Add(const std::string& name) {
+	const SimSignal* s = signals ? signals->Get(name) : NULL;
+	if (!s || s->elements != 1) {
+		console.AddLog("[error] Analyzer: no signal %s", name.c_str());
+		return false;
+	}
+	int width = s->width < 32 ? s->width : 32;
+	if (stride + width > ANALYZER_MAX_BITS) {
+		console.AddLog("[error] Analyzer: %s does not fit, %d of %d bits used", name.c_str(), stride, ANALYZER_MAX_BITS);
+		return false;
+	}
+	SimAnalyzer_Channel c;
+	c.name = name;
+	c.signal = s;
+	c.width = width;
+	c.shift = 0;
+	channels.push_back(c);
+	Layout();
+	return true;
+}
+
+void SimAnalyzer::Remove(int index) {
+	channels.erase(channels.begin() + index);
+	Layout();
+}
+
+void SimAnalyzer::SetDepth(int log2) {
+	depthLog2 = log2;
+	depth = (uint64_t)1 << log2;
+	Layout();
+}
+
+// Free running capture when trigger_text is empty
+bool SimAnalyzer::Start(const std::string& trigger_text) {
+	if (channels.empty()) { return false; }
+	waiting = false;
+	if (!trigger_text.empty()) {
+		if (!trigger.Compile(trigger_text, resolve)) {
+			console.AddLog("[error] Analyzer trigger: %s", trigger.error.c_str());
+			return false;
+		}
+		waiting = true;
+	}
+	count = 0;
+	postLeft = 0;
+	triggered = false;
+	capturing = true;
+	return true;
+}
+
+void SimAnalyzer::Trigger() {
+	waiting = false;
+	triggered = true;
+	triggerSample = count - 1;
+	triggerTime = time ? *time : 0;
+	postLeft = depth - depth * prePercent / 100;
+	console.Log(LOG_INFO, LOG_SIM, "Analyzer triggered at %llu", (unsigned long long)triggerTime);
+	if (!postLeft) { Stop(); }
+}
+
+void SimAnalyzer::Stop() {
+	capturing = false;
+	waiting = false;
+	postLeft = 0;
+	Decode();
+	fit = true;
+}
+
+// Turn the ring into transitions per channel, x in cycles from the trigger
+// (or from the oldest sample when there was none)
+void SimAnalyzer::Decode() {
+	uint64_t n = count < depth ? count : depth;
+	uint64_t first = count - n;
+	double origin = triggered ? (double)triggerSample : (double)first;
+	int lanes = (int)channels.size();
+	for (int c = 0; c < lanes; c++) {
+		channels[c].xs.clear();
+		channels[c].ys.clear();
+		channels[c].values.clear();
+	}
+	for (uint64_t i = first; i < count; i++) {
+		uint64_t v = Load(i & (depth - 1));
+		for (int c = 0; c < lanes; c++) {
+			SimAnalyzer_Channel& ch = channels[c];
+			uint32_t value = (uint32_t)((v >> ch.shift) & (((uint64_t)1 << ch.width) - 1));
+			if (!ch.values.empty() && ch.values.back() == value && i != count - 1) { continue; }
+			// Buses are drawn scaled into their lane, lanes stack downwards
+			double max = (double)(((uint64_t)1 << ch.width) - 1);
+			ch.xs.push_back((double)i - origin);
+			ch.ys.push_back((lanes - 1 - c) * 1.5 + value / max);
+			ch.values.push_back(value);
+		}
+	}
+}
+
+void SimAnalyzer::Draw(const char* title, bool* p_open, ImVec2 size) {
+	ImGui::SetNextWindowSize(size, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin(title, p_open)) {
+		ImGui::End();
+		return;
+	}
+
+	// Capture controls
+	static const char* depths[] = { "64K", "256K", "1M", "4M" };
+	int depthIndex = (depthLog2 - 16) / 2;
+	ImGui::SetNextItemWidth(70);
+	if (ImGui::Combo("depth", &depthIndex, depths, IM_ARRAYSIZE(depths))) { SetDepth(16 + depthIndex * 2); }
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(100);
+	ImGui::SliderInt("pre %", &prePercent, 0, 100);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(260);
+	ImGui::InputTextWithHint("##trigger", "trigger, e.g. motherboard.CRTC.vsync == 1", triggerText, IM_ARRAYSIZE(triggerText));
+	ImGui::SameLine();
+	if (ImGui::Button(triggerText[0] ? "Arm" : "Run")) { Start(triggerText); }
+	ImGui::SameLine();
+	if (ImGui::Button("Stop") && capturing) { Stop(); }
+	ImGui::SameLine();
+	if (capturing) { ImGui::Text(waiting ? "waiting for trigger, %llu samples" : "capturing, %llu samples", (unsigned long long)count); }
+	else if (triggered) { ImGui::Text("triggered at %llu", (unsigned long long)triggerTime); }
+	else { ImGui::Text("stopped, %llu samples", (unsigned long long)(count < depth ? count : depth)); }
+
+	// Channels
+	ImGui::SetNextItemWidth(260);
+	bool add = ImGui::InputTextWithHint("##add", "signal, e.g. motherboard.CRTC.hsync", addName, IM_ARRAYSIZE(addName), ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SameLine();
+	add |= ImGui::Button("Add");
+	if (add && addName[0] && Add(addName)) { addName[0] = 0; }
+	ImGui::SameLine();
+	ImGui::Text("%d/%d bits", stride, ANALYZER_MAX_BITS);
+	int remove = -1;
+	for (int i = 0; i < (int)channels.size(); i++) {
+		ImGui::PushID(i);
+		if (i > 0) { ImGui::SameLine(); }
+		if (ImGui::SmallButton(channels[i].name.c_str())) { remove = i; }
+		if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Remove"); }
+		ImGui::PopID();
+	}
+	if (remove >= 0) { Remove(remove); }
+
+	// Waveform
+	int lanes = (int)channels.size();
+	if (lanes > 0 && !capturing && ImPlot::BeginPlot("##wave", ImVec2(-1, -1), ImPlotFlags_NoLegend | ImPlotFlags_NoTitle | ImPlotFlags_Crosshairs)) {
+		std::vector<double> ticks(lanes);
+		std::vector<const char*> labels(lanes);
+		for (int c = 0; c < lanes; c++) {
+			ticks[c] = (lanes - 1 - c) * 1.5 + 0.5;
+			labels[c] = channels[c].name.c_str();
+		}
+		ImPlot::SetupAxes("cycles", NULL, ImPlotAxisFlags_None, ImPlotAxisFlags_Lock);
+		ImPlot::SetupAxisTicks(ImAxis_Y1, ticks.data(), lanes, labels.data());
+		ImPlot::SetupAxisLimits(ImAxis_Y1, -0.5, lanes * 1.5, ImPlotCond_Always);
+		if (fit) {
+			ImPlot::SetNextAxisToFit(ImAxis_X1);
+			fit = false;
+		}
+		ImPlotRect limits = ImPlot::GetPlotLimits();
+		for (int c = 0; c < lanes; c++) {
+			SimAnalyzer_Channel& ch = channels[c];
+			if (ch.xs.empty()) { continue; }
+			ImPlot::PlotStairs(ch.name.c_str(), ch.xs.data(), ch.ys.data(), (int)ch.xs.size());
+
+			// Label bus values once the view is zoomed in far enough to read them
+			if (ch.width == 1) { continue; }
+			size_t a = std::lower_bound(ch.xs.begin(), ch.xs.end(), limits.X.Min) - ch.xs.begin();
+			size_t b = std::upper_bound(ch.xs.begin(), ch.xs.end(), limits.X.Max) - ch.xs.begin();
+			if (a > 0) { a--; }
+			if (b - a > 64) { continue; }
+			for (size_t i = a; i + 1 < ch.xs.size() && i < b; i++) {
+				char text[16];
+				snprintf(text, sizeof(text), "%X", ch.values[i]);
+				ImPlot::PlotText(text, (ch.xs[i] + ch.xs[i + 1]) / 2, (lanes - 1 - c) * 1.5 + 1.2);
+			}
+		}
+		if (triggered) {
+			double zero = 0;
+			ImPlot::SetNextLineStyle(ImVec4(1, 0.3f, 0.3f, 1));
+			ImPlot::PlotVLines("trigger", &zero, 1);
+		}
+		ImPlot::EndPlot();
+	}
+	ImGui::End();
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "imgui.h"
+#include "sim_signals.h"
+#include "sim_expr.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Logic analyzer
+//
+// Sample() runs on every rising edge while capturing and packs the value of
+// each channel side by side into one sample of `stride` bits (64 at most),
+// stored back to back in a ring of `depth` samples. A dozen control lines
+// over the last million cycles then take a couple of megabytes.
+//
+// Capture either runs until stopped, or waits for the trigger expression to
+// go true and stops once the post-trigger share of the ring has filled. The
+// waveform is only decoded once capture has stopped, into a list of
+// transitions per channel, which is what ImPlot draws.
+
+#define ANALYZER_MAX_BITS 64
+
+struct SimAnalyzer_Channel {
+public:
+	std::string name;
+	const SimSignal* signal;
+	int width;		// bits kept, at most 32
+	int shift;		// position inside a sample
+
+	// Decoded waveform: one point per transition
+	std::vector<double> xs;
+	std::vector<double> ys;
+	std::vector<uint32_t> values;
+};
+
+struct SimAnalyzer {
+public:
+	SimSignals* signals;
+	SimExpr_Resolver resolve;
+	vluint64_t* time;
+
+	std::vector<SimAnalyzer_Channel> channels;
+	bool capturing;
+
+	void Sample() {
+		if (!capturing) { return; }
+		uint64_t v = 0;
+		for (size_t i = 0; i < channels.size(); i++) {
+			const SimAnalyzer_Channel& c = channels[i];
+			v |= (c.signal->Read() & (((uint64_t)1 << c.width) - 1)) << c.shift;
+		}
+		Store(count & (depth - 1), v);
+		count++;
+		if (postLeft) {
+			if (--postLeft == 0) { Stop(); }
+		}
+		else if (waiting && trigger.Eval()) {
+			Trigger();
+		}
+	}
+
+	bool Add(const std::string& name);
+	void Remove(int index);
+	bool Start(const std::string& trigger_text);
+	void Stop();
+	void SetDepth(int log2);
+	void Draw(const char* title, bool* p_open, ImVec2 size);
+
+	SimAnalyzer();
+	~SimAnalyzer();
+
+private:
+	uint64_t* words;
+	int depthLog2;
+	uint64_t depth;			// samples, power of two
+	int stride;				// bits per sample
+	uint64_t mask;
+	uint64_t count;			// samples taken since Start()
+
+	// Trigger
+	SimExpr trigger;
+	bool waiting;
+	bool triggered;
+	uint64_t triggerSample;
+	vluint64_t triggerTime;
+	uint64_t postLeft;
+	int prePercent;			// share of the ring kept from before the trigger
+
+	// Viewer
+	char addName[128];
+	char triggerText[128];
+	bool fit;
+
+	void Store(uint64_t index, uint64_t v) {
+		uint64_t bit = index * stride;
+		size_t w = bit >> 6;
+		int off = bit & 63;
+		words[w] = (words[w] & ~(mask << off)) | (v << off);
+		if (off + stride > 64) {
+			words[w + 1] = (words[w + 1] & ~(mask >> (64 - off))) | (v >> (64 - off));
+		}
+	}
+	uint64_t Load(uint64_t index);
+	void Trigger();
+	void Layout();
+	void Decode();
+};
@@ -4,13 +4,9 @@
 #include <list>
 using namespace std;
 
-SimClock clk;
-bool outputToFile;
-ofstream audioFile;
-
 SimAudio::SimAudio(int systemClockFrequency, bool saveToFile)
 {
-	clk = SimClock(systemClockFrequency / 44100);
+	clock = SimClock(systemClockFrequency / 44100);
 	outputToFile = saveToFile;
 }
 
@@ -20,8 +16,8 @@ SimAudio::~SimAudio()
 }
 
 void SimAudio::Clock(signed short left, signed short right) {
-	clk.Tick();
-	if (clk.IsRising()) {
+	clock.Tick();
+	if (clock.IsRising()) {
 		// Output audio (left channel only for now)
 		float l = left / 32768.0f;
 		if (outputToFile) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <fstream>
 #include "sim_clock.h"
 
 struct SimAudio {
@@ -20,4 +21,8 @@ public:
 	void CollectDebug(signed short left, signed short right);
 	void Initialise();
 	void CleanUp();
+
+private:
+	bool outputToFile;
+	std::ofstream audioFile;
 };
@@ -0,0 +1,248 @@
+#include "sim_bisect.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <sys/wait.h>
+#else
+#define WIN32
+#endif
+
+struct SimBisect_Result {
+	uint64_t first;
+	int32_t frame;		// -1 = the search failed
+	int32_t pad;
+};
+
+SimBisect::SimBisect(int jobs) {
+	maxJobs = jobs;
+#ifndef WIN32
+	if (maxJobs <= 0) { maxJobs = (int)sysconf(_SC_NPROCESSORS_ONLN); }
+#endif
+	if (maxJobs <= 0) { maxJobs = 1; }
+	every = 1;
+	time = NULL;
+	frame = NULL;
+	found = false;
+	first = 0;
+	firstFrame = 0;
+	resultFd = -1;
+}
+
+#ifndef WIN32
+
+static bool read_all(int fd, void* data, size_t size) {
+	uint8_t* p = (uint8_t*)data;
+	while (size > 0) {
+		ssize_t n = read(fd, p, size);
+		if (n <= 0) { return false; }
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*)data;
+	while (size > 0) {
+		ssize_t n = write(fd, p, size);
+		if (n <= 0) { return false; }
+		p += n;
+		size -= (size_t)n;
+	}
+	return true;
+}
+
+void SimBisect::Release(int fd) {
+	close(fd);
+	for (size_t i = 0; i < privateFds.size(); i++) {
+		if (privateFds[i] == fd) {
+			privateFds.erase(privateFds.begin() + i);
+			break;
+		}
+	}
+}
+
+// Fork a copy that runs to probeAt, reports whether the condition holds
+// there, then parks. The parent gets the copy's pid and its two pipes. The
+// copy returns 0 only once woken with the end of the interval it is to
+// search; if its wake pipe closes first it just exits.
+int SimBisect::Fork(vluint64_t probeAt, int& wakeFd, int& reportFd, vluint64_t& end) {
+	int wake[2], report[2];
+	if (pipe(wake) != 0) { return -1; }
+	if (pipe(report) != 0) {
+		close(wake[0]);
+		close(wake[1]);
+		return -1;
+	}
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(wake[0]);
+		close(wake[1]);
+		close(report[0]);
+		close(report[1]);
+		return -1;
+	}
+	if (pid > 0) {
+		close(wake[0]);
+		close(report[1]);
+		wakeFd = wake[1];
+		reportFd = report[0];
+		privateFds.push_back(wakeFd);
+		privateFds.push_back(reportFd);
+		return pid;
+	}
+
+	// The copy: nothing of the parent's bookkeeping may stay open here, or
+	// the processes it belongs to would never see their pipes close
+	close(wake[1]);
+	close(report[0]);
+	for (size_t i = 0; i < privateFds.size(); i++) { close(privateFds[i]); }
+	privateFds.clear();
+	uint8_t holding = runTo(probeAt) && holds() ? 1 : 0;
+	bool ok = write_all(report[1], &holding, 1);
+	close(report[1]);
+	if (!ok || !read_all(wake[0], &end, sizeof(end))) { _exit(0); }
+	close(wake[0]);
+	return 0;
+}
+
+// In a copy parked where the condition is false; it holds at 'end'
+void SimBisect::Search(vluint64_t end) {
+	while (end - *time > 1) {
+		vluint64_t start = *time;
+		int n = end - start - 1 < (vluint64_t)maxJobs ? (int)(end - start - 1) : maxJobs;
+		std::vector<vluint64_t> at(n);
+		std::vector<int> wakes(n), reports(n);
+		bool adopted = false;
+		for (int j = 0; j < n && !adopted; j++) {
+			at[j] = start + (end - start) * (j + 1) / (n + 1);
+			vluint64_t next;
+			int pid = Fork(at[j], wakes[j], reports[j], next);
+			if (pid < 0) { Finish(0, -1); }
+			if (pid == 0) {
+				// This probe was the last one still false: carry on from here
+				end = next;
+				adopted = true;
+			}
+		}
+		if (adopted) { continue; }
+
+		int k = n;
+		for (int j = 0; j < n; j++) {
+			uint8_t holding;
+			if (!read_all(reports[j], &holding, 1)) { Finish(0, -1); }
+			if (holding && k == n) { k = j; }
+		}
+		for (int j = 0; j < n; j++) {
+			Release(reports[j]);
+			if (j != k - 1) { Release(wakes[j]); }
+		}
+		vluint64_t next = k < n ? at[k] : end;
+		if (k == 0) {
+			end = next;
+			continue;
+		}
+		bool ok = write_all(wakes[k - 1], &next, sizeof(next));
+		Release(wakes[k - 1]);
+		if (!ok) { Finish(0, -1); }
+		_exit(0);
+	}
+	save(snapshot);
+	Finish(end, *frame);
+}
+
+// Hand the answer (or a failure, atFrame -1) to Run() and go
+void SimBisect::Finish(vluint64_t at, int atFrame) {
+	SimBisect_Result r;
+	r.first = at;
+	r.frame = atFrame;
+	r.pad = 0;
+	write_all(resultFd, &r, sizeof(r));
+	fflush(stdout);
+	fflush(stderr);
+	_exit(atFrame < 0 ? 1 : 0);
+}
+
+bool SimBisect::Run() {
+	found = false;
+	error.clear();
+	if (holds()) {
+		found = true;
+		first = *time;
+		firstFrame = *frame;
+		return true;
+	}
+	int result[2];
+	if (pipe(result) != 0) {
+		error = "pipe failed";
+		return false;
+	}
+	resultFd = result[1];
+	privateFds.push_back(result[0]);
+
+	// Forward: keep a checkpoint parked at the last point still false
+	int wake = -1;
+	bool searching = false;
+	while (true) {
+		int reportFd, nextWake;
+		vluint64_t end;
+		int pid = Fork(*time, nextWake, reportFd, end);
+		if (pid < 0) {
+			error = "fork failed";
+			break;
+		}
+		if (pid == 0) {
+			Search(end);	// does not return
+		}
+		// Read its report before closing the pipe, or the write would kill it
+		uint8_t holding;
+		read_all(reportFd, &holding, 1);
+		Release(reportFd);
+		if (wake >= 0) { Release(wake); }
+		wake = nextWake;
+
+		bool more = runTo(*time + every);
+		if (holds()) {
+			end = *time;
+			searching = write_all(wake, &end, sizeof(end));
+			if (!searching) { error = "checkpoint is gone"; }
+			break;
+		}
+		if (!more) { break; }
+		while (waitpid(-1, NULL, WNOHANG) > 0) {}
+	}
+	if (wake >= 0) { Release(wake); }
+	close(resultFd);
+	resultFd = -1;
+
+	if (searching) {
+		SimBisect_Result r;
+		if (!read_all(result[0], &r, sizeof(r))) { error = "search processes died"; }
+		else if (r.frame < 0) { error = "search failed"; }
+		else {
+			found = true;
+			first = r.first;
+			firstFrame = r.frame;
+		}
+	}
+	Release(result[0]);
+	while (waitpid(-1, NULL, WNOHANG) > 0) {}
+	return error.empty();
+}
+
+#else
+
+bool SimBisect::Run() {
+	error = "not supported on Windows";
+	return false;
+}
+int SimBisect::Fork(vluint64_t probeAt, int& wakeFd, int& reportFd, vluint64_t& end) { return -1; }
+void SimBisect::Search(vluint64_t end) {}
+void SimBisect::Finish(vluint64_t at, int atFrame) {}
+void SimBisect::Release(int fd) {}
+
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+#include "verilated_heavy.h"
+#include <string>
+#include <vector>
+#include <functional>
+
+// Find the first cycle at which a condition holds
+//
+// The condition is checked at points only, so it has to stay true once it
+// has become true (a signal the bug leaves set, or "some frame so far
+// differed from the golden run"). Run() goes forward from where the model
+// is, checking at a checkpoint every 'every' main_time ticks. A checkpoint
+// is a forked copy of the whole process parked at that time, so host state
+// the RTL is fed from (input playback, video counters, the clock phase)
+// comes back exactly, which a VerilatedSave restore alone would not give.
+// Only the checkpoint before the current point is kept.
+//
+// Once the condition holds, the last checkpoint wakes up and splits the
+// interval between them with up to maxJobs probes running in parallel,
+// each a fork that runs to its point and reports. The last probe still
+// false becomes the searcher for the next, (maxJobs + 1) times smaller,
+// interval, until it is one tick wide. The final searcher saves the model
+// (save, e.g. VerilatedSave to 'snapshot') as it is one tick before the
+// condition and hands the answer back through a pipe.
+
+struct SimBisect {
+public:
+	int maxJobs;
+	vluint64_t every;
+	vluint64_t* time;
+	int* frame;
+	std::function<bool(vluint64_t t)> runTo;	// false once the run is over
+	std::function<bool()> holds;
+	std::function<void(const std::string& file)> save;
+	std::string snapshot;
+
+	// Results
+	bool found;
+	vluint64_t first;		// first main_time the condition holds at
+	int firstFrame;
+	std::string error;
+
+	bool Run();
+
+	SimBisect(int jobs);
+
+private:
+	int resultFd;
+	std::vector<int> privateFds;	// closed in every fork
+
+	int Fork(vluint64_t probeAt, int& wakeFd, int& reportFd, vluint64_t& end);
+	void Search(vluint64_t end);
+	void Finish(vluint64_t at, int atFrame);
+	void Release(int fd);
+};
@@ -0,0 +1,230 @@
+#include "sim_breakpoints.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_console.h"
+
+static DebugConsole console;
+
+static const char* type_names[BP_TYPES] = { "PC", "CPU write", "RAM write" };
+
+SimBreakpoints::SimBreakpoints() {
+	cpu_addr = NULL;
+	cpu_dout = NULL;
+	m1_n = NULL;
+	mreq_n = NULL;
+	mem_wr = NULL;
+	mem_addr = NULL;
+	time = NULL;
+	maps[BP_PC] = (uint64_t*)calloc(cpu_size / 64, sizeof(uint64_t));
+	maps[BP_CPU_WRITE] = (uint64_t*)calloc(cpu_size / 64, sizeof(uint64_t));
+	maps[BP_RAM_WRITE] = (uint64_t*)calloc(ram_size / 64, sizeof(uint64_t));
+	armed = false;
+	lastFetch = false;
+	lastWrite = false;
+	memset(&last, 0, sizeof(last));
+	last.index = -1;
+
+	newType = BP_PC;
+	strcpy(newAddr, "0000");
+	newEnd[0] = 0;
+	newCond[0] = 0;
+	newIgnore = 0;
+}
+
+SimBreakpoints::~SimBreakpoints() {
+	for (int t = 0; t < BP_TYPES; t++) { free(maps[t]); }
+}
+
+// Find the bus signals by name. Without them no breakpoint fires.
+bool SimBreakpoints::Attach(SimSignals* signals) {
+	struct { void** ptr; const char* name; int bytes; } wanted[] = {
+		{ (void**)&cpu_addr, "motherboard.cpu_addr", 2 }, { (void**)&cpu_dout, "motherboard.cpu_dout", 1 },
+		{ (void**)&mreq_n, "motherboard.MREQ_n", 1 }, { (void**)&mem_wr, "motherboard.mem_wr", 1 },
+		{ (void**)&mem_addr, "motherboard.mem_addr", 4 }, { (void**)&m1_n, "motherboard.M1_n", 1 },
+	};
+	m1_n = NULL;
+	for (size_t i = 0; i < sizeof(wanted) / sizeof(wanted[0]); i++) {
+		const SimSignal* s = signals->Get(wanted[i].name);
+		if (!s || s->bytes != wanted[i].bytes) {
+			console.AddLog("[error] Breakpoints: %s is not public in this model", wanted[i].name);
+			m1_n = NULL;
+			return false;
+		}
+		*wanted[i].ptr = s->ptr;
+	}
+	return true;
+}
+
+const char* SimBreakpoints::TypeName(int type) {
+	return type >= 0 && type < BP_TYPES ? type_names[type] : "?";
+}
+
+int SimBreakpoints::Add(int type, uint32_t addr, uint32_t end, uint8_t cond_mask, uint8_t cond_value, vluint64_t ignore) {
+	uint32_t size = type == BP_RAM_WRITE ? ram_size : cpu_size;
+	if (type < 0 || type >= BP_TYPES || addr >= size) {
+		console.AddLog("[error] Breakpoint address %X out of range", addr);
+		return -1;
+	}
+	if (end < addr) { end = addr; }
+	if (end >= size) { end = size - 1; }
+	SimBreakpoint bp;
+	bp.type = type;
+	bp.addr = addr;
+	bp.end = end;
+	bp.enabled = true;
+	bp.cond_mask = cond_mask;
+	bp.cond_value = cond_value & cond_mask;
+	bp.ignore = ignore;
+	bp.hits = 0;
+	breakpoints.push_back(bp);
+	Rebuild();
+	return (int)breakpoints.size() - 1;
+}
+
+void SimBreakpoints::Remove(int index) {
+	if (index < 0 || index >= (int)breakpoints.size()) { return; }
+	breakpoints.erase(breakpoints.begin() + index);
+	Rebuild();
+}
+
+void SimBreakpoints::SetEnabled(int index, bool enabled) {
+	if (index < 0 || index >= (int)breakpoints.size()) { return; }
+	breakpoints[index].enabled = enabled;
+	Rebuild();
+}
+
+void SimBreakpoints::Clear() {
+	breakpoints.clear();
+	Rebuild();
+}
+
+void SimBreakpoints::ResetHits() {
+	for (size_t i = 0; i < breakpoints.size(); i++) { breakpoints[i].hits = 0; }
+}
+
+// Set the bits of every enabled range; called whenever the list changes
+void SimBreakpoints::Rebuild() {
+	memset(maps[BP_PC], 0, cpu_size / 8);
+	memset(maps[BP_CPU_WRITE], 0, cpu_size / 8);
+	memset(maps[BP_RAM_WRITE], 0, ram_size / 8);
+	armed = false;
+	for (size_t i = 0; i < breakpoints.size(); i++) {
+		SimBreakpoint& bp = breakpoints[i];
+		if (!bp.enabled) { continue; }
+		for (uint32_t a = bp.addr; a <= bp.end; a++) {
+			maps[bp.type][a >> 6] |= 1ULL << (a & 63);
+		}
+		armed = true;
+	}
+}
+
+// Slow path once a bit test matched: apply conditions and hit counts
+bool SimBreakpoints::Hit(int type, uint32_t addr) {
+	uint8_t data = cpu_dout ? *cpu_dout : 0;
+	bool stop = false;
+	for (size_t i = 0; i < breakpoints.size(); i++) {
+		SimBreakpoint& bp = breakpoints[i];
+		if (!bp.enabled || bp.type != type || addr < bp.addr || addr > bp.end) { continue; }
+		if (type != BP_PC && (data & bp.cond_mask) != bp.cond_value) { continue; }
+		bp.hits++;
+		if (bp.hits <= bp.ignore || stop) { continue; }
+		last.index = (int)i;
+		last.type = type;
+		last.addr = addr;
+		last.data = data;
+		last.time = time ? *time : 0;
+		stop = true;
+	}
+	if (stop) {
+		if (type == BP_PC) {
+			console.AddLog("Breakpoint %d: %s %04X at %llu", last.index, type_names[type], addr, (unsigned long long)last.time);
+		}
+		else {
+			console.AddLog("Breakpoint %d: %s %06X <- %02X at %llu", last.index, type_names[type], addr, data, (unsigned long long)last.time);
+		}
+	}
+	return stop;
+}
+
+void SimBreakpoints::Draw(const char* title, bool* p_open, ImVec2 size) {
+	ImGui::SetNextWindowSize(size, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin(title, p_open)) {
+		ImGui::End();
+		return;
+	}
+
+	// Add form
+	ImGui::SetNextItemWidth(100);
+	ImGui::Combo("##type", &newType, type_names, BP_TYPES);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(60);
+	ImGui::InputText("addr", newAddr, IM_ARRAYSIZE(newAddr), ImGuiInputTextFlags_CharsHexadecimal);
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(60);
+	ImGui::InputText("end", newEnd, IM_ARRAYSIZE(newEnd), ImGuiInputTextFlags_CharsHexadecimal);
+	ImGui::SetNextItemWidth(60);
+	ImGui::InputText("data[/mask]", newCond, IM_ARRAYSIZE(newCond));
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(80);
+	ImGui::InputInt("ignore", &newIgnore);
+	ImGui::SameLine();
+	if (ImGui::Button("Add")) {
+		uint32_t addr = (uint32_t)strtoul(newAddr, NULL, 16);
+		uint32_t end = newEnd[0] ? (uint32_t)strtoul(newEnd, NULL, 16) : addr;
+		uint8_t mask = 0, value = 0;
+		if (newCond[0]) {
+			char* slash = NULL;
+			value = (uint8_t)strtoul(newCond, &slash, 16);
+			mask = (slash && *slash == '/') ? (uint8_t)strtoul(slash + 1, NULL, 16) : 0xFF;
+		}
+		Add(newType, addr, end, mask, value, newIgnore > 0 ? newIgnore : 0);
+	}
+
+	if (last.index >= 0) {
+		ImGui::Text("Last hit: #%d %s %06X data=%02X at %llu", last.index, type_names[last.type], last.addr, last.data, (unsigned long long)last.time);
+	}
+	if (ImGui::Button("Reset hits")) { ResetHits(); }
+	ImGui::SameLine();
+	if (ImGui::Button("Clear all")) { Clear(); }
+	ImGui::Separator();
+
+	int remove = -1;
+	ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersV;
+	if (ImGui::BeginTable("breakpoints", 6, flags)) {
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("on", ImGuiTableColumnFlags_WidthFixed, 24);
+		ImGui::TableSetupColumn("type", ImGuiTableColumnFlags_WidthFixed, 70);
+		ImGui::TableSetupColumn("range", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("data", ImGuiTableColumnFlags_WidthFixed, 50);
+		ImGui::TableSetupColumn("hits", ImGuiTableColumnFlags_WidthFixed, 80);
+		ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 20);
+		ImGui::TableHeadersRow();
+		for (int i = 0; i < (int)breakpoints.size(); i++) {
+			SimBreakpoint& bp = breakpoints[i];
+			ImGui::PushID(i);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			bool enabled = bp.enabled;
+			if (ImGui::Checkbox("##on", &enabled)) { SetEnabled(i, enabled); }
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(type_names[bp.type]);
+			ImGui::TableNextColumn();
+			if (bp.end != bp.addr) { ImGui::Text("%06X-%06X", bp.addr, bp.end); }
+			else { ImGui::Text("%06X", bp.addr); }
+			ImGui::TableNextColumn();
+			if (bp.cond_mask) { ImGui::Text("%02X/%02X", bp.cond_value, bp.cond_mask); }
+			else { ImGui::TextDisabled("any"); }
+			ImGui::TableNextColumn();
+			if (bp.ignore) { ImGui::Text("%llu/%llu", (unsigned long long)bp.hits, (unsigned long long)bp.ignore); }
+			else { ImGui::Text("%llu", (unsigned long long)bp.hits); }
+			ImGui::TableNextColumn();
+			if (ImGui::SmallButton("x")) { remove = i; }
+			ImGui::PopID();
+		}
+		ImGui::EndTable();
+	}
+	if (remove >= 0) { Remove(remove); }
+	ImGui::End();
+}
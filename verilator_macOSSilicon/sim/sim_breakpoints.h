@@ -0,0 +1,108 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "imgui.h"
+#include "sim_signals.h"
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+// PC breakpoints and memory watchpoints
+//
+// Every enabled breakpoint sets the bits for its address range in one of
+// three bitmaps: opcode fetch address and write address in the 64K CPU
+// space, and write address in the 8MB RAM. Check() runs on each rising
+// edge and only does one bit test per new fetch or write, so breakpoints
+// can stay enabled in full speed batch runs. The list is only walked when
+// a bit is set, to apply the data condition and hit count.
+
+#define BP_PC        0	// opcode fetch (M1) at CPU address
+#define BP_CPU_WRITE 1	// memory write at CPU address
+#define BP_RAM_WRITE 2	// memory write at RAM address
+#define BP_TYPES     3
+
+struct SimBreakpoint {
+public:
+	int type;
+	uint32_t addr;
+	uint32_t end;			// inclusive
+	bool enabled;
+	uint8_t cond_mask;		// writes only: stop if (data & mask) == value, 0 = any data
+	uint8_t cond_value;
+	vluint64_t ignore;		// let this many hits pass before stopping
+	vluint64_t hits;
+};
+
+struct SimBreakpoint_Hit {
+public:
+	int index;
+	int type;
+	uint32_t addr;
+	uint8_t data;
+	vluint64_t time;
+};
+
+struct SimBreakpoints {
+public:
+	static const uint32_t cpu_size = 0x10000;
+	static const uint32_t ram_size = 0x800000;
+
+	// Model signals, found by Attach()
+	SData* cpu_addr;
+	CData* cpu_dout;
+	CData* m1_n;
+	CData* mreq_n;
+	CData* mem_wr;
+	IData* mem_addr;
+	vluint64_t* time;
+
+	std::vector<SimBreakpoint> breakpoints;
+	SimBreakpoint_Hit last;
+
+	bool Check() {
+		if (!armed || !m1_n) { return false; }
+		bool fetch = !*m1_n && !*mreq_n;
+		bool write = *mem_wr;
+		bool stop = false;
+		if (fetch && !lastFetch && Test(maps[BP_PC], *cpu_addr)) {
+			stop |= Hit(BP_PC, *cpu_addr);
+		}
+		if (write && !lastWrite) {
+			if (Test(maps[BP_CPU_WRITE], *cpu_addr)) { stop |= Hit(BP_CPU_WRITE, *cpu_addr); }
+			if (Test(maps[BP_RAM_WRITE], *mem_addr & (ram_size - 1))) { stop |= Hit(BP_RAM_WRITE, *mem_addr & (ram_size - 1)); }
+		}
+		lastFetch = fetch;
+		lastWrite = write;
+		return stop;
+	}
+
+	bool Attach(SimSignals* signals);
+	int Add(int type, uint32_t addr, uint32_t end, uint8_t cond_mask, uint8_t cond_value, vluint64_t ignore);
+	void Remove(int index);
+	void SetEnabled(int index, bool enabled);
+	void Clear();
+	void ResetHits();
+	static const char* TypeName(int type);
+	void Draw(const char* title, bool* p_open, ImVec2 size);
+
+	SimBreakpoints();
+	~SimBreakpoints();
+
+private:
+	uint64_t* maps[BP_TYPES];
+	bool armed;
+	bool lastFetch;
+	bool lastWrite;
+
+	// Add form
+	int newType;
+	char newAddr[16];
+	char newEnd[16];
+	char newCond[16];
+	int newIgnore;
+
+	static bool Test(const uint64_t* map, uint32_t a) {
+		return (map[a >> 6] >> (a & 63)) & 1;
+	}
+	bool Hit(int type, uint32_t addr);
+	void Rebuild();
+};
@@ -14,21 +14,6 @@
 
 static DebugConsole console;
 
-FILE* ioctl_file = NULL;
-int ioctl_next_addr = -1;
-int ioctl_last_index = -1;
-
-IData* ioctl_addr = NULL;
-CData* ioctl_index = NULL;
-CData* ioctl_wait = NULL;
-CData* ioctl_download = NULL;
-CData* ioctl_upload = NULL;
-CData* ioctl_wr = NULL;
-CData* ioctl_dout = NULL;
-CData* ioctl_din = NULL;
-
-std::queue<SimBus_DownloadChunk> downloadQueue;
-
 void SimBus::QueueDownload(std::string file, int index) {
 	SimBus_DownloadChunk chunk = SimBus_DownloadChunk(file, index);
 	downloadQueue.push(chunk);
@@ -40,8 +25,13 @@ void SimBus::QueueDownload(std::string file, int index, bool restart) {
 bool SimBus::HasQueue() {
 	return downloadQueue.size() > 0;
 }
+std::vector<std::string> SimBus::QueuedFiles() {
+	std::vector<std::string> files;
+	std::queue<SimBus_DownloadChunk> queue = downloadQueue;
+	for (; !queue.empty(); queue.pop()) { files.push_back(queue.front().file); }
+	return files;
+}
 
-int nextchar = 0;
 void SimBus::BeforeEval()
 {
 	// If no file is open and there is a download queued
@@ -59,6 +49,7 @@ void SimBus::BeforeEval()
 		// Set address and index
 		*ioctl_addr = ioctl_next_addr;
 		*ioctl_index = currentDownload.index;
+		currentDownload.addr = ioctl_next_addr + 1;
 
 		// Open file
 		ioctl_file = fopen(currentDownload.file.c_str(), "rb");
@@ -81,6 +72,8 @@ void SimBus::BeforeEval()
 				*ioctl_download = 0;
 				*ioctl_wr = 0;
 				console.AddLog("ioctl_download complete %d", ioctl_next_addr);
+				lastDownload = currentDownload;
+				downloadsDone++;
 			}
 			if (ioctl_file) {
 				int curchar = fgetc(ioctl_file);
@@ -118,8 +111,12 @@ SimBus::SimBus(DebugConsole c) {
 	ioctl_wr = NULL;
 	ioctl_dout = NULL;
 	ioctl_din = NULL;
+	ioctl_file = NULL;
+	ioctl_next_addr = -1;
+	nextchar = 0;
+	downloadsDone = 0;
 }
 
 SimBus::~SimBus() {
-
+	if (ioctl_file) { fclose(ioctl_file); }
 }
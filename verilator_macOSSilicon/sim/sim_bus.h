@@ -1,5 +1,6 @@
 #pragma once
 #include <queue>
+#include <vector>
 #include "verilated_heavy.h"
 #include "sim_console.h"
 
@@ -14,21 +15,25 @@ public:
 	std::string file;
 	int index;
 	bool restart;
+	int addr;		// ioctl_addr of the first byte, once started
 	
 	SimBus_DownloadChunk() {
 		file = "";
 		index = -1;
+		addr = -1;
 	}
 
 	SimBus_DownloadChunk(std::string file, int index) {
 		this->restart = false;
 		this->file = std::string(file);
 		this->index = index;
+		this->addr = -1;
 	}
 	SimBus_DownloadChunk(std::string file, int index, bool restart) {
 		this->restart = restart;
 		this->file = std::string(file);
 		this->index = index;
+		this->addr = -1;
 	}
 };
 
@@ -44,11 +49,16 @@ public:
 	CData* ioctl_dout;
 	CData* ioctl_din;
 
+	// Counts finished downloads; the last one is in lastDownload
+	int downloadsDone;
+	SimBus_DownloadChunk lastDownload;
+
 	void BeforeEval(void);
 	void AfterEval(void);
 	void QueueDownload(std::string file, int index);
 	void QueueDownload(std::string file, int index, bool restart);
 	bool HasQueue();
+	std::vector<std::string> QueuedFiles();
 
 	SimBus(DebugConsole c);
 	~SimBus();
@@ -56,5 +66,8 @@ public:
 private:
 	std::queue<SimBus_DownloadChunk> downloadQueue;
 	SimBus_DownloadChunk currentDownload;
+	FILE* ioctl_file;
+	int ioctl_next_addr;
+	int nextchar;
 	void SetDownload(std::string file, int index);
 };
@@ -0,0 +1,149 @@
+#include "sim_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+#else
+#define WIN32
+#include <direct.h>
+#include <io.h>
+#include <process.h>
+#define getpid _getpid
+#endif
+
+#define CACHE_FORMAT "simcache 1"
+
+SimCache_Entry::SimCache_Entry() {
+	status = 0;
+	seconds = 0;
+}
+
+SimCache::SimCache() {
+	recording = false;
+	key = 0xcbf29ce484222325ULL;	// FNV-1a 64
+}
+
+void SimCache::Feed(const void* data, size_t size) {
+	const uint8_t* p = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++) { key = (key ^ p[i]) * 0x100000001b3ULL; }
+}
+
+// Each item goes in with its length, so "ab","c" and "a","bc" differ
+void SimCache::Add(const void* data, size_t size) {
+	uint64_t length = size;
+	Feed(&length, sizeof(length));
+	Feed(data, size);
+}
+
+bool SimCache::AddFile(const std::string& file) {
+	FILE* f = fopen(file.c_str(), "rb");
+	if (!f) { return false; }
+	if (fseek(f, 0, SEEK_END) != 0) {
+		fclose(f);
+		return false;
+	}
+	uint64_t length = (uint64_t)ftell(f);
+	fseek(f, 0, SEEK_SET);
+	Feed(&length, sizeof(length));
+	char buf[65536];
+	size_t got;
+	while ((got = fread(buf, 1, sizeof(buf), f)) > 0) { Feed(buf, got); }
+	fclose(f);
+	return true;
+}
+
+// The running binary, falling back to argv[0] where it can't be found
+bool SimCache::AddExecutable(const char* argv0) {
+	std::string path = argv0;
+#if defined(__APPLE__)
+	char buf[4096];
+	uint32_t size = sizeof(buf);
+	if (_NSGetExecutablePath(buf, &size) == 0) { path = buf; }
+#elif !defined(WIN32)
+	path = "/proc/self/exe";
+#endif
+	return AddFile(path) || AddFile(argv0);
+}
+
+std::string SimCache::Key() {
+	char buf[20];
+	snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)key);
+	return buf;
+}
+
+std::string SimCache::Path() {
+	return dir + "/" + Key() + ".txt";
+}
+
+bool SimCache::Open(std::string directory) {
+	dir = directory;
+#ifndef WIN32
+	mkdir(dir.c_str(), 0777);
+	struct stat st;
+	if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+#else
+	_mkdir(dir.c_str());
+	if (_access(dir.c_str(), 0) != 0) {
+#endif
+		fprintf(stderr, "Cannot use cache directory %s\n", dir.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool SimCache::Lookup(SimCache_Entry& out) {
+	FILE* f = fopen(Path().c_str(), "rb");
+	if (!f) { return false; }
+	out = SimCache_Entry();
+	bool valid = false, complete = false;
+	char line[4096];
+	while (fgets(line, sizeof(line), f)) {
+		std::string s = line;
+		if (!s.empty() && s[s.size() - 1] == '\n') { s.erase(s.size() - 1); }
+		size_t space = s.find(' ');
+		std::string field = s.substr(0, space);
+		std::string value = space == std::string::npos ? "" : s.substr(space + 1);
+		if (s == CACHE_FORMAT) { valid = true; }
+		else if (field == "status") { out.status = atoi(value.c_str()); }
+		else if (field == "seconds") { out.seconds = atof(value.c_str()); }
+		else if (field == "report") { out.report += value + "\n"; }
+		else if (field == "hash") { out.hashes.push_back(strtoull(value.c_str(), NULL, 16)); }
+		else if (field == "end") { complete = true; }
+	}
+	fclose(f);
+	return valid && complete;
+}
+
+bool SimCache::Store() {
+	std::string path = Path();
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), ".tmp%d", (int)getpid());
+	FILE* f = fopen((path + tmp).c_str(), "wb");
+	if (!f) {
+		fprintf(stderr, "Cannot write cache entry %s\n", path.c_str());
+		return false;
+	}
+	fprintf(f, "%s\nkey %s\nstatus %d\nseconds %.3f\nframes %d\n", CACHE_FORMAT, Key().c_str(), entry.status, entry.seconds, (int)entry.hashes.size());
+	size_t start = 0;
+	while (start < entry.report.size()) {
+		size_t nl = entry.report.find('\n', start);
+		if (nl == std::string::npos) { nl = entry.report.size(); }
+		fprintf(f, "report %s\n", entry.report.substr(start, nl - start).c_str());
+		start = nl + 1;
+	}
+	for (size_t i = 0; i < entry.hashes.size(); i++) { fprintf(f, "hash %016llx\n", (unsigned long long)entry.hashes[i]); }
+	fprintf(f, "end\n");
+	bool ok = fclose(f) == 0;
+	if (ok) { ok = rename((path + tmp).c_str(), path.c_str()) == 0; }
+	if (!ok) {
+		remove((path + tmp).c_str());
+		fprintf(stderr, "Cannot write cache entry %s\n", path.c_str());
+	}
+	return ok;
+}
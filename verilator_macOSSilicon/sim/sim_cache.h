@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Result cache for headless regression runs
+//
+// The key is a hash of everything that decides how a run ends, fed in with
+// Add(): the sim binary (the verilated RTL and the host code driving it),
+// the command line with its cycle budget, and the contents of the files it
+// loads (CPR/DSK images, input scripts, snapshots). The value, one text
+// file per key in the cache directory, is what the run left behind: its
+// exit status, the lines it printed, the hash of every frame and the wall
+// time it took. A later run with the same key prints the same lines and
+// exits the same way without simulating anything. Hung runs (exit status 3)
+// are never stored, since their report names snapshot files that a replay
+// would not write.
+//
+// Entries are written to a temporary name and renamed into place, so any
+// number of runners can share one directory.
+
+struct SimCache_Entry {
+public:
+	int status;						// exit status
+	double seconds;					// wall time of the run that made it
+	std::string report;				// what it printed
+	std::vector<uint64_t> hashes;	// SimVideo::frame_hash of frames 1..n
+
+	SimCache_Entry();
+};
+
+struct SimCache {
+public:
+	std::string dir;
+	bool recording;
+	SimCache_Entry entry;
+
+	// Every rising edge while recording: keep the hash of each new frame
+	void Frame(int count, uint64_t hash) {
+		if (recording && count != (int)entry.hashes.size()) { entry.hashes.push_back(hash); }
+	}
+
+	bool Open(std::string dir);
+	void Add(const void* data, size_t size);
+	void Add(const std::string& text) { Add(text.data(), text.size()); }
+	bool AddFile(const std::string& file);
+	bool AddExecutable(const char* argv0);
+	std::string Key();
+
+	bool Lookup(SimCache_Entry& out);
+	bool Store();
+
+	SimCache();
+
+private:
+	uint64_t key;
+	void Feed(const void* data, size_t size);
+	std::string Path();
+};
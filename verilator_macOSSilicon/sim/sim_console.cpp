@@ -1,5 +1,7 @@
 #include "sim_console.h"
 #include <string>
+#include <atomic>
+#include <stdarg.h>
 #include "imgui.h"
 
 // Demonstrate creating a simple console window, with scrolling, filtering, completion and history.
@@ -13,20 +15,78 @@ ImGuiTextFilter       Filter;
 bool                  AutoScroll;
 bool                  ScrollToBottom;
 
+// Log ring
+// --------
+// Producers claim a sequence number with one atomic add, format straight
+// into the slot and publish it by storing seq + 1. The GUI copies a slot
+// out and checks the published seq before and after the copy, so a line
+// that was half written, or lapped while being copied, is skipped.
+struct DebugConsole_Line {
+	std::atomic<unsigned long long> seq;
+	unsigned char level;
+	unsigned char category;
+	char text[DebugConsole::line_size];
+};
+
+static DebugConsole_Line      Lines[DebugConsole::capacity];
+static std::atomic<unsigned long long> LineHead(0);
+unsigned long long    LineTail = 0;      // first seq still shown (moved by Clear)
+ImVector<unsigned long long> Visible;    // seqs passing the filters, oldest first
+unsigned long long    VisibleNext = 0;   // next seq to test against the filters
+int                   MinLevel = LOG_DEBUG;
+bool                  ShowCategory[LOG_CATEGORIES] = { true, true, true, true, true, true };
+static const char*    LevelNames[] = { "debug", "info", "warn", "error" };
+static const char*    CategoryNames[] = { "sim", "bus", "input", "video", "audio", "rtl" };
+
+static void LogV(int level, int category, const char* fmt, va_list args)
+{
+	unsigned long long seq = LineHead.fetch_add(1, std::memory_order_relaxed);
+	DebugConsole_Line& line = Lines[seq & (DebugConsole::capacity - 1)];
+	line.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	vsnprintf(line.text, sizeof(line.text), fmt, args);
+	line.level = (unsigned char)level;
+	line.category = (unsigned char)category;
+	line.seq.store(seq + 1, std::memory_order_release);
+}
+
+struct DebugConsole_Copy {
+	unsigned char level;
+	unsigned char category;
+	char text[DebugConsole::line_size];
+};
+
+// Copies the line for seq, false if it was overwritten or isn't finished
+static bool GetLine(unsigned long long seq, DebugConsole_Copy& copy)
+{
+	const DebugConsole_Line& line = Lines[seq & (DebugConsole::capacity - 1)];
+	if (line.seq.load(std::memory_order_acquire) != seq + 1)
+		return false;
+	copy.level = line.level;
+	copy.category = line.category;
+	memcpy(copy.text, line.text, sizeof(copy.text));
+	copy.text[sizeof(copy.text) - 1] = 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return line.seq.load(std::memory_order_relaxed) == seq + 1;
+}
 
-ImVector<char*>       Items;
 static char* Strdup(const char* str) { size_t len = strlen(str) + 1; void* buf = malloc(len); IM_ASSERT(buf); return (char*)memcpy(buf, (const void*)str, len); }
 
-void DebugConsole::AddLog(const char* fmt, ...) IM_FMTARGS(2)
+// Untagged lines are info, or error if they carry the old "[error]" marker
+void DebugConsole::AddLog(const char* fmt, ...)
 {
-	// FIXME-OPT
-	char buf[1024];
 	va_list args;
 	va_start(args, fmt);
-	vsnprintf(buf, IM_ARRAYSIZE(buf), fmt, args);
-	buf[IM_ARRAYSIZE(buf) - 1] = 0;
+	LogV(strstr(fmt, "[error]") ? LOG_ERROR : LOG_INFO, LOG_SIM, fmt, args);
+	va_end(args);
+}
+
+void DebugConsole::Log(int level, int category, const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	LogV(level, category, fmt, args);
 	va_end(args);
-	Items.push_back(Strdup(buf));
 }
 
 DebugConsole::DebugConsole()
@@ -57,9 +117,36 @@ static void  Strtrim(char* str) { char* str_end = str + strlen(str); while (str_
 
 void DebugConsole::ClearLog()
 {
-	for (int i = 0; i < Items.Size; i++)
-		free(Items[i]);
-	Items.clear();
+	LineTail = LineHead.load(std::memory_order_acquire);
+	VisibleNext = LineTail;
+	Visible.clear();
+}
+
+static bool PassFilters(const DebugConsole_Copy& line)
+{
+	return line.level >= MinLevel && ShowCategory[line.category % LOG_CATEGORIES] && Filter.PassFilter(line.text);
+}
+
+// Bring the visible list up to date: drop lines that have been overwritten
+// and test only the lines added since last frame against the filters
+static void UpdateVisible(bool rebuild)
+{
+	unsigned long long head = LineHead.load(std::memory_order_acquire);
+	unsigned long long oldest = head > DebugConsole::capacity ? head - DebugConsole::capacity : 0;
+	if (oldest < LineTail) { oldest = LineTail; }
+	if (rebuild || VisibleNext < oldest) {
+		Visible.clear();
+		VisibleNext = oldest;
+	}
+	int drop = 0;
+	while (drop < Visible.Size && Visible[drop] < oldest) { drop++; }
+	if (drop) { Visible.erase(Visible.begin(), Visible.begin() + drop); }
+	DebugConsole_Copy line;
+	while (VisibleNext < head) {
+		if (!GetLine(VisibleNext, line)) { break; } // still being written, pick it up next frame
+		if (PassFilters(line)) { Visible.push_back(VisibleNext); }
+		VisibleNext++;
+	}
 }
 
 void DebugConsole::Draw(const char* title, bool* p_open, ImVec2 size)
@@ -90,18 +177,26 @@ void DebugConsole::Draw(const char* title, bool* p_open, ImVec2 size)
 	ImGui::Separator();
 
 	// Options menu
+	bool rebuild = false;
 	if (ImGui::BeginPopup("Options"))
 	{
 		ImGui::Checkbox("Auto-scroll", &AutoScroll);
+		ImGui::Separator();
+		for (int c = 0; c < LOG_CATEGORIES; c++)
+			rebuild |= ImGui::Checkbox(CategoryNames[c], &ShowCategory[c]);
 		ImGui::EndPopup();
 	}
 
-	// Options, Filter
+	// Options, Level, Filter
 	if (ImGui::Button("Options"))
 		ImGui::OpenPopup("Options");
 	ImGui::SameLine();
-	Filter.Draw("Filter (\"incl,-excl\") (\"error\")", 180);
+	ImGui::SetNextItemWidth(70);
+	rebuild |= ImGui::Combo("##level", &MinLevel, LevelNames, IM_ARRAYSIZE(LevelNames));
+	ImGui::SameLine();
+	rebuild |= Filter.Draw("Filter (\"incl,-excl\") (\"error\")", 180);
 	ImGui::Separator();
+	UpdateVisible(rebuild);
 
 	const float footer_height_to_reserve = ImGui::GetStyle().ItemSpacing.y + ImGui::GetFrameHeightWithSpacing(); // 1 separator, 1 input text
 	ImGui::BeginChild("ScrollingRegion", ImVec2(0, -footer_height_to_reserve), false, ImGuiWindowFlags_HorizontalScrollbar); // Leave room for 1 separator + 1 InputText
@@ -111,34 +206,35 @@ void DebugConsole::Draw(const char* title, bool* p_open, ImVec2 size)
 		ImGui::EndPopup();
 	}
 
-	// Display every line as a separate entry so we can change their color or add custom widgets. If you only want raw text you can use ImGui::TextUnformatted(log.begin(), log.end());
-	// NB- if you have thousands of entries this approach may be too inefficient and may require user-side clipping to only process visible items.
-	// You can seek and display only the lines that are visible using the ImGuiListClipper helper, if your elements are evenly spaced and you have cheap random access to the elements.
-	// To use the clipper we could replace the 'for (int i = 0; i < Items.Size; i++)' loop with:
-	//     ImGuiListClipper clipper(Items.Size);
-	//     while (clipper.Step())
-	//         for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
-	// However, note that you can not use this code as is if a filter is active because it breaks the 'cheap random-access' property. We would need random-access on the post-filtered list.
-	// A typical application wanting coarse clipping and filtering may want to pre-compute an array of indices that passed the filtering test, recomputing this array when user changes the filter,
-	// and appending newly elements as they are inserted. This is left as a task to the user until we can manage to improve this example code!
-	// If your items are of variable size you may want to implement code similar to what ImGuiListClipper does. Or split your data into fixed height items to allow random-seeking into your list.
+	// Only the visible part of the filtered list is submitted
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(4, 1)); // Tighten spacing
 	if (copy_to_clipboard)
 		ImGui::LogToClipboard();
-	for (int i = 0; i < Items.Size; i++)
+	ImGuiListClipper clipper;
+	clipper.Begin(Visible.Size);
+	if (copy_to_clipboard)
+		clipper.ForceDisplayRangeByIndices(0, Visible.Size);
+	while (clipper.Step())
 	{
-		const char* item = Items[i];
-		if (!Filter.PassFilter(item))
-			continue;
-
-		// Normally you would store more information in your item (e.g. make Items[] an array of structure, store color/type etc.)
-		bool pop_color = false;
-		if (strstr(item, "[error]")) { ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.4f, 0.4f, 1.0f)); pop_color = true; }
-		else if (strncmp(item, "# ", 2) == 0) { ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.8f, 0.6f, 1.0f)); pop_color = true; }
-		ImGui::TextUnformatted(item);
-		if (pop_color)
-			ImGui::PopStyleColor();
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
+		{
+			DebugConsole_Copy line;
+			if (!GetLine(Visible[i], line))
+				continue;
+			const char* item = line.text;
+
+			bool pop_color = false;
+			if (line.level == LOG_ERROR) { ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.4f, 0.4f, 1.0f)); pop_color = true; }
+			else if (line.level == LOG_WARN) { ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.9f, 0.4f, 1.0f)); pop_color = true; }
+			else if (line.level == LOG_DEBUG) { ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.6f, 0.6f, 0.6f, 1.0f)); pop_color = true; }
+			else if (strncmp(item, "# ", 2) == 0) { ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.8f, 0.6f, 1.0f)); pop_color = true; }
+			if (line.category != LOG_SIM) { ImGui::TextDisabled("[%s]", CategoryNames[line.category % LOG_CATEGORIES]); ImGui::SameLine(); }
+			ImGui::TextUnformatted(item);
+			if (pop_color)
+				ImGui::PopStyleColor();
+		}
 	}
+	clipper.End();
 	if (copy_to_clipboard)
 		ImGui::LogFinish();
 
@@ -1,9 +1,31 @@
 #pragma once
 #include "imgui.h"
 
+// Log severity
+#define LOG_DEBUG   0
+#define LOG_INFO    1
+#define LOG_WARN    2
+#define LOG_ERROR   3
+
+// Log category
+#define LOG_SIM     0
+#define LOG_BUS     1
+#define LOG_INPUT   2
+#define LOG_VIDEO   3
+#define LOG_AUDIO   4
+#define LOG_RTL     5
+#define LOG_CATEGORIES 6
+
+// All DebugConsole objects share one fixed size ring of log lines, so copies
+// handed to SimBus etc. log to the same window. AddLog/Log never allocate
+// and may be called from any thread; the oldest lines are overwritten.
 struct DebugConsole {
 public:
+	static const int capacity = 4096;	// lines, power of two
+	static const int line_size = 240;	// bytes per line including terminator
+
 	void AddLog(const char* fmt, ...) IM_FMTARGS(2);
+	void Log(int level, int category, const char* fmt, ...) IM_FMTARGS(4);
 	DebugConsole();
 	~DebugConsole();
 	void ClearLog();
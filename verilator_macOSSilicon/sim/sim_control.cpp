@@ -0,0 +1,368 @@
+#include "sim_control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#else
+#define WIN32
+#endif
+
+#define CONTROL_LINE_MAX (1 << 20)
+
+// Requests
+// --------
+
+std::string SimControl_Request::Get(std::string key, std::string fallback) {
+	std::map<std::string, std::string>::iterator it = options.find(key);
+	return it == options.end() ? fallback : it->second;
+}
+
+long long SimControl_Request::GetInt(std::string key, long long fallback) {
+	std::string v = Get(key, "");
+	return v.empty() ? fallback : strtoll(v.c_str(), NULL, 0);
+}
+
+bool SimControl_Request::Has(std::string key) {
+	return options.find(key) != options.end();
+}
+
+static void skip_space(const std::string& s, size_t& i) {
+	while (i < s.size() && (s[i] == ' ' || s[i] == '\t' || s[i] == '\r' || s[i] == '\n')) { i++; }
+}
+
+// A JSON string starting at the quote; \u escapes above 0x7F become UTF-8
+static bool parse_string(const std::string& s, size_t& i, std::string& out) {
+	if (i >= s.size() || s[i] != '"') { return false; }
+	for (i++; i < s.size(); i++) {
+		char c = s[i];
+		if (c == '"') {
+			i++;
+			return true;
+		}
+		if (c != '\\') {
+			out += c;
+			continue;
+		}
+		if (++i >= s.size()) { return false; }
+		switch (s[i]) {
+		case '"': out += '"'; break;
+		case '\\': out += '\\'; break;
+		case '/': out += '/'; break;
+		case 'b': out += '\b'; break;
+		case 'f': out += '\f'; break;
+		case 'n': out += '\n'; break;
+		case 'r': out += '\r'; break;
+		case 't': out += '\t'; break;
+		case 'u': {
+			if (i + 4 >= s.size()) { return false; }
+			unsigned int u = (unsigned int)strtoul(s.substr(i + 1, 4).c_str(), NULL, 16);
+			i += 4;
+			if (u < 0x80) { out += (char)u; }
+			else if (u < 0x800) { out += (char)(0xC0 | u >> 6); out += (char)(0x80 | (u & 0x3F)); }
+			else { out += (char)(0xE0 | u >> 12); out += (char)(0x80 | (u >> 6 & 0x3F)); out += (char)(0x80 | (u & 0x3F)); }
+			break;
+		}
+		default: return false;
+		}
+	}
+	return false;
+}
+
+bool SimControl_Request::Parse(const std::string& text, std::string& error) {
+	line = text;
+	options.clear();
+	size_t i = 0;
+	skip_space(text, i);
+	if (i >= text.size() || text[i] != '{') {
+		error = "request is not a JSON object";
+		return false;
+	}
+	i++;
+	skip_space(text, i);
+	if (i < text.size() && text[i] == '}') { return true; }
+	while (true) {
+		std::string key, value;
+		skip_space(text, i);
+		if (!parse_string(text, i, key)) {
+			error = "expected a quoted key";
+			return false;
+		}
+		skip_space(text, i);
+		if (i >= text.size() || text[i] != ':') {
+			error = "expected ':' after \"" + key + "\"";
+			return false;
+		}
+		i++;
+		skip_space(text, i);
+		if (i < text.size() && text[i] == '"') {
+			if (!parse_string(text, i, value)) {
+				error = "bad string for \"" + key + "\"";
+				return false;
+			}
+		}
+		else if (i < text.size() && (text[i] == '{' || text[i] == '[')) {
+			error = "\"" + key + "\": nested values are not supported";
+			return false;
+		}
+		else {
+			size_t start = i;
+			while (i < text.size() && text[i] != ',' && text[i] != '}' && text[i] != ' ' && text[i] != '\t') { i++; }
+			value = text.substr(start, i - start);
+			if (value.empty()) {
+				error = "missing value for \"" + key + "\"";
+				return false;
+			}
+			if (value == "true") { value = "1"; }
+			else if (value == "false") { value = "0"; }
+			else if (value == "null") { value = ""; }
+		}
+		options[key] = value;
+		skip_space(text, i);
+		if (i < text.size() && text[i] == ',') {
+			i++;
+			continue;
+		}
+		if (i < text.size() && text[i] == '}') { return true; }
+		error = "expected ',' or '}'";
+		return false;
+	}
+}
+
+// Replies
+// -------
+
+static std::string quote(const std::string& s) {
+	std::string out = "\"";
+	for (size_t i = 0; i < s.size(); i++) {
+		unsigned char c = (unsigned char)s[i];
+		if (c == '"') { out += "\\\""; }
+		else if (c == '\\') { out += "\\\\"; }
+		else if (c == '\n') { out += "\\n"; }
+		else if (c == '\r') { out += "\\r"; }
+		else if (c == '\t') { out += "\\t"; }
+		else if (c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		}
+		else { out += (char)c; }
+	}
+	return out + "\"";
+}
+
+SimControl_Reply::SimControl_Reply() {
+	failed = false;
+}
+
+void SimControl_Reply::Set(std::string key, std::string value) {
+	fields.push_back(std::make_pair(key, quote(value)));
+}
+
+void SimControl_Reply::Set(std::string key, long long value) {
+	fields.push_back(std::make_pair(key, std::to_string(value)));
+}
+
+void SimControl_Reply::Set(std::string key, double value) {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.6g", value);
+	fields.push_back(std::make_pair(key, std::string(buf)));
+}
+
+void SimControl_Reply::Set(std::string key, bool value) {
+	fields.push_back(std::make_pair(key, std::string(value ? "true" : "false")));
+}
+
+void SimControl_Reply::Error(std::string message) {
+	failed = true;
+	Set("error", message);
+}
+
+std::string SimControl_Reply::Text() {
+	std::string out = failed ? "{\"ok\":false" : "{\"ok\":true";
+	for (size_t i = 0; i < fields.size(); i++) {
+		out += "," + quote(fields[i].first) + ":" + fields[i].second;
+	}
+	return out + "}\n";
+}
+
+// Transport
+// ---------
+
+SimControl::SimControl() {
+	listenFd = -1;
+	inFd = -1;
+	outFd = -1;
+	stdio = false;
+}
+
+SimControl::~SimControl() {
+	Close();
+}
+
+#ifndef WIN32
+
+bool SimControl::Open(std::string socket_path) {
+	Close();
+	path = socket_path;
+	// A client that goes away mid reply must not take the sim with it
+	signal(SIGPIPE, SIG_IGN);
+
+	if (path == "-") {
+		stdio = true;
+		inFd = 0;
+		fflush(stdout);
+		outFd = dup(1);
+		dup2(2, 1);
+		return outFd >= 0;
+	}
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Control socket path too long: %s\n", path.c_str());
+		return false;
+	}
+	strcpy(addr.sun_path, path.c_str());
+	// Replace a socket left by an earlier run
+	unlink(path.c_str());
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0 || bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 4) != 0) {
+		fprintf(stderr, "Cannot listen on control socket %s\n", path.c_str());
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void SimControl::Close() {
+	if (stdio) {
+		if (outFd >= 0) { close(outFd); }
+		stdio = false;
+		inFd = -1;
+		outFd = -1;
+		return;
+	}
+	Disconnect();
+	if (listenFd >= 0) {
+		close(listenFd);
+		unlink(path.c_str());
+		listenFd = -1;
+	}
+}
+
+void SimControl::Disconnect() {
+	if (!stdio && inFd >= 0) {
+		close(inFd);
+		inFd = -1;
+		outFd = -1;
+	}
+	buffer.clear();
+}
+
+static double now_ms() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+bool SimControl::NextLine(std::string& line) {
+	size_t nl = buffer.find('\n');
+	if (nl == std::string::npos) { return false; }
+	line = buffer.substr(0, nl);
+	buffer.erase(0, nl + 1);
+	return true;
+}
+
+bool SimControl::Poll(SimControl_Request& request, int timeoutMs) {
+	double deadline = now_ms() + timeoutMs;
+	while (IsOpen()) {
+		std::string line, error;
+		while (NextLine(line)) {
+			if (line.find_first_not_of(" \t\r") == std::string::npos) { continue; }
+			if (request.Parse(line, error)) { return true; }
+			SimControl_Reply reply;
+			reply.Error(error);
+			Reply(reply, request);
+		}
+
+		int wait = -1;
+		if (timeoutMs >= 0) {
+			wait = (int)(deadline - now_ms());
+			if (wait < 0) { wait = 0; }
+		}
+		struct pollfd p;
+		p.fd = inFd >= 0 ? inFd : listenFd;
+		p.events = POLLIN;
+		p.revents = 0;
+		int n = poll(&p, 1, wait);
+		if (n < 0) { continue; }	// interrupted
+		if (n == 0) { return false; }
+
+		if (inFd < 0) {
+			inFd = accept(listenFd, NULL, NULL);
+			outFd = inFd;
+			continue;
+		}
+		char data[4096];
+		ssize_t got = read(inFd, data, sizeof(data));
+		if (got <= 0) {
+			// Client gone; stdin at EOF closes the channel
+			if (stdio) { Close(); }
+			else { Disconnect(); }
+			continue;
+		}
+		buffer.append(data, (size_t)got);
+		if (buffer.size() > CONTROL_LINE_MAX && buffer.find('\n') == std::string::npos) {
+			SimControl_Reply reply;
+			reply.Error("request line too long");
+			Send(reply.Text());
+			buffer.clear();
+		}
+	}
+	return false;
+}
+
+void SimControl::Send(const std::string& text) {
+	size_t done = 0;
+	while (outFd >= 0 && done < text.size()) {
+		ssize_t n = write(outFd, text.data() + done, text.size() - done);
+		if (n <= 0) {
+			Disconnect();
+			return;
+		}
+		done += (size_t)n;
+	}
+}
+
+#else
+
+bool SimControl::Open(std::string socket_path) {
+	fprintf(stderr, "Control channel is not supported on Windows\n");
+	return false;
+}
+void SimControl::Close() {}
+void SimControl::Disconnect() {}
+bool SimControl::NextLine(std::string& line) { return false; }
+bool SimControl::Poll(SimControl_Request& request, int timeoutMs) { return false; }
+void SimControl::Send(const std::string& text) {}
+
+#endif
+
+void SimControl::Reply(SimControl_Reply& reply, SimControl_Request& request) {
+	if (request.Has("id")) {
+		// Echo the id as it was written: a number stays a number
+		std::string id = request.Get("id", "");
+		bool number = !id.empty() && id.find_first_not_of("-0123456789") == std::string::npos;
+		if (number) { reply.Set("id", strtoll(id.c_str(), NULL, 10)); }
+		else { reply.Set("id", id); }
+	}
+	Send(reply.Text());
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+// JSON-lines control channel for scripted runs
+//
+// Open() listens on a UNIX domain socket, one client at a time, or with
+// "-" reads stdin and answers on the original stdout (whatever else the sim
+// prints is moved over to stderr so it can't get into the replies).
+//
+// A request is one JSON object per line with flat string, number or
+// boolean values:
+//     {"cmd":"run","frames":50,"id":7}
+// and gets exactly one reply line, an object with "ok" and either the
+// results or "error". An "id" in the request is echoed back in the reply.
+// Lines that don't parse are answered here; everything else is up to the
+// caller (sim_main's serve_control), which decides what the commands mean.
+
+struct SimControl_Request {
+public:
+	std::string line;
+	std::map<std::string, std::string> options;	// strings unescaped, numbers and booleans as written
+
+	std::string Get(std::string key, std::string fallback);
+	long long GetInt(std::string key, long long fallback);
+	bool Has(std::string key);
+	bool Parse(const std::string& text, std::string& error);
+};
+
+struct SimControl_Reply {
+public:
+	void Set(std::string key, std::string value);
+	void Set(std::string key, const char* value) { Set(key, std::string(value)); }
+	void Set(std::string key, long long value);
+	void Set(std::string key, uint64_t value) { Set(key, (long long)value); }
+	void Set(std::string key, int value) { Set(key, (long long)value); }
+	void Set(std::string key, double value);
+	void Set(std::string key, bool value);
+	void Error(std::string message);
+	bool Failed() { return failed; }
+	std::string Text();
+
+	SimControl_Reply();
+
+private:
+	std::vector<std::pair<std::string, std::string> > fields;	// key, JSON text
+	bool failed;
+};
+
+struct SimControl {
+public:
+	std::string path;
+
+	bool Open(std::string path);
+	void Close();
+	bool IsOpen() { return listenFd >= 0 || inFd >= 0; }
+
+	// Wait up to timeoutMs (-1 = forever) for the next request. False on
+	// timeout, or once stdin is closed (IsOpen() then turns false).
+	bool Poll(SimControl_Request& request, int timeoutMs);
+	void Reply(SimControl_Reply& reply, SimControl_Request& request);
+
+	SimControl();
+	~SimControl();
+
+private:
+	int listenFd;	// socket mode
+	int inFd;		// client socket, or stdin
+	int outFd;
+	bool stdio;
+	std::string buffer;
+
+	bool NextLine(std::string& line);
+	void Send(const std::string& text);
+	void Disconnect();
+};
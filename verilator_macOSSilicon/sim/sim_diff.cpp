@@ -0,0 +1,112 @@
+#include "sim_diff.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+SimDiff::SimDiff() {
+	signals = NULL;
+	maxList = 16;
+	differences = 0;
+}
+
+static bool shorter_first(const std::string& a, const std::string& b) {
+	return a.size() != b.size() ? a.size() < b.size() : a < b;
+}
+
+void SimDiff::Capture(int side) {
+	std::vector<std::string> names;
+	signals->List(names, "");
+	std::sort(names.begin(), names.end(), shorter_first);
+	std::map<void*, bool> seen;
+	for (size_t i = 0; i < names.size(); i++) {
+		const SimSignal* s = signals->Get(names[i]);
+		if (!s || seen.count(s->ptr)) { continue; }
+		seen[s->ptr] = true;
+		Add(side, names[i], s->ptr, s->bytes, s->width, s->elements);
+	}
+}
+
+void SimDiff::Add(int side, const std::string& name, const void* data, int bytes, int width, int elements) {
+	SimDiff_Block& b = blocks[name];
+	b.bytes = bytes;
+	b.width = width;
+	b.elements = elements;
+	const uint8_t* p = (const uint8_t*)data;
+	b.data[side].assign(p, p + (size_t)bytes * elements);
+}
+
+// One element as hex, most significant word first for wide signals
+std::string SimDiff::Value(const SimDiff_Block& b, int side, int index) {
+	const uint8_t* p = &b.data[side][(size_t)index * b.bytes];
+	char buf[24];
+	if (b.bytes <= 8) {
+		uint64_t v = 0;
+		memcpy(&v, p, b.bytes);
+		if (b.width < 64) { v &= (1ULL << b.width) - 1; }
+		snprintf(buf, sizeof(buf), "%0*llx", (b.width + 3) / 4, (unsigned long long)v);
+		return buf;
+	}
+	std::string out;
+	for (int w = b.bytes / 4 - 1; w >= 0; w--) {
+		uint32_t v;
+		memcpy(&v, p + w * 4, 4);
+		snprintf(buf, sizeof(buf), "%08x", v);
+		out += buf;
+	}
+	size_t digits = (size_t)(b.width + 3) / 4;
+	return out.size() > digits ? out.substr(out.size() - digits) : out;
+}
+
+void SimDiff::ReportArray(const std::string& name, const SimDiff_Block& b, std::string& out) {
+	std::vector<int> diff;
+	for (int i = 0; i < b.elements; i++) {
+		if (memcmp(&b.data[0][(size_t)i * b.bytes], &b.data[1][(size_t)i * b.bytes], b.bytes) != 0) { diff.push_back(i); }
+	}
+	char buf[160];
+	snprintf(buf, sizeof(buf), "%s [%d x %d]: %d differ in %x-%x\n", name.c_str(), b.elements, b.width,
+		(int)diff.size(), diff.front(), diff.back());
+	out += buf;
+	if ((int)diff.size() <= maxList) {
+		for (size_t i = 0; i < diff.size(); i++) {
+			snprintf(buf, sizeof(buf), "    [%x] ", diff[i]);
+			out += buf + Value(b, 0, diff[i]) + " -> " + Value(b, 1, diff[i]) + "\n";
+		}
+		return;
+	}
+	// Too many to list: runs of neighbouring elements instead
+	int runs = 0;
+	for (size_t i = 0; i < diff.size(); ) {
+		size_t j = i;
+		while (j + 1 < diff.size() && diff[j + 1] == diff[j] + 1) { j++; }
+		if (runs < maxList) {
+			snprintf(buf, sizeof(buf), "    %x-%x (%d)\n", diff[i], diff[j], (int)(j - i + 1));
+			out += buf;
+		}
+		runs++;
+		i = j + 1;
+	}
+	if (runs > maxList) {
+		snprintf(buf, sizeof(buf), "    ... %d more runs\n", runs - maxList);
+		out += buf;
+	}
+}
+
+std::string SimDiff::Report() {
+	std::string out;
+	differences = 0;
+	for (std::map<std::string, SimDiff_Block>::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+		SimDiff_Block& b = it->second;
+		if (b.data[0].size() != b.data[1].size()) {
+			out += it->first + ": only in one state\n";
+			differences++;
+			continue;
+		}
+		if (b.data[0] == b.data[1]) { continue; }
+		differences++;
+		if (b.elements > 1) { ReportArray(it->first, b, out); }
+		else { out += it->first + ": " + Value(b, 0, 0) + " -> " + Value(b, 1, 0) + "\n"; }
+	}
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%d of %d signals differ\n", differences, (int)blocks.size());
+	return out + buf;
+}
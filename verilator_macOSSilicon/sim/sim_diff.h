@@ -0,0 +1,48 @@
+#pragma once
+#include "sim_signals.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+
+// Signal level diff of two model states
+//
+// Capture() copies the storage of every public signal, found by name
+// through the Verilator scope tables, into side 0 or 1; main restores one
+// VerilatedSave snapshot, captures, restores the other and captures again.
+// Host state that is not in the model (main_time, the SDRAM=dpi pages)
+// goes in with Add(). Both sides have to come from the same build.
+//
+// Report() lists what differs by hierarchical name. Plain signals show
+// both values; arrays show how many elements differ and where, with the
+// elements themselves when there are only a few, or the runs of differing
+// elements when there are many (sdram.ram, asic_ram).
+// Names that share storage with a shorter one are left out.
+
+struct SimDiff_Block {
+public:
+	int bytes;			// per element
+	int width;			// bits per element
+	int elements;
+	std::vector<uint8_t> data[2];
+};
+
+struct SimDiff {
+public:
+	SimSignals* signals;
+	int maxList;		// elements or runs listed per array
+
+	void Capture(int side);
+	void Add(int side, const std::string& name, const void* data, int bytes, int width, int elements);
+	std::string Report();
+	int Differences() { return differences; }
+
+	SimDiff();
+
+private:
+	std::map<std::string, SimDiff_Block> blocks;
+	int differences;
+
+	std::string Value(const SimDiff_Block& b, int side, int index);
+	void ReportArray(const std::string& name, const SimDiff_Block& b, std::string& out);
+};
@@ -0,0 +1,179 @@
+#include "sim_events.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim_console.h"
+
+static DebugConsole console;
+
+thread_local SimEvents* sim_events_active = NULL;
+
+static const char* event_names[SIM_EVENT_KINDS] = {
+	"download start",
+	"download done",
+	"reset",
+	"ACID state",
+	"DMA start",
+	"palette write",
+	"sprite collision"
+};
+
+static const char* acid_state_names[] = { "LOCKED", "UNLOCKING", "UNLOCKED", "PERM_UNLOCKED" };
+
+// DPI-C import of sim_events.v
+extern "C" void sim_event(int kind, int a, int b) {
+	if (!sim_events_active) { return; }
+	sim_events_active->Push(kind, a, b);
+
+	// Rare events that used to be $display lines also go to the debug log
+	if (kind == SIM_EVENT_DOWNLOAD_START || kind == SIM_EVENT_DOWNLOAD_DONE || kind == SIM_EVENT_RESET) {
+		char buf[128];
+		SimEvent e = { sim_events_active->time ? *sim_events_active->time : 0, kind, a, b };
+		sim_events_active->Describe(e, buf, sizeof(buf));
+		console.Log(LOG_INFO, LOG_RTL, "%s: %s", event_names[kind], buf);
+	}
+}
+
+SimEvents::SimEvents() {
+	time = NULL;
+	events = (SimEvent*)calloc(capacity, sizeof(SimEvent));
+	head = 0;
+	tail = 0;
+	visibleNext = 0;
+	follow = true;
+	for (int k = 0; k < SIM_EVENT_KINDS; k++) {
+		capture[k] = true;
+		show[k] = true;
+		counts[k] = 0;
+	}
+}
+
+SimEvents::~SimEvents() {
+	free(events);
+	if (sim_events_active == this) { sim_events_active = NULL; }
+}
+
+void SimEvents::MakeActive() {
+	sim_events_active = this;
+}
+
+void SimEvents::Clear() {
+	tail = head;
+	visibleNext = head;
+	visible.clear();
+	for (int k = 0; k < SIM_EVENT_KINDS; k++) { counts[k] = 0; }
+}
+
+int SimEvents::Size() {
+	vluint64_t n = head - tail;
+	return n > (vluint64_t)capacity ? capacity : (int)n;
+}
+
+const char* SimEvents::Name(int kind) {
+	return kind >= 0 && kind < SIM_EVENT_KINDS ? event_names[kind] : "?";
+}
+
+void SimEvents::Describe(const SimEvent& e, char* buf, int size) {
+	switch (e.kind) {
+	case SIM_EVENT_DOWNLOAD_START:
+		snprintf(buf, size, "index=%d", e.a);
+		break;
+	case SIM_EVENT_DOWNLOAD_DONE:
+		snprintf(buf, size, "addr=%06X plus_download=%d plus_valid=%d", e.a, (e.b >> 1) & 1, e.b & 1);
+		break;
+	case SIM_EVENT_ACID_STATE:
+		snprintf(buf, size, "%s seq_index=%d", acid_state_names[e.a & 3], e.b);
+		break;
+	case SIM_EVENT_DMA_START:
+		snprintf(buf, size, "channels=%s%s%s status=%X",
+			e.a & 1 ? "0" : "", e.a & 2 ? "1" : "", e.a & 4 ? "2" : "", e.b);
+		break;
+	case SIM_EVENT_PALETTE_WRITE:
+		snprintf(buf, size, "%04X <- %02X (colour %d)", e.a, e.b, (e.a & 0x3F) >> 1);
+		break;
+	case SIM_EVENT_SPRITE_COLLISION:
+		snprintf(buf, size, "collision=%02X (was %02X)", e.a, e.b);
+		break;
+	default:
+		snprintf(buf, size, "a=%X b=%X", e.a, e.b);
+		break;
+	}
+}
+
+// Drop overwritten events from the filtered list and test only new ones
+void SimEvents::UpdateVisible(bool rebuild) {
+	vluint64_t oldest = head > (vluint64_t)capacity ? head - capacity : 0;
+	if (oldest < tail) { oldest = tail; }
+	if (rebuild || visibleNext < oldest) {
+		visible.clear();
+		visibleNext = oldest;
+	}
+	int drop = 0;
+	while (drop < visible.Size && visible[drop] < oldest) { drop++; }
+	if (drop) { visible.erase(visible.begin(), visible.begin() + drop); }
+	for (; visibleNext < head; visibleNext++) {
+		if (show[events[visibleNext & (capacity - 1)].kind]) { visible.push_back(visibleNext); }
+	}
+}
+
+void SimEvents::Draw(const char* title, bool* p_open, ImVec2 size) {
+	ImGui::SetNextWindowSize(size, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin(title, p_open)) {
+		ImGui::End();
+		return;
+	}
+
+	bool rebuild = false;
+	if (ImGui::Button("Clear")) { Clear(); }
+	ImGui::SameLine();
+	ImGui::Checkbox("Follow", &follow);
+	ImGui::SameLine();
+	ImGui::Text("%d events", Size());
+	if (ImGui::BeginTable("kinds", 3, ImGuiTableFlags_SizingStretchSame)) {
+		for (int k = 0; k < SIM_EVENT_KINDS; k++) {
+			ImGui::TableNextColumn();
+			ImGui::PushID(k);
+			ImGui::Checkbox("##capture", &capture[k]);
+			if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Capture"); }
+			ImGui::SameLine();
+			rebuild |= ImGui::Checkbox("##show", &show[k]);
+			if (ImGui::IsItemHovered()) { ImGui::SetTooltip("Show"); }
+			ImGui::SameLine();
+			ImGui::Text("%s (%llu)", event_names[k], (unsigned long long)counts[k]);
+			ImGui::PopID();
+		}
+		ImGui::EndTable();
+	}
+	ImGui::Separator();
+	UpdateVisible(rebuild);
+
+	ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersV | ImGuiTableFlags_Resizable;
+	if (ImGui::BeginTable("events", 3, flags)) {
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("time", ImGuiTableColumnFlags_WidthFixed, 90);
+		ImGui::TableSetupColumn("event", ImGuiTableColumnFlags_WidthFixed, 110);
+		ImGui::TableSetupColumn("detail", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableHeadersRow();
+
+		char buf[128];
+		ImGuiListClipper clipper;
+		clipper.Begin(visible.Size);
+		while (clipper.Step()) {
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+				const SimEvent& e = events[visible[i] & (capacity - 1)];
+				Describe(e, buf, sizeof(buf));
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::Text("%llu", (unsigned long long)e.time);
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(event_names[e.kind]);
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(buf);
+			}
+		}
+		clipper.End();
+		if (follow) { ImGui::SetScrollY(ImGui::GetScrollMaxY()); }
+		ImGui::EndTable();
+	}
+	ImGui::End();
+}
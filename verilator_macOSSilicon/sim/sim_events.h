@@ -0,0 +1,74 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "imgui.h"
+
+// Typed debug events from the RTL probes in sim_events.v
+//
+// The model calls sim_event(kind, a, b) through DPI-C. The event is stamped
+// with main_time and stored in a fixed ring, newest overwriting oldest, so
+// the only cost on the model side is a few stores. Formatting happens in
+// the viewer, and only for the rows on screen.
+//
+// Kinds must match the localparams in sim_events.v.
+
+#define SIM_EVENT_DOWNLOAD_START   0
+#define SIM_EVENT_DOWNLOAD_DONE    1
+#define SIM_EVENT_RESET            2
+#define SIM_EVENT_ACID_STATE       3
+#define SIM_EVENT_DMA_START        4
+#define SIM_EVENT_PALETTE_WRITE    5
+#define SIM_EVENT_SPRITE_COLLISION 6
+#define SIM_EVENT_KINDS            7
+
+struct SimEvent {
+public:
+	vluint64_t time;
+	int kind;
+	int a;
+	int b;
+};
+
+struct SimEvents {
+public:
+	static const int capacity = 65536;	// power of two
+
+	vluint64_t* time;
+	bool capture[SIM_EVENT_KINDS];		// kinds recorded at all
+	bool show[SIM_EVENT_KINDS];			// kinds listed in the viewer
+	vluint64_t counts[SIM_EVENT_KINDS];
+
+	void Push(int kind, int a, int b) {
+		if (kind < 0 || kind >= SIM_EVENT_KINDS || !capture[kind]) { return; }
+		SimEvent& e = events[head & (capacity - 1)];
+		e.time = time ? *time : 0;
+		e.kind = kind;
+		e.a = a;
+		e.b = b;
+		head++;
+		counts[kind]++;
+	}
+
+	void MakeActive();
+	void Clear();
+	int Size();
+	static const char* Name(int kind);
+	void Describe(const SimEvent& e, char* buf, int size);
+	void Draw(const char* title, bool* p_open, ImVec2 size);
+
+	SimEvents();
+	~SimEvents();
+
+private:
+	SimEvent* events;
+	vluint64_t head;
+	vluint64_t tail;
+
+	// Viewer state
+	ImVector<vluint64_t> visible;
+	vluint64_t visibleNext;
+	bool follow;
+
+	void UpdateVisible(bool rebuild);
+};
+
+extern thread_local SimEvents* sim_events_active;
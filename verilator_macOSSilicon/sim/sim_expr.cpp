@@ -0,0 +1,180 @@
+#include "sim_expr.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+// Binary operators by precedence, lowest first
+struct SimExpr_BinaryOp {
+	const char* token;
+	SimExpr::Op op;
+};
+static const SimExpr_BinaryOp binary_ops[][5] = {
+	{ { "||", SimExpr::OP_LOR } },
+	{ { "&&", SimExpr::OP_LAND } },
+	{ { "|", SimExpr::OP_OR } },
+	{ { "^", SimExpr::OP_XOR } },
+	{ { "&", SimExpr::OP_AND } },
+	{ { "==", SimExpr::OP_EQ }, { "!=", SimExpr::OP_NE } },
+	{ { "<=", SimExpr::OP_LE }, { ">=", SimExpr::OP_GE }, { "<", SimExpr::OP_LT }, { ">", SimExpr::OP_GT } },
+	{ { "<<", SimExpr::OP_SHL }, { ">>", SimExpr::OP_SHR } },
+	{ { "+", SimExpr::OP_ADD }, { "-", SimExpr::OP_SUB } },
+	{ { "*", SimExpr::OP_MUL }, { "/", SimExpr::OP_DIV }, { "%", SimExpr::OP_MOD } },
+};
+static const int binary_levels = sizeof(binary_ops) / sizeof(binary_ops[0]);
+static const char* two_char_ops[] = { "||", "&&", "<<", ">>", "<=", ">=", "==", "!=" };
+
+SimExpr::SimExpr() {
+	p = NULL;
+	depth = 0;
+	maxDepth = 0;
+}
+
+void SimExpr::Emit(Op op, const void* ptr, int64_t value) {
+	Instr i;
+	i.op = op;
+	i.ptr = ptr;
+	i.value = value;
+	program.push_back(i);
+	if (op <= OP_LOAD64) { depth++; }
+	else if (op > OP_NEG) { depth--; }
+	if (depth > maxDepth) { maxDepth = depth; }
+}
+
+void SimExpr::SkipSpace() {
+	while (*p && isspace((unsigned char)*p)) { p++; }
+}
+
+// Match an operator, without taking the first half of a two character one
+bool SimExpr::Accept(const char* token) {
+	SkipSpace();
+	size_t len = strlen(token);
+	if (strncmp(p, token, len) != 0) { return false; }
+	if (len == 1 && p[1]) {
+		char two[3] = { p[0], p[1], 0 };
+		for (size_t i = 0; i < sizeof(two_char_ops) / sizeof(two_char_ops[0]); i++) {
+			if (strcmp(two, two_char_ops[i]) == 0) { return false; }
+		}
+	}
+	p += len;
+	return true;
+}
+
+bool SimExpr::ParseBinary(int level) {
+	if (level == binary_levels) { return ParseUnary(); }
+	if (!ParseBinary(level + 1)) { return false; }
+	for (;;) {
+		const SimExpr_BinaryOp* matched = NULL;
+		for (int i = 0; i < 5 && binary_ops[level][i].token; i++) {
+			if (Accept(binary_ops[level][i].token)) { matched = &binary_ops[level][i]; break; }
+		}
+		if (!matched) { return true; }
+		if (!ParseBinary(level + 1)) { return false; }
+		Emit(matched->op, NULL, 0);
+	}
+}
+
+bool SimExpr::ParseUnary() {
+	if (Accept("!")) { if (!ParseUnary()) { return false; } Emit(OP_NOT, NULL, 0); return true; }
+	if (Accept("~")) { if (!ParseUnary()) { return false; } Emit(OP_INV, NULL, 0); return true; }
+	if (Accept("-")) { if (!ParseUnary()) { return false; } Emit(OP_NEG, NULL, 0); return true; }
+	return ParsePrimary();
+}
+
+bool SimExpr::ParsePrimary() {
+	SkipSpace();
+	if (Accept("(")) {
+		if (!ParseBinary(0)) { return false; }
+		if (!Accept(")")) { error = "missing )"; return false; }
+		return true;
+	}
+	if (isdigit((unsigned char)*p)) {
+		char* end;
+		int64_t value;
+		if (p[0] == '0' && (p[1] == 'b' || p[1] == 'B')) { value = strtoll(p + 2, &end, 2); }
+		else { value = strtoll(p, &end, 0); }
+		p = end;
+		Emit(OP_CONST, NULL, value);
+		return true;
+	}
+	if (isalpha((unsigned char)*p) || *p == '_') {
+		const char* start = p;
+		while (isalnum((unsigned char)*p) || *p == '_' || *p == '.') { p++; }
+		std::string name(start, p - start);
+		SimExpr_Signal signal;
+		if (!resolver || !resolver(name, signal)) { error = "unknown signal " + name; return false; }
+		switch (signal.bytes) {
+		case 1: Emit(OP_LOAD8, signal.ptr, 0); break;
+		case 2: Emit(OP_LOAD16, signal.ptr, 0); break;
+		case 4: Emit(OP_LOAD32, signal.ptr, 0); break;
+		case 8: Emit(OP_LOAD64, signal.ptr, 0); break;
+		default: error = "unsupported width for " + name; return false;
+		}
+		return true;
+	}
+	error = *p ? std::string("unexpected ") + *p : "unexpected end";
+	return false;
+}
+
+bool SimExpr::Compile(const std::string& text, SimExpr_Resolver resolve) {
+	this->text = text;
+	error.clear();
+	program.clear();
+	resolver = resolve;
+	depth = 0;
+	maxDepth = 0;
+	p = text.c_str();
+
+	bool ok = ParseBinary(0);
+	SkipSpace();
+	if (ok && *p) { error = std::string("unexpected ") + *p; ok = false; }
+	if (ok && maxDepth > max_stack) { error = "expression too deep"; ok = false; }
+	if (!ok) { program.clear(); }
+	resolver = nullptr;
+	return ok;
+}
+
+// Overflow wraps at 64 bits instead of being undefined, and x / -1 is -x
+// rather than a trap for the smallest value
+static inline int64_t wrap(uint64_t v) { return (int64_t)v; }
+static inline int64_t divide(int64_t a, int64_t b) { return !b ? 0 : b == -1 ? wrap(0 - (uint64_t)a) : a / b; }
+static inline int64_t modulo(int64_t a, int64_t b) { return !b || b == -1 ? 0 : a % b; }
+// >> stays arithmetic, like the usual C compilers
+static inline int64_t shift_right(int64_t a, int n) { return a < 0 ? wrap(~(~(uint64_t)a >> n)) : wrap((uint64_t)a >> n); }
+
+int64_t SimExpr::Eval() {
+	int64_t stack[max_stack];
+	int sp = -1;
+	const Instr* i = program.data();
+	const Instr* end = i + program.size();
+	for (; i < end; i++) {
+		switch (i->op) {
+		case OP_CONST:  stack[++sp] = i->value; break;
+		case OP_LOAD8:  stack[++sp] = *(const uint8_t*)i->ptr; break;
+		case OP_LOAD16: stack[++sp] = *(const uint16_t*)i->ptr; break;
+		case OP_LOAD32: stack[++sp] = *(const uint32_t*)i->ptr; break;
+		case OP_LOAD64: stack[++sp] = *(const int64_t*)i->ptr; break;
+		case OP_NOT:    stack[sp] = !stack[sp]; break;
+		case OP_INV:    stack[sp] = ~stack[sp]; break;
+		case OP_NEG:    stack[sp] = wrap(0 - (uint64_t)stack[sp]); break;
+		case OP_MUL:    sp--; stack[sp] = wrap((uint64_t)stack[sp] * (uint64_t)stack[sp + 1]); break;
+		case OP_DIV:    sp--; stack[sp] = divide(stack[sp], stack[sp + 1]); break;
+		case OP_MOD:    sp--; stack[sp] = modulo(stack[sp], stack[sp + 1]); break;
+		case OP_ADD:    sp--; stack[sp] = wrap((uint64_t)stack[sp] + (uint64_t)stack[sp + 1]); break;
+		case OP_SUB:    sp--; stack[sp] = wrap((uint64_t)stack[sp] - (uint64_t)stack[sp + 1]); break;
+		case OP_SHL:    sp--; stack[sp] = wrap((uint64_t)stack[sp] << (stack[sp + 1] & 63)); break;
+		case OP_SHR:    sp--; stack[sp] = shift_right(stack[sp], (int)(stack[sp + 1] & 63)); break;
+		case OP_LT:     sp--; stack[sp] = stack[sp] < stack[sp + 1]; break;
+		case OP_LE:     sp--; stack[sp] = stack[sp] <= stack[sp + 1]; break;
+		case OP_GT:     sp--; stack[sp] = stack[sp] > stack[sp + 1]; break;
+		case OP_GE:     sp--; stack[sp] = stack[sp] >= stack[sp + 1]; break;
+		case OP_EQ:     sp--; stack[sp] = stack[sp] == stack[sp + 1]; break;
+		case OP_NE:     sp--; stack[sp] = stack[sp] != stack[sp + 1]; break;
+		case OP_AND:    sp--; stack[sp] = stack[sp] & stack[sp + 1]; break;
+		case OP_XOR:    sp--; stack[sp] = stack[sp] ^ stack[sp + 1]; break;
+		case OP_OR:     sp--; stack[sp] = stack[sp] | stack[sp + 1]; break;
+		case OP_LAND:   sp--; stack[sp] = stack[sp] && stack[sp + 1]; break;
+		case OP_LOR:    sp--; stack[sp] = stack[sp] || stack[sp + 1]; break;
+		}
+	}
+	return sp >= 0 ? stack[sp] : 0;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <stdint.h>
+
+// Integer expressions over model signals, e.g.
+//   asic_inst.acid_inst.state == 3 && video.count_frame > 10
+//
+// Compile() parses the text once, resolving every name to a pointer and
+// width through the resolver, into a flat stack program. Eval() then only
+// runs that program, so it is cheap enough to call on every rising edge.
+//
+// Operators follow C: ! ~ - (unary), * / %, + -, << >>, < <= > >=, == !=,
+// &, ^, |, &&, ||, and parentheses. Numbers are decimal, 0x hex or 0b binary.
+// Values are 64 bit signed and wrap on overflow; x / 0 and x % 0 are 0.
+
+struct SimExpr_Signal {
+public:
+	const void* ptr;
+	int bytes;	// 1, 2, 4 or 8
+};
+
+typedef std::function<bool(const std::string& name, SimExpr_Signal& signal)> SimExpr_Resolver;
+
+struct SimExpr {
+public:
+	enum Op {
+		OP_CONST, OP_LOAD8, OP_LOAD16, OP_LOAD32, OP_LOAD64,
+		OP_NOT, OP_INV, OP_NEG,
+		OP_MUL, OP_DIV, OP_MOD, OP_ADD, OP_SUB, OP_SHL, OP_SHR,
+		OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+		OP_AND, OP_XOR, OP_OR, OP_LAND, OP_LOR
+	};
+
+	std::string text;
+	std::string error;
+
+	bool Compile(const std::string& text, SimExpr_Resolver resolve);
+	bool IsValid() { return !program.empty(); }
+	int64_t Eval();
+
+	SimExpr();
+
+private:
+	struct Instr {
+		Op op;
+		const void* ptr;
+		int64_t value;
+	};
+	static const int max_stack = 64;
+
+	std::vector<Instr> program;
+
+	// Parser state
+	const char* p;
+	SimExpr_Resolver resolver;
+	int depth;
+	int maxDepth;
+
+	void Emit(Op op, const void* ptr, int64_t value);
+	void SkipSpace();
+	bool Accept(const char* token);
+	bool ParseBinary(int level);
+	bool ParseUnary();
+	bool ParsePrimary();
+};
@@ -0,0 +1,681 @@
+#include "sim_fastfwd.h"
+#include "sim_console.h"
+#include "sim_pacer.h"
+#include "sim_mmu.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static DebugConsole console;
+
+static const char* states[] = { "off", "armed, waiting for the RTL to leave reset", "waiting for an RTL instruction to patch",
+	"waiting for the RTL to enter the stub", "restore stub running", "handed off" };
+
+SimFastForward::SimFastForward() {
+	signals = NULL;
+	time = NULL;
+	sdram = NULL;
+	ram = NULL;
+	targetPc = -1;
+	targetFrames = 0;
+	limitFrames = 3000;
+	state = FASTFWD_IDLE;
+	instructions = 0;
+	frames = 0;
+	hostMs = 0;
+	z80.bus = this;
+	lastRd = false;
+	fetching = false;
+	prefixPending = false;
+	lastPrefix = 0;
+	fetchAddr = 0;
+	patchDelay = 0;
+	stubSize = 0;
+	stubCopies = 0;
+	rom_map = NULL;
+	importing = false;
+	exportDue = false;
+	exportPc = 0;
+	lastM1 = false;
+	Reset();
+}
+
+// "pc=BB06", "frames=150", "pc=BB06,limit=500"
+bool SimFastForward::Arm(const std::string& spec) {
+	targetPc = -1;
+	targetFrames = 0;
+	size_t pos = 0;
+	while (pos < spec.size()) {
+		size_t end = spec.find_first_of(", ", pos);
+		if (end == std::string::npos) { end = spec.size(); }
+		std::string item = spec.substr(pos, end - pos);
+		pos = end + 1;
+		if (item.empty()) { continue; }
+		if (item.compare(0, 3, "pc=") == 0) { targetPc = (int)(strtoul(item.c_str() + 3, NULL, 16) & 0xFFFF); }
+		else if (item.compare(0, 7, "frames=") == 0) { targetFrames = atoi(item.c_str() + 7); }
+		else if (item.compare(0, 6, "limit=") == 0) { limitFrames = atoi(item.c_str() + 6); }
+		else {
+			console.AddLog("[error] Fast-forward: unknown checkpoint %s", item.c_str());
+			return false;
+		}
+	}
+	if (targetPc < 0 && targetFrames <= 0) {
+		console.AddLog("[error] Fast-forward: no checkpoint, use pc=XXXX and/or frames=N");
+		return false;
+	}
+
+	if (!Attach()) { return false; }
+	importing = false;
+	report.clear();
+	state = FASTFWD_ARMED;
+	return true;
+}
+
+// Hand a snapshot to the RTL the same way, in place of a model run
+bool SimFastForward::Import(const std::string& file) {
+	if (!sna.Load(file)) {
+		console.AddLog("[error] Snapshot: %s", sna.error.c_str());
+		return false;
+	}
+	if (!Attach()) { return false; }
+	Cancel();
+	importing = true;
+	report = "Snapshot " + file + "\n";
+	state = FASTFWD_ARMED;
+	return true;
+}
+
+// Written out when M1 of the next instruction's opcode fetch ends, once the
+// previous instruction has finished writing back
+bool SimFastForward::Export(const std::string& file) {
+	if (!Attach()) { return false; }
+	exportFile = file;
+	exportDue = false;
+	return true;
+}
+
+bool SimFastForward::Attach() {
+	struct { const SimSignal** signal; const char* name; } wanted[] = {
+		{ &m1_n, "motherboard.CPU.i_tv80_core.m1_n" }, { &mreq_n, "motherboard.CPU.mreq_n_reg" },
+		{ &rd_n, "motherboard.CPU.rd_n_reg" }, { &addr, "motherboard.CPU.i_tv80_core.A" },
+		{ &di_reg, "motherboard.CPU.di_reg" }, { &reset, "RESET" }, { &download, "ioctl_download" },
+		{ &sdram_addr, "sdram.addr" }, { &mmu_map, "motherboard.MMU.RAMmap" }, { &mmu_page, "motherboard.MMU.RAMpage" },
+		{ &rom_map, "rom_map" }, { &model, "model" }, { &plus_mode, "plus_mode" },
+	};
+	for (size_t i = 0; i < sizeof(wanted) / sizeof(wanted[0]); i++) {
+		*wanted[i].signal = signals->Get(wanted[i].name);
+		if (!*wanted[i].signal) {
+			console.AddLog("[error] Fast-forward: %s is not public in this model", wanted[i].name);
+			return false;
+		}
+	}
+
+	// Check() was not watching the bus, and the first fetch seen may be the
+	// second half of a prefixed opcode
+	if ((state == FASTFWD_IDLE || state == FASTFWD_DONE) && exportFile.empty()) {
+		lastRd = !rd_n->Read();
+		lastM1 = !m1_n->Read();
+		fetching = false;
+		prefixPending = true;
+		lastPrefix = 0;
+		patchDelay = 0;
+	}
+	return true;
+}
+
+// Put back anything patched into memory and stop
+void SimFastForward::Cancel() {
+	if (state == FASTFWD_ENTER || state == FASTFWD_STUB) { Restore(); }
+	patchDelay = 0;
+	state = FASTFWD_IDLE;
+}
+
+void SimFastForward::Restore() {
+	if (state == FASTFWD_ENTER) {
+		for (int i = 0; i < 4; i++) { Poke(patchPhys + i, patchSaved[i]); }
+	}
+	for (int c = 0; c < stubCopies; c++) {
+		for (int i = 0; i < stubSize; i++) { Poke(stubPhys[c] + i, stubSaved[c][i]); }
+	}
+	stubCopies = 0;
+}
+
+// The reset state of the board, and how the RTL is configured
+void SimFastForward::Reset() {
+	z80.Reset();
+	ramMap = 0;
+	ramPage = 3;
+	romBank = 0;
+	romSelect = 0;
+	mmrPort = 0x7F;
+	mmr = 0xC0;
+	gaMode = 0;
+	pen = 0;
+	memset(inks, 0, sizeof(inks));
+	bcLast = 0;
+	crtcSelect = 0;
+	memset(crtc, 0, sizeof(crtc));
+	memset(asicKeys, 0, sizeof(asicKeys));
+	for (int k = 0; k < 4; k++) { asicOrder[k] = -1; }
+	asicWrites = 0;
+	ppiA = 0;
+	ppiC = 0;
+	ppiControl = 0x9B;
+	psgSelect = 0;
+	memset(psg, 0, sizeof(psg));
+	us = 0;
+	lineStart = 0;
+	line = 0;
+	r52 = 0;
+	intPending = false;
+	eiDelay = false;
+	opcode = -1;
+	frames = 0;
+	instructions = 0;
+	stopReason.clear();
+	memset(romMap, 0, sizeof(romMap));
+	ram64k = false;
+	plus = false;
+	if (!rom_map) { return; }
+	for (int i = 0; i < 256; i++) { romMap[i] = (((const uint32_t*)rom_map->ptr)[i >> 5] >> (i & 31)) & 1; }
+	ram64k = model->Read() != 0;
+	plus = plus_mode->Read() != 0;
+}
+
+// Amstrad_MMU.v ram_A for the classic mapping
+uint32_t SimFastForward::Physical(uint16_t a, bool rom, uint8_t map, uint8_t page) {
+	return sim_mmu_physical(a, rom, map, page, romBank);
+}
+
+// One bus cycle of about 1us; the gate array counts 64us lines and raises
+// the interrupt every 52 of them, resynced two lines into VSYNC
+void SimFastForward::Tick() {
+	us++;
+	if (us - lineStart < 64) { return; }
+	lineStart += 64;
+	line++;
+	if (++r52 == 52) {
+		r52 = 0;
+		intPending = true;
+	}
+	if (line == 2) {
+		if (r52 >= 32) { intPending = true; }
+		r52 = 0;
+	}
+	if (line == 312) {
+		line = 0;
+		frames++;
+	}
+}
+
+uint8_t SimFastForward::Fetch(uint16_t a) {
+	uint8_t v = Read(a);
+	if (opcode < 0) { opcode = v; }
+	return v;
+}
+
+uint8_t SimFastForward::Read(uint16_t a) {
+	Tick();
+	bool rom = ((a >> 14) == 0 && !(gaMode & 0x04)) || ((a >> 14) == 3 && !(gaMode & 0x08));
+	return Peek(Physical(a, rom, ramMap, ramPage));
+}
+
+void SimFastForward::Write(uint16_t a, uint8_t data) {
+	Tick();
+	Poke(Physical(a, false, ramMap, ramPage), data);
+}
+
+uint8_t SimFastForward::In(uint16_t port) {
+	Tick();
+	uint8_t v = 0xFF;
+	int reg = (port >> 8) & 3;
+	if (!(port & 0x4000) && reg == 3) { v = crtcSelect >= 12 && crtcSelect < 18 ? crtc[crtcSelect] : 0; }
+	if (!(port & 0x0800)) {
+		if (reg == 0 && (ppiC >> 6) == 1 && psgSelect < 14) { v = psg[psgSelect]; }
+		// {tape, 2'b11, ppi_jumpers, crtc_vs} as wired in sim.v
+		if (reg == 1) { v = (uint8_t)(0x7A | (ram64k ? 0 : 0x04) | (line < 8 ? 1 : 0)); }
+		if (reg == 2) { v = ppiC; }
+	}
+	// FDC main status: idle and ready
+	if ((port & 0x0581) == 0x0100) { v = 0x80; }
+	return v;
+}
+
+void SimFastForward::Out(uint16_t port, uint8_t data) {
+	Tick();
+	int reg = (port >> 8) & 3;
+
+	// MMU: RAM configuration and ROM select, decoded as loosely as Amstrad_MMU.v
+	if (!(port & 0x8000) && (data & 0xC0) == 0xC0 && !ram64k) {
+		ramPage = (uint8_t)((((~port >> 8) & 1) << 3 | ((data >> 3) & 7)) + 3);
+		ramMap = data & 7;
+		mmr = data;
+		mmrPort = (uint8_t)(port >> 8);
+	}
+	if (!(port & 0x2000)) {
+		romBank = romMap[data] ? data : 0;
+		romSelect = data;
+	}
+
+	// Gate array
+	if ((port & 0xC000) == 0x4000) {
+		switch (data >> 6) {
+		case 0: pen = data & 0x1F; break;
+		case 1: inks[pen & 0x10 ? 16 : pen & 0x0F] = data & 0x1F; break;
+		case 2:
+			gaMode = data;
+			if (data & 0x10) {
+				r52 = 0;
+				intPending = false;
+			}
+			break;
+		}
+	}
+
+	// CRTC, and the asic.sv registers keyed on the data written to BC00
+	if (!(port & 0x4000)) {
+		if (reg == 0) {
+			bcLast = data;
+			crtcSelect = data & 0x1F;
+		}
+		if (reg == 1 && crtcSelect < 18) { crtc[crtcSelect] = data; }
+	}
+	if ((port >> 8) == 0xBC && !(port & 1) && (data & 0x1F) < 4) {
+		int k = data & 0x1F;
+		asicKeys[k] = data;
+		asicOrder[k] = asicWrites++;
+		if (k == 2 && plus && (data == 0x02 || data == 0x62 || data == 0x82)) { stopReason = "program enabled the ASIC"; }
+	}
+
+	// PPI, and the PSG behind port A
+	if (!(port & 0x0800)) {
+		if (reg == 0) { ppiA = data; }
+		if (reg == 2) { ppiC = data; }
+		if (reg == 3) {
+			if (data & 0x80) {
+				ppiControl = data;
+				ppiA = 0;
+				ppiC = 0;
+			}
+			else if (data & 1) { ppiC |= (uint8_t)(1 << ((data >> 1) & 7)); }
+			else { ppiC &= (uint8_t)~(1 << ((data >> 1) & 7)); }
+		}
+		if (reg != 1) {
+			if ((ppiC >> 6) == 3) { psgSelect = ppiA & 0x0F; }
+			if ((ppiC >> 6) == 2) { psg[psgSelect] = ppiA; }
+		}
+	}
+}
+
+// Run the model from reset to the checkpoint
+void SimFastForward::Run() {
+	double start = SimPacer::Now();
+	Reset();
+
+	int frameLimit = targetFrames > 0 ? targetFrames : limitFrames;
+	const char* reason = NULL;
+	for (;;) {
+		if (targetPc >= 0 && z80.regs.pc == targetPc && !z80.regs.halted) {
+			reason = "reached PC";
+			break;
+		}
+		if (frames >= frameLimit) {
+			reason = targetFrames > 0 ? "reached frame" : "frame limit, PC never reached";
+			break;
+		}
+		if (!stopReason.empty()) {
+			reason = stopReason.c_str();
+			break;
+		}
+		if (intPending && z80.regs.iff1 && !eiDelay) {
+			intPending = false;
+			r52 &= 0x1F;
+			Tick();
+			z80.Interrupt(0xFF);
+			continue;
+		}
+		opcode = -1;
+		z80.Step();
+		instructions++;
+		eiDelay = opcode == 0xFB;
+	}
+	hostMs = SimPacer::Now() - start;
+	resumePc = z80.regs.halted ? (uint16_t)(z80.regs.pc - 1) : z80.regs.pc;
+
+	char text[256];
+	snprintf(text, sizeof(text), "Fast-forward: %llu instructions, %d frames (%.0f ms emulated) in %.0f ms, %s, resuming at %04X\n",
+		(unsigned long long)instructions, frames, us / 1000.0, hostMs, reason, resumePc);
+	report = text;
+	console.Log(LOG_INFO, LOG_SIM, "%s", text);
+}
+
+// Board and CPU from the snapshot, RAM straight into the SDRAM: the base
+// 64K at page 2, extension bank n at page n + 2 as Amstrad_MMU.v maps them
+void SimFastForward::LoadSnapshot() {
+	Reset();
+	z80.regs = sna.regs;
+	pen = sna.gaPen;
+	memcpy(inks, sna.gaInks, sizeof(inks));
+	gaMode = sna.gaMode;
+	mmr = sna.ramConfig;
+	if (!ram64k) {
+		ramMap = mmr & 7;
+		ramPage = (uint8_t)(((mmr >> 3) & 7) + 3);
+	}
+	romSelect = sna.romSelect;
+	romBank = romMap[romSelect] ? romSelect : 0;
+	bcLast = sna.crtcSelect;
+	crtcSelect = sna.crtcSelect & 0x1F;
+	memcpy(crtc, sna.crtc, sizeof(crtc));
+	ppiA = sna.ppiA;
+	ppiC = sna.ppiC;
+	ppiControl = sna.ppiControl;
+	psgSelect = sna.psgSelect & 0x0F;
+	memcpy(psg, sna.psg, sizeof(psg));
+	size_t banks = sna.memory.size() >> 16;
+	if (ram64k && banks > 1) { banks = 1; }
+	for (size_t b = 0; b < banks; b++) {
+		for (uint32_t i = 0; i < 0x10000; i++) { Poke((uint32_t)((b + 2) << 16) + i, sna.memory[(b << 16) + i]); }
+	}
+	resumePc = z80.regs.pc;
+	importing = false;
+	char text[64];
+	snprintf(text, sizeof(text), "%dK, resuming at %04X\n", (int)(banks * 64), resumePc);
+	report += text;
+	console.Log(LOG_INFO, LOG_SIM, "%s", report.c_str());
+}
+
+// Read one RTL register by name for the snapshot, 0 when it is not there
+uint64_t SimFastForward::Value(const char* name, int index) {
+	const SimSignal* s = signals->Get(name);
+	if (!s) {
+		if (missing.empty()) { missing = name; }
+		return 0;
+	}
+	return s->Read(index);
+}
+
+void SimFastForward::Capture() {
+	static const char* core = "motherboard.CPU.i_tv80_core.";
+	std::string file = exportFile;
+	exportFile.clear();
+	exportDue = false;
+	missing.clear();
+
+	SimSna out;
+	SimZ80_Regs& r = out.regs;
+	std::string c = core;
+	r.a = (uint8_t)Value((c + "ACC").c_str());
+	r.f = (uint8_t)Value((c + "F").c_str());
+	r.a_ = (uint8_t)Value((c + "Ap").c_str());
+	r.f_ = (uint8_t)Value((c + "Fp").c_str());
+	r.i = (uint8_t)Value((c + "I").c_str());
+	r.sp = (uint16_t)Value((c + "SP").c_str());
+	r.iff1 = (uint8_t)Value((c + "IntE_FF1").c_str());
+	r.iff2 = (uint8_t)Value((c + "IntE_FF2").c_str());
+	r.im = (uint8_t)Value((c + "IStatus").c_str());
+	// R only exists in a tv80 built with TV80_REFRESH
+	const SimSignal* rr = signals->Get(c + "R");
+	r.r = rr ? (uint8_t)rr->Read() : 0;
+	// HALT keeps fetching the opcode after it
+	const SimSignal* halt = signals->Get(c + "Halt_FF");
+	r.pc = halt && halt->Read() ? (uint16_t)(exportPc - 1) : exportPc;
+	std::string regs = c + "i_reg.";
+	int bank = Value((c + "Alternate").c_str()) ? 4 : 0;
+	int alt = 4 - bank;
+	uint8_t* pairs[8][2] = { { &r.b, &r.c }, { &r.d, &r.e }, { &r.h, &r.l }, { &r.ixh, &r.ixl },
+		{ &r.b_, &r.c_ }, { &r.d_, &r.e_ }, { &r.h_, &r.l_ }, { &r.iyh, &r.iyl } };
+	int index[8] = { bank, bank + 1, bank + 2, 3, alt, alt + 1, alt + 2, 7 };
+	for (int i = 0; i < 8; i++) {
+		*pairs[i][0] = (uint8_t)Value((regs + "RegsH").c_str(), index[i]);
+		*pairs[i][1] = (uint8_t)Value((regs + "RegsL").c_str(), index[i]);
+	}
+
+	// Gate array: {hromen, lromen, mode1, mode0} are the control bits as written
+	out.gaPen = (uint8_t)Value("motherboard.GateArray.inksel");
+	for (int i = 0; i < 16; i++) { out.gaInks[i] = (uint8_t)Value("motherboard.GateArray.inkr", i); }
+	out.gaInks[16] = (uint8_t)Value("motherboard.GateArray.border");
+	out.gaMode = (uint8_t)(0x80 | Value("motherboard.GateArray.hromen") << 3 | Value("motherboard.GateArray.lromen") << 2 |
+		Value("motherboard.GateArray.mode1") << 1 | Value("motherboard.GateArray.mode0"));
+	out.ramConfig = (uint8_t)(0xC0 | ((mmu_page->Read() - 3) & 7) << 3 | mmu_map->Read());
+	out.romSelect = (uint8_t)Value("motherboard.MMU.ROMbank");
+
+	// UM6845R keeps the registers split into fields
+	const char* crtc_names[] = { "R0_h_total", "R1_h_displayed", "R2_h_sync_pos", NULL, "R4_v_total", "R5_v_total_adj",
+		"R6_v_displayed", "R7_v_sync_pos", NULL, "R9_v_max_line", NULL, "R11_cursor_end", "R12_start_addr_h",
+		"R13_start_addr_l", "R14_cursor_h", "R15_cursor_l" };
+	std::string crtc = "motherboard.CRTC.";
+	for (int i = 0; i < 16; i++) {
+		if (crtc_names[i]) { out.crtc[i] = (uint8_t)Value((crtc + crtc_names[i]).c_str()); }
+	}
+	out.crtc[3] = (uint8_t)(Value((crtc + "R3_v_sync_width").c_str()) << 4 | Value((crtc + "R3_h_sync_width").c_str()));
+	out.crtc[8] = (uint8_t)(Value((crtc + "R8_skew").c_str()) << 4 | Value((crtc + "R8_interlace").c_str()));
+	out.crtc[10] = (uint8_t)(Value((crtc + "R10_cursor_mode").c_str()) << 5 | Value((crtc + "R10_cursor_start").c_str()));
+	out.crtcSelect = (uint8_t)Value((crtc + "addr").c_str());
+
+	out.ppiA = (uint8_t)Value("motherboard.PPI.opa_r");
+	out.ppiB = (uint8_t)Value("motherboard.PPI.opb_r");
+	out.ppiC = (uint8_t)Value("motherboard.PPI.opc_r");
+	out.ppiControl = (uint8_t)Value("motherboard.PPI.mode");
+	out.psgSelect = (uint8_t)Value("motherboard.PSG.addr");
+	for (int i = 0; i < 16; i++) { out.psg[i] = (uint8_t)Value("motherboard.PSG.ymreg", i); }
+
+	if (!missing.empty()) {
+		console.AddLog("[error] Snapshot: %s is not public in this model", missing.c_str());
+		return;
+	}
+	bool small = model->Read() != 0;
+	out.machine = plus_mode->Read() ? SNA_GX4000 : small ? SNA_CPC464 : SNA_CPC6128;
+	out.memory.resize(small ? 0x10000 : 0x20000);
+	for (uint32_t i = 0; i < out.memory.size(); i++) { out.memory[i] = Peek(0x20000 + i); }
+	if (!out.Save(file)) {
+		console.AddLog("[error] Snapshot: %s", out.error.c_str());
+		return;
+	}
+	console.Log(LOG_INFO, LOG_SIM, "Snapshot %s saved at PC %04X, time %llu", file.c_str(), r.pc, time ? (unsigned long long)*time : 0ULL);
+}
+
+// LD BC,port (or LD B,n) only when it changes, then LD A,n; OUT (C),A
+void SimFastForward::EmitOut(uint16_t port, uint8_t data) {
+	if ((port & 0xFF) != (stubBC & 0xFF)) {
+		Emit(0x01);
+		Emit16(port);
+	}
+	else if (port != stubBC) {
+		Emit(0x06);
+		Emit((uint8_t)(port >> 8));
+	}
+	stubBC = port;
+	Emit(0x3E);
+	Emit(data);
+	Emit(0xED);
+	Emit(0x79);
+}
+
+// AF' and AF as data at stubAddr, code from stubAddr + 4
+void SimFastForward::BuildStub() {
+	const SimZ80_Regs& r = z80.regs;
+	stubSize = 0;
+	stubBC = 0xFFFF;
+	Emit(r.f_);
+	Emit(r.a_);
+	Emit(r.f);
+	Emit(r.a);
+
+	// PPI control first as it clears the outputs, then the PSG registers
+	EmitOut(0xF700, 0x82);
+	for (int i = 0; i < 14; i++) {
+		EmitOut(0xF400, (uint8_t)i);
+		EmitOut(0xF600, 0xC0);
+		EmitOut(0xF600, 0x00);
+		EmitOut(0xF400, psg[i]);
+		EmitOut(0xF600, 0x80);
+		EmitOut(0xF600, 0x00);
+	}
+	EmitOut(0xF400, psgSelect);
+	EmitOut(0xF600, 0xC0);
+	EmitOut(0xF600, 0x00);
+	EmitOut(0xF700, ppiControl);
+	EmitOut(0xF400, ppiA);
+	EmitOut(0xF600, ppiC);
+
+	// CRTC. Selecting registers 0-3 also hits the asic.sv keys, so they are
+	// replayed afterwards in the order the program wrote them (never written
+	// ones with a value that leaves the ASIC off), then the last select.
+	for (int i = 0; i < 16; i++) {
+		EmitOut(0xBC00, (uint8_t)i);
+		EmitOut(0xBD00, crtc[i]);
+	}
+	for (int k = 0; k < 4; k++) {
+		if (asicOrder[k] < 0) { EmitOut(0xBC00, (uint8_t)(0xE0 | k)); }
+	}
+	int keys[4] = { 0, 1, 2, 3 };
+	std::sort(keys, keys + 4, [this](int a, int b) { return asicOrder[a] < asicOrder[b]; });
+	for (int i = 0; i < 4; i++) {
+		if (asicOrder[keys[i]] >= 0) { EmitOut(0xBC00, asicKeys[keys[i]]); }
+	}
+	EmitOut(0xBC00, bcLast);
+
+	// Gate array and ROM select, then the RAM configuration last as it can
+	// move the stub (it is written to both places)
+	for (int i = 0; i < 17; i++) {
+		EmitOut(0x7F00, (uint8_t)(i == 16 ? 0x10 : i));
+		EmitOut(0x7F00, (uint8_t)(0x40 | inks[i]));
+	}
+	EmitOut(0x7F00, pen);
+	EmitOut(0x7F00, (uint8_t)(0x80 | (gaMode & 0x0F)));
+	EmitOut(0xDF00, romSelect);
+	if (!ram64k) { EmitOut((uint16_t)(mmrPort << 8), mmr); }
+
+	// Alternate set, then the main registers
+	Emit(0x01); Emit(r.c_); Emit(r.b_);				// LD BC,nn
+	Emit(0x11); Emit(r.e_); Emit(r.d_);				// LD DE,nn
+	Emit(0x21); Emit(r.l_); Emit(r.h_);				// LD HL,nn
+	Emit(0x31); Emit16(stubAddr);					// LD SP,nn
+	Emit(0xF1);										// POP AF
+	Emit(0xD9);										// EXX
+	Emit(0x08);										// EX AF,AF'
+	Emit(0xDD); Emit(0x21); Emit(r.ixl); Emit(r.ixh);	// LD IX,nn
+	Emit(0xFD); Emit(0x21); Emit(r.iyl); Emit(r.iyh);	// LD IY,nn
+	Emit(0x3E); Emit(r.i); Emit(0xED); Emit(0x47);	// LD A,n; LD I,A
+	Emit(0xED); Emit(r.im == 2 ? 0x5E : r.im == 1 ? 0x56 : 0x46);
+	Emit(0x01); Emit(r.c); Emit(r.b);
+	Emit(0x11); Emit(r.e); Emit(r.d);
+	Emit(0x21); Emit(r.l); Emit(r.h);
+
+	// R counts on through the opcode fetches still to come
+	int fetches = r.iff1 ? 5 : 4;
+	Emit(0x3E); Emit((uint8_t)((r.r & 0x80) | ((r.r - fetches) & 0x7F)));
+	Emit(0xED); Emit(0x4F);							// LD R,A
+	Emit(0x31); Emit16((uint16_t)(stubAddr + 2));	// LD SP,nn
+	Emit(0xF1);										// POP AF
+	Emit(0x31); Emit16(r.sp);						// LD SP,nn
+	if (r.iff1) { Emit(0xFB); }						// EI
+	Emit(0xC3); Emit16(resumePc);					// JP nn
+}
+
+// The RTL CPU is starting an opcode fetch
+void SimFastForward::Fetched() {
+	if (!exportFile.empty() && !exportDue && !prefixPending) {
+		exportDue = true;
+		exportPc = fetchAddr;
+	}
+	if (state == FASTFWD_ARMED) {
+		if (reset->Read() || download->Read() || prefixPending) { return; }
+		if (importing) { LoadSnapshot(); }
+		else { Run(); }
+		state = FASTFWD_PATCH;
+	}
+	if (state == FASTFWD_PATCH) {
+		// DI; JP stub goes over this opcode, so all four bytes must be in one bank
+		if (prefixPending || (fetchAddr & 0x3FFF) > 0x3FFC) { return; }
+		patchAddr = fetchAddr;
+		patchDelay = 3;
+	}
+	else if (state == FASTFWD_ENTER && fetchAddr == (uint16_t)(stubAddr + 4)) {
+		for (int i = 0; i < 4; i++) { Poke(patchPhys + i, patchSaved[i]); }
+		state = FASTFWD_STUB;
+	}
+	else if (state == FASTFWD_STUB && fetchAddr == resumePc) {
+		Restore();
+		state = FASTFWD_DONE;
+		console.Log(LOG_INFO, LOG_SIM, "Fast-forward handed off to RTL at PC %04X, time %llu", resumePc, time ? (unsigned long long)*time : 0ULL);
+	}
+}
+
+// A few clocks into the fetch the MMU has the physical address on the SDRAM,
+// and the data is not sampled yet
+void SimFastForward::Patch() {
+	uint32_t phys = (uint32_t)sdram_addr->Read();
+	if (rd_n->Read() || (phys & 0x3FFF) != (patchAddr & 0x3FFF)) { return; }
+
+	// Somewhere in 8000-BFFF clear of the checkpoint and of the patch
+	uint8_t rtlMap = (uint8_t)mmu_map->Read();
+	uint8_t rtlPage = (uint8_t)mmu_page->Read();
+	stubAddr = 0x8000;
+	BuildStub();
+	bool placed = false;
+	uint32_t size = (uint32_t)stubSize;
+	for (uint32_t s = 0x8000; s + size <= 0xC000 && !placed; s += 0x100) {
+		stubAddr = (uint16_t)s;
+		stubPhys[0] = Physical(stubAddr, false, rtlMap, rtlPage);
+		stubPhys[1] = Physical(stubAddr, false, ramMap, ramPage);
+		placed = !((uint32_t)resumePc + 4 > s && resumePc < s + size);
+		for (int c = 0; c < 2; c++) {
+			if (phys + 4 > stubPhys[c] && phys < stubPhys[c] + size) { placed = false; }
+		}
+	}
+	if (!placed) { return; }
+	BuildStub();
+
+	stubCopies = stubPhys[1] == stubPhys[0] ? 1 : 2;
+	for (int c = 0; c < stubCopies; c++) {
+		for (int i = 0; i < stubSize; i++) {
+			stubSaved[c][i] = Peek(stubPhys[c] + i);
+			Poke(stubPhys[c] + i, stub[i]);
+		}
+	}
+	uint16_t entry = (uint16_t)(stubAddr + 4);
+	uint8_t patch[4] = { 0xF3, 0xC3, (uint8_t)entry, (uint8_t)(entry >> 8) };
+	patchPhys = phys;
+	for (int i = 0; i < 4; i++) {
+		patchSaved[i] = Peek(phys + i);
+		Poke(phys + i, patch[i]);
+	}
+	state = FASTFWD_ENTER;
+}
+
+void SimFastForward::Draw(const char* title, bool* p_open, ImVec2 size) {
+	ImGui::SetNextWindowSize(size, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin(title, p_open)) {
+		ImGui::End();
+		return;
+	}
+	static char spec[64] = "frames=100";
+	ImGui::SetNextItemWidth(200);
+	ImGui::InputTextWithHint("##checkpoint", "pc=BB06 and/or frames=N", spec, IM_ARRAYSIZE(spec));
+	ImGui::SameLine();
+	if (ImGui::Button("Arm")) {
+		Cancel();
+		Arm(spec);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Cancel")) { Cancel(); }
+	ImGui::Text("%s", states[state]);
+	if (state == FASTFWD_ARMED || state == FASTFWD_IDLE) {
+		ImGui::TextDisabled("Runs from reset at the next RTL instruction after downloads finish");
+	}
+	if (!report.empty()) { ImGui::TextWrapped("%s", report.c_str()); }
+
+	ImGui::Separator();
+	static char file[128] = "scene.sna";
+	ImGui::SetNextItemWidth(200);
+	ImGui::InputText("##sna", file, IM_ARRAYSIZE(file));
+	ImGui::SameLine();
+	if (ImGui::Button("Load SNA")) { Import(file); }
+	ImGui::SameLine();
+	if (ImGui::Button("Save SNA")) { Export(file); }
+	if (!exportFile.empty()) { ImGui::Text("saving at the next instruction"); }
+	ImGui::End();
+}
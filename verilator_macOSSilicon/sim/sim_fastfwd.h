@@ -0,0 +1,196 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "imgui.h"
+#include "sim_signals.h"
+#include "sim_sdram.h"
+#include "sim_z80.h"
+#include "sim_sna.h"
+#include <string>
+#include <stdint.h>
+
+// Fast-forward of the boot through a behavioural model, then hand off to RTL
+//
+// Arm() takes a checkpoint ("pc=BB06", "frames=150" or both). At the next
+// instruction the RTL CPU starts once downloads are done, the machine is run
+// from reset by SimZ80 plus a small model of the rest of the board: the
+// Amstrad_MMU.v banking (RAM configurations, lower/upper ROM, the rom_map
+// ROM select), the gate array pens/inks/mode and its 300Hz interrupt, CRTC,
+// PPI and PSG registers. It reads and writes the RTL's own SDRAM, so ROM and
+// cartridge images are the ones the RTL loaded and RAM needs no copying.
+// Timing is approximate: every bus cycle counts as 1us.
+//
+// At the checkpoint the state goes into the RTL without touching its
+// internals: a restore stub is written into RAM at 8000-BFFF, and the
+// opcode the RTL CPU is about to fetch is patched to DI; JP stub. The stub
+// replays the port writes that rebuild the board state, loads every Z80
+// register and jumps to the checkpoint PC. The patched bytes and the stub
+// memory are put back as soon as they have been executed, and the RTL runs
+// on cycle accurately from there.
+//
+// Not carried over: the exact 300Hz counter phase, CRTC counters, the PSG
+// tone/envelope phase, and Plus ASIC state (the model hands off early as
+// soon as the program enables the ASIC). Needs the tv80 and MMU signals by
+// name, so the hierarchical build reports it as unavailable.
+//
+// Import() hands a .SNA snapshot to the RTL through the same stub in place
+// of a model run, so a scene boots instantly on any RTL revision. Export()
+// reads the registers out of tv80, the gate array, UM6845R, i8255 and
+// YM2149 by name at the next instruction boundary and saves them with the
+// RAM as a .SNA.
+
+#define FASTFWD_IDLE    0
+#define FASTFWD_ARMED   1	// waiting for the RTL to come out of reset
+#define FASTFWD_PATCH   2	// model done, waiting for an RTL instruction start to patch
+#define FASTFWD_ENTER   3	// patched, waiting for the RTL to reach the stub
+#define FASTFWD_STUB    4	// stub running, waiting for the checkpoint PC
+#define FASTFWD_DONE    5
+
+#define FASTFWD_STUB_MAX 2048
+
+struct SimFastForward : public SimZ80_Bus {
+public:
+	SimSignals* signals;
+	vluint64_t* time;
+	SimSDRAM* sdram;		// SDRAM=dpi build
+	uint8_t* ram;			// otherwise the 8MB array inside the model
+
+	int targetPc;			// -1 = none
+	int targetFrames;		// 0 = none
+	int limitFrames;		// give up and hand off here when the PC is never reached
+
+	int state;
+	uint64_t instructions;
+	int frames;
+	double hostMs;
+	std::string report;
+
+	void Check() {
+		if ((state == FASTFWD_IDLE || state == FASTFWD_DONE) && exportFile.empty()) { return; }
+		bool rd = !rd_n->Read();
+		bool m1 = !m1_n->Read();
+		if (rd && !lastRd) {
+			fetching = m1 && !mreq_n->Read();
+			fetchAddr = (uint16_t)addr->Read();
+			if (fetching) { Fetched(); }
+		}
+		if (!rd && lastRd) {
+			if (fetching) { prefixPending = sim_z80_prefix(lastPrefix, (uint8_t)di_reg->Read()); }
+			else {
+				prefixPending = false;
+				lastPrefix = 0;
+			}
+		}
+		if (patchDelay && !--patchDelay) { Patch(); }
+		// Registers are read once the fetch's M1 ends (tv80 has no rfsh_n)
+		if (exportDue && !m1 && lastM1) { Capture(); }
+		lastRd = rd;
+		lastM1 = m1;
+	}
+
+	bool Arm(const std::string& spec);
+	void Cancel();
+	bool Import(const std::string& file);
+	bool Export(const std::string& file);
+	bool ExportPending() { return !exportFile.empty(); }
+	void Draw(const char* title, bool* p_open, ImVec2 size);
+
+	// SimZ80_Bus, the behavioural board
+	uint8_t Fetch(uint16_t addr);
+	uint8_t Read(uint16_t addr);
+	void Write(uint16_t addr, uint8_t data);
+	uint8_t In(uint16_t port);
+	void Out(uint16_t port, uint8_t data);
+
+	SimFastForward();
+
+private:
+	SimZ80 z80;
+
+	// RTL signals
+	const SimSignal* m1_n;
+	const SimSignal* mreq_n;
+	const SimSignal* rd_n;
+	const SimSignal* addr;
+	const SimSignal* di_reg;
+	const SimSignal* reset;
+	const SimSignal* download;
+	const SimSignal* sdram_addr;
+	const SimSignal* mmu_map;
+	const SimSignal* mmu_page;
+	const SimSignal* rom_map;
+	const SimSignal* model;
+	const SimSignal* plus_mode;
+
+	bool lastRd;
+	bool fetching;
+	bool prefixPending;
+	uint8_t lastPrefix;
+	uint16_t fetchAddr;
+	int patchDelay;
+	bool lastM1;
+
+	// Snapshots
+	SimSna sna;
+	bool importing;
+	std::string exportFile;
+	bool exportDue;
+	uint16_t exportPc;
+	std::string missing;
+
+	// Board state
+	bool romMap[256];
+	bool ram64k;
+	bool plus;
+	uint8_t ramMap, ramPage, romBank, romSelect, mmrPort, mmr;
+	uint8_t gaMode, pen, inks[17];
+	uint8_t bcLast, crtcSelect, crtc[18];
+	uint8_t asicKeys[4];	// asic.sv decodes BC00 writes with data 0-3
+	int asicOrder[4];		// write order of the keys, -1 = never written
+	int asicWrites;
+	uint8_t ppiA, ppiC, ppiControl;
+	uint8_t psgSelect, psg[16];
+
+	// Timing, in us
+	uint64_t us;
+	uint64_t lineStart;
+	int line;
+	int r52;
+	bool intPending;
+	bool eiDelay;
+	int opcode;				// first byte fetched by the current instruction
+	std::string stopReason;
+
+	// Handoff
+	uint8_t stub[FASTFWD_STUB_MAX];
+	int stubSize;
+	uint16_t stubAddr;
+	uint16_t resumePc;
+	uint32_t stubPhys[2];
+	uint8_t stubSaved[2][FASTFWD_STUB_MAX];
+	int stubCopies;
+	uint16_t patchAddr;
+	uint32_t patchPhys;
+	uint8_t patchSaved[4];
+	uint16_t stubBC;
+
+	uint8_t Peek(uint32_t a) { return sdram ? sdram->Read(a) : ram[a & 0x7FFFFF]; }
+	void Poke(uint32_t a, uint8_t d) {
+		if (sdram) { sdram->Write(a, d); }
+		else { ram[a & 0x7FFFFF] = d; }
+	}
+	uint32_t Physical(uint16_t a, bool rom, uint8_t map, uint8_t page);
+	void Tick();
+	void Reset();
+	void Run();
+	bool Attach();
+	void LoadSnapshot();
+	uint64_t Value(const char* name, int index = 0);
+	void Capture();
+	void Fetched();
+	void Patch();
+	void BuildStub();
+	void Emit(uint8_t b) { if (stubSize < FASTFWD_STUB_MAX) { stub[stubSize++] = b; } }
+	void Emit16(uint16_t v) { Emit((uint8_t)v); Emit((uint8_t)(v >> 8)); }
+	void EmitOut(uint16_t port, uint8_t data);
+	void Restore();
+};
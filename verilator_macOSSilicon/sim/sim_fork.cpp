@@ -0,0 +1,137 @@
+#include "sim_fork.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#else
+#define WIN32
+#endif
+
+static double now_seconds() {
+#ifndef WIN32
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#else
+	return 0;
+#endif
+}
+
+std::string SimFork_Variant::Get(std::string key, std::string fallback) {
+	std::map<std::string, std::string>::iterator it = options.find(key);
+	return it == options.end() ? fallback : it->second;
+}
+
+int SimFork_Variant::GetInt(std::string key, int fallback) {
+	std::string v = Get(key, "");
+	return v.empty() ? fallback : (int)strtol(v.c_str(), NULL, 0);
+}
+
+bool SimFork_Variant::Has(std::string key) {
+	return options.find(key) != options.end();
+}
+
+SimForkServer::SimForkServer(int jobs) {
+	maxJobs = jobs;
+#ifndef WIN32
+	if (maxJobs <= 0) { maxJobs = (int)sysconf(_SC_NPROCESSORS_ONLN); }
+#endif
+	if (maxJobs <= 0) { maxJobs = 1; }
+}
+
+SimForkServer::~SimForkServer() {
+}
+
+bool SimForkServer::LoadVariants(std::string file) {
+	std::ifstream in(file);
+	if (!in) {
+		fprintf(stderr, "Cannot open variants file %s\n", file.c_str());
+		return false;
+	}
+	std::string line;
+	while (std::getline(in, line)) {
+		size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#') { continue; }
+		SimFork_Variant v;
+		v.line = line;
+		std::istringstream tokens(line);
+		std::string token;
+		while (tokens >> token) {
+			size_t eq = token.find('=');
+			if (eq == std::string::npos) { v.options[token] = "1"; }
+			else { v.options[token.substr(0, eq)] = token.substr(eq + 1); }
+		}
+		if (!v.Has("name")) { v.options["name"] = "variant" + std::to_string(variants.size()); }
+		variants.push_back(v);
+	}
+	return true;
+}
+
+// Returns the number of children that did not exit with status 0
+int SimForkServer::Run(std::function<int(int index, SimFork_Variant& variant)> child) {
+#ifdef WIN32
+	fprintf(stderr, "Fork server is not supported on Windows\n");
+	return (int)variants.size();
+#else
+	results.clear();
+	results.resize(variants.size());
+	std::map<pid_t, int> running;
+	size_t next = 0;
+	int failed = 0;
+
+	while (next < variants.size() || running.size() > 0) {
+		// Keep maxJobs children busy
+		while (next < variants.size() && (int)running.size() < maxJobs) {
+			int index = (int)next++;
+			SimFork_Result& r = results[index];
+			r.name = variants[index].Get("name", "");
+			r.seconds = now_seconds();
+
+			fflush(stdout);
+			fflush(stderr);
+			pid_t pid = fork();
+			if (pid == 0) {
+				int rc = child(index, variants[index]);
+				fflush(stdout);
+				fflush(stderr);
+				_exit(rc);
+			}
+			if (pid < 0) {
+				perror("fork");
+				r.pid = -1;
+				r.status = -1;
+				failed++;
+				continue;
+			}
+			r.pid = pid;
+			running[pid] = index;
+		}
+
+		// Reap one child
+		int status = 0;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0) { break; }
+		std::map<pid_t, int>::iterator it = running.find(pid);
+		if (it == running.end()) { continue; }
+		SimFork_Result& r = results[it->second];
+		r.seconds = now_seconds() - r.seconds;
+		r.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+		if (r.status != 0) { failed++; }
+		running.erase(it);
+	}
+	return failed;
+#endif
+}
+
+void SimForkServer::PrintSummary() {
+	printf("%-32s %8s %6s %10s\n", "variant", "pid", "status", "seconds");
+	for (size_t i = 0; i < results.size(); i++) {
+		SimFork_Result& r = results[i];
+		printf("%-32s %8d %6d %10.2f\n", r.name.c_str(), r.pid, r.status, r.seconds);
+	}
+}
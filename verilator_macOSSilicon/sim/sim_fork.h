@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
+// Fork server for headless regression runs
+//
+// The parent boots the model once, then Run() forks one child per variant.
+// Children share the booted model copy-on-write, apply their variant and
+// run to completion; at most maxJobs run at the same time.
+//
+// Variants file: one child per line as whitespace separated key=value pairs,
+// e.g. "name=fire frames=200 input=fire.log save=fire.sav" or
+// "name=disc type=run\"disc\n frames=500". Blank lines and
+// lines starting with # are skipped.
+
+struct SimFork_Variant {
+public:
+	std::string line;
+	std::map<std::string, std::string> options;
+
+	std::string Get(std::string key, std::string fallback);
+	int GetInt(std::string key, int fallback);
+	bool Has(std::string key);
+};
+
+struct SimFork_Result {
+public:
+	std::string name;
+	int pid;
+	int status;
+	double seconds;
+};
+
+struct SimForkServer {
+public:
+
+	int maxJobs;
+	std::vector<SimFork_Variant> variants;
+	std::vector<SimFork_Result> results;
+
+	bool LoadVariants(std::string file);
+	int Run(std::function<int(int index, SimFork_Variant& variant)> child);
+	void PrintSummary();
+
+	SimForkServer(int jobs);
+	~SimForkServer();
+};
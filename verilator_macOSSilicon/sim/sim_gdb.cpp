@@ -0,0 +1,436 @@
+#include "sim_gdb.h"
+#include "sim_console.h"
+#include "sim_mmu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#else
+#define WIN32
+#endif
+
+static DebugConsole console;
+
+SimGdb::SimGdb() {
+	signals = NULL;
+	sdram = NULL;
+	ram = NULL;
+	running = false;
+	status = "not listening";
+	listenFd = -1;
+	clientFd = -1;
+	noAck = false;
+	lastRd = false;
+	lastM1 = false;
+	fetching = false;
+	prefixPending = true;
+	lastPrefix = 0;
+	stepping = false;
+	breakIn = false;
+	stopDue = false;
+	replyDue = false;
+	stopSignal = 5;
+	stopPc = 0;
+	memset(&regs, 0, sizeof(regs));
+}
+
+SimGdb::~SimGdb() {
+	Close();
+}
+
+bool SimGdb::Attach() {
+	static const char* core_names[] = { "ACC", "F", "Ap", "Fp", "I", "SP", "R", "IntE_FF1", "IntE_FF2", "IStatus", "Alternate" };
+	static const char* mmu_names[] = { "motherboard.MMU.RAMmap", "motherboard.MMU.RAMpage", "motherboard.MMU.ROMbank",
+		"motherboard.GateArray.lromen", "motherboard.GateArray.hromen" };
+	std::string c = "motherboard.CPU.i_tv80_core.";
+	struct { const SimSignal** signal; std::string name; } wanted[] = {
+		{ &m1_n, c + "m1_n" }, { &mreq_n, "motherboard.CPU.mreq_n_reg" }, { &rd_n, "motherboard.CPU.rd_n_reg" },
+		{ &addr, c + "A" }, { &di_reg, "motherboard.CPU.di_reg" },
+		{ &regsH, c + "i_reg.RegsH" }, { &regsL, c + "i_reg.RegsL" },
+	};
+	std::string missing;
+	for (size_t i = 0; i < sizeof(wanted) / sizeof(wanted[0]); i++) {
+		*wanted[i].signal = signals->Get(wanted[i].name);
+		if (!*wanted[i].signal && missing.empty()) { missing = wanted[i].name; }
+	}
+	// R (6) only exists in a tv80 built with TV80_REFRESH
+	for (int i = 0; i < 11; i++) {
+		core[i] = signals->Get(c + core_names[i]);
+		if (!core[i] && i != 6 && missing.empty()) { missing = c + core_names[i]; }
+	}
+	for (int i = 0; i < 5; i++) {
+		mmu[i] = signals->Get(mmu_names[i]);
+		if (!mmu[i] && missing.empty()) { missing = mmu_names[i]; }
+	}
+	halt_ff = signals->Get(c + "Halt_FF");
+	if (!missing.empty()) {
+		status = missing + " is not public in this model";
+		console.AddLog("[error] GDB: %s", status.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Z80 address to SDRAM through the MMU state the RTL has now
+uint32_t SimGdb::Physical(uint16_t a, bool write) {
+	int bank = a >> 14;
+	bool rom = !write && ((bank == 0 && !mmu[3]->Read()) || (bank == 3 && !mmu[4]->Read()));
+	return sim_mmu_physical(a, rom, (uint8_t)mmu[0]->Read(), (uint8_t)mmu[1]->Read(), (uint8_t)mmu[2]->Read());
+}
+
+// An instruction starts at pc: stop when its M1 ends if anything asks for it
+void SimGdb::Started(uint16_t pc) {
+	// HALT keeps fetching the opcode after it, which is not a new instruction
+	bool halted = halt_ff && halt_ff->Read();
+	bool hit = !halted && breakpoints.count(pc);
+	if (!stepping && !breakIn && !hit) { return; }
+	stopSignal = breakIn && !stepping && !hit ? 2 : 5;	// SIGINT, SIGTRAP
+	stopPc = halted ? (uint16_t)(pc - 1) : pc;
+	stopDue = true;
+}
+
+void SimGdb::Stopped() {
+	stopDue = false;
+	stepping = false;
+	breakIn = false;
+	running = false;
+	ReadRTL();
+	char buf[64];
+	snprintf(buf, sizeof(buf), "stopped at %04X", regs.pc);
+	status = buf;
+	if (replyDue) {
+		snprintf(buf, sizeof(buf), "S%02x", stopSignal);
+		Send(buf);
+		replyDue = false;
+	}
+}
+
+void SimGdb::ReadRTL() {
+	regs.a = (uint8_t)core[0]->Read();
+	regs.f = (uint8_t)core[1]->Read();
+	regs.a_ = (uint8_t)core[2]->Read();
+	regs.f_ = (uint8_t)core[3]->Read();
+	regs.i = (uint8_t)core[4]->Read();
+	regs.sp = (uint16_t)core[5]->Read();
+	regs.r = core[6] ? (uint8_t)core[6]->Read() : 0;
+	regs.iff1 = (uint8_t)core[7]->Read();
+	regs.iff2 = (uint8_t)core[8]->Read();
+	regs.im = (uint8_t)core[9]->Read();
+	regs.pc = stopPc;
+	int bank = core[10]->Read() ? 4 : 0;
+	int alt = 4 - bank;
+	uint8_t* pairs[8][2] = { { &regs.b, &regs.c }, { &regs.d, &regs.e }, { &regs.h, &regs.l }, { &regs.ixh, &regs.ixl },
+		{ &regs.b_, &regs.c_ }, { &regs.d_, &regs.e_ }, { &regs.h_, &regs.l_ }, { &regs.iyh, &regs.iyl } };
+	int index[8] = { bank, bank + 1, bank + 2, 3, alt, alt + 1, alt + 2, 7 };
+	for (int i = 0; i < 8; i++) {
+		*pairs[i][0] = (uint8_t)regsH->Read(index[i]);
+		*pairs[i][1] = (uint8_t)regsL->Read(index[i]);
+	}
+}
+
+// GDB's z80 register file, 16 bits each, little endian
+std::string SimGdb::ReadRegisters() {
+	SimZ80_Regs& r = regs;
+	uint16_t values[GDB_REGS] = {
+		(uint16_t)(r.a << 8 | r.f), (uint16_t)(r.b << 8 | r.c), (uint16_t)(r.d << 8 | r.e), (uint16_t)(r.h << 8 | r.l),
+		r.sp, r.pc, (uint16_t)(r.ixh << 8 | r.ixl), (uint16_t)(r.iyh << 8 | r.iyl),
+		(uint16_t)(r.a_ << 8 | r.f_), (uint16_t)(r.b_ << 8 | r.c_), (uint16_t)(r.d_ << 8 | r.e_), (uint16_t)(r.h_ << 8 | r.l_),
+		(uint16_t)(r.i << 8 | r.r) };
+	std::string out;
+	char buf[8];
+	for (int i = 0; i < GDB_REGS; i++) {
+		snprintf(buf, sizeof(buf), "%02x%02x", values[i] & 0xFF, values[i] >> 8);
+		out += buf;
+	}
+	return out;
+}
+
+static int hex_digit(char c) {
+	if (c >= '0' && c <= '9') { return c - '0'; }
+	if (c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+	if (c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+	return -1;
+}
+
+// Returns false when the packet needs the CPU stopped and it is still running
+bool SimGdb::Handle(const std::string& p) {
+	char kind = p.empty() ? 0 : p[0];
+	if (running && kind != 'q' && kind != 'Q' && kind != 'H' && kind != 'v' && kind != 'k' && kind != 'D') { return false; }
+
+	if (kind == '?') {
+		char buf[8];
+		snprintf(buf, sizeof(buf), "S%02x", stopSignal);
+		Send(buf);
+	}
+	else if (kind == 'g') { Send(ReadRegisters()); }
+	else if (kind == 'p') {
+		unsigned long n = strtoul(p.c_str() + 1, NULL, 16);
+		if (n >= GDB_REGS) { Send("E01"); }
+		else { Send(ReadRegisters().substr(n * 4, 4)); }
+	}
+	else if (kind == 'G' || kind == 'P') { Send("E01"); }	// registers are read only
+	else if (kind == 'm' || kind == 'M') {
+		char* end;
+		unsigned long a = strtoul(p.c_str() + 1, &end, 16);
+		unsigned long length = *end == ',' ? strtoul(end + 1, &end, 16) : 0;
+		if (length > 0x1000) { length = 0x1000; }
+		if (kind == 'm') {
+			std::string out;
+			char buf[4];
+			for (unsigned long i = 0; i < length; i++) {
+				snprintf(buf, sizeof(buf), "%02x", Peek(Physical((uint16_t)(a + i), false)));
+				out += buf;
+			}
+			Send(out);
+		}
+		else {
+			const char* data = *end == ':' ? end + 1 : NULL;
+			if (!data || strlen(data) < length * 2) {
+				Send("E01");
+				return true;
+			}
+			for (unsigned long i = 0; i < length; i++) {
+				int hi = hex_digit(data[i * 2]), lo = hex_digit(data[i * 2 + 1]);
+				if (hi < 0 || lo < 0) {
+					Send("E01");
+					return true;
+				}
+				Poke(Physical((uint16_t)(a + i), true), (uint8_t)(hi << 4 | lo));
+			}
+			Send("OK");
+		}
+	}
+	else if (kind == 'c' || kind == 's') {
+		// A resume address would need a PC write, which tv80 can't take here
+		stepping = kind == 's';
+		running = true;
+		replyDue = true;
+		status = stepping ? "stepping" : "running";
+	}
+	else if ((kind == 'Z' || kind == 'z') && p.size() > 3 && (p[1] == '0' || p[1] == '1') && p[2] == ',') {
+		uint16_t a = (uint16_t)strtoul(p.c_str() + 3, NULL, 16);
+		if (kind == 'Z') { breakpoints.insert(a); }
+		else { breakpoints.erase(a); }
+		Send("OK");
+	}
+	else if (p.compare(0, 10, "qSupported") == 0) { Send("PacketSize=2000;QStartNoAckMode+"); }
+	else if (p == "QStartNoAckMode") {
+		Send("OK");
+		noAck = true;
+	}
+	else if (p == "qAttached") { Send("1"); }
+	else if (p == "qC") { Send("QC1"); }
+	else if (p == "qfThreadInfo") { Send("m1"); }
+	else if (p == "qsThreadInfo") { Send("l"); }
+	else if (kind == 'H') { Send("OK"); }
+	else if (kind == 'D') {
+		Send("OK");
+		Disconnect();
+	}
+	else if (kind == 'k') { Disconnect(); }
+	else { Send(""); }
+	return true;
+}
+
+#ifndef WIN32
+
+bool SimGdb::Open(std::string address) {
+	Close();
+	if (!signals || !Attach()) { return false; }
+	signal(SIGPIPE, SIG_IGN);
+
+	if (address.find('/') != std::string::npos) {
+		struct sockaddr_un a;
+		memset(&a, 0, sizeof(a));
+		a.sun_family = AF_UNIX;
+		if (address.size() >= sizeof(a.sun_path)) {
+			console.AddLog("[error] GDB: socket path too long: %s", address.c_str());
+			return false;
+		}
+		strcpy(a.sun_path, address.c_str());
+		unlink(address.c_str());
+		listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listenFd >= 0 && (bind(listenFd, (struct sockaddr*)&a, sizeof(a)) != 0 || listen(listenFd, 1) != 0)) {
+			close(listenFd);
+			listenFd = -1;
+		}
+	}
+	else {
+		// Local connections only: the stub can rewrite guest memory
+		struct sockaddr_in a;
+		memset(&a, 0, sizeof(a));
+		a.sin_family = AF_INET;
+		a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		a.sin_port = htons((uint16_t)atoi(address.c_str() + (address[0] == ':' ? 1 : 0)));
+		listenFd = socket(AF_INET, SOCK_STREAM, 0);
+		int on = 1;
+		if (listenFd >= 0) { setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)); }
+		if (listenFd >= 0 && (bind(listenFd, (struct sockaddr*)&a, sizeof(a)) != 0 || listen(listenFd, 1) != 0)) {
+			close(listenFd);
+			listenFd = -1;
+		}
+	}
+	if (listenFd < 0) {
+		console.AddLog("[error] GDB: cannot listen on %s", address.c_str());
+		return false;
+	}
+	status = "listening on " + address;
+	console.Log(LOG_INFO, LOG_SIM, "GDB: %s", status.c_str());
+	return true;
+}
+
+void SimGdb::Close() {
+	Disconnect();
+	if (listenFd >= 0) {
+		close(listenFd);
+		listenFd = -1;
+	}
+	status = "not listening";
+}
+
+void SimGdb::Accept() {
+	clientFd = accept(listenFd, NULL, NULL);
+	if (clientFd < 0) { return; }
+	int on = 1;
+	setsockopt(clientFd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+	input.clear();
+	deferred.clear();
+	lastPacket.clear();
+	noAck = false;
+	breakpoints.clear();
+	replyDue = false;
+	stepping = false;
+	stopDue = false;
+	// Stop at the next instruction so the first '?' has registers to show;
+	// the first fetch seen may be the second half of a prefixed opcode
+	breakIn = true;
+	running = true;
+	stopSignal = 5;
+	prefixPending = true;
+	lastPrefix = 0;
+	fetching = false;
+	lastRd = !rd_n->Read();
+	lastM1 = !m1_n->Read();
+	status = "debugger connected";
+	console.Log(LOG_INFO, LOG_SIM, "GDB: debugger connected");
+}
+
+void SimGdb::Disconnect() {
+	if (clientFd < 0) { return; }
+	close(clientFd);
+	clientFd = -1;
+	deferred.clear();
+	running = false;
+	stepping = false;
+	breakIn = false;
+	stopDue = false;
+	replyDue = false;
+	breakpoints.clear();
+	status = "listening";
+	console.Log(LOG_INFO, LOG_SIM, "GDB: debugger disconnected");
+}
+
+void SimGdb::Send(const std::string& packet) {
+	unsigned char sum = 0;
+	for (size_t i = 0; i < packet.size(); i++) { sum += (unsigned char)packet[i]; }
+	char tail[4];
+	snprintf(tail, sizeof(tail), "#%02x", sum);
+	lastPacket = "$" + packet + tail;
+	SendRaw(lastPacket);
+}
+
+void SimGdb::Poll(int timeoutMs) {
+	if (listenFd < 0) { return; }
+	// A packet that had to wait for the CPU to stop
+	if (!deferred.empty() && !running) {
+		Handle(deferred);
+		deferred.clear();
+		timeoutMs = 0;
+	}
+	struct pollfd p;
+	p.fd = clientFd >= 0 ? clientFd : listenFd;
+	p.events = POLLIN;
+	p.revents = 0;
+	if (poll(&p, 1, timeoutMs) <= 0) { return; }
+	if (clientFd < 0) {
+		Accept();
+		return;
+	}
+	char data[4096];
+	ssize_t got = read(clientFd, data, sizeof(data));
+	if (got <= 0) {
+		Disconnect();
+		return;
+	}
+	input.append(data, (size_t)got);
+
+	// Acks, breaks and whole packets. GDB sends one packet at a time and
+	// waits for its reply, so at most one is ever deferred.
+	while (!input.empty() && clientFd >= 0 && deferred.empty()) {
+		char c = input[0];
+		if (c == 0x03) {
+			if (running) { breakIn = true; }
+			input.erase(0, 1);
+			continue;
+		}
+		if (c == '-' && !noAck) {
+			input.erase(0, 1);
+			std::string resend = lastPacket;
+			SendRaw(resend);
+			continue;
+		}
+		if (c != '$') {
+			input.erase(0, 1);
+			continue;
+		}
+		size_t hash = input.find('#');
+		if (hash == std::string::npos || hash + 2 >= input.size()) { break; }
+		std::string packet = input.substr(1, hash - 1);
+		unsigned char sum = 0;
+		for (size_t i = 0; i < packet.size(); i++) { sum += (unsigned char)packet[i]; }
+		int expect = hex_digit(input[hash + 1]) << 4 | hex_digit(input[hash + 2]);
+		input.erase(0, hash + 3);
+		if (!noAck && sum != expect) {
+			SendRaw("-");
+			continue;
+		}
+		if (!noAck) { SendRaw("+"); }
+		if (clientFd >= 0 && !Handle(packet)) { deferred = packet; }
+	}
+}
+
+void SimGdb::SendRaw(const std::string& text) {
+	size_t done = 0;
+	while (clientFd >= 0 && done < text.size()) {
+		ssize_t n = write(clientFd, text.data() + done, text.size() - done);
+		if (n <= 0) {
+			Disconnect();
+			return;
+		}
+		done += (size_t)n;
+	}
+}
+
+#else
+
+bool SimGdb::Open(std::string address) {
+	console.AddLog("[error] GDB: not supported on Windows");
+	return false;
+}
+void SimGdb::Close() {}
+void SimGdb::Accept() {}
+void SimGdb::Disconnect() {}
+void SimGdb::Send(const std::string& packet) {}
+void SimGdb::SendRaw(const std::string& text) {}
+void SimGdb::Poll(int timeoutMs) {}
+
+#endif
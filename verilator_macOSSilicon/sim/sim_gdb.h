@@ -0,0 +1,132 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "sim_signals.h"
+#include "sim_sdram.h"
+#include "sim_z80.h"
+#include <string>
+#include <set>
+#include <stdint.h>
+
+// GDB remote serial protocol stub for the guest Z80
+//
+// Open() listens on a localhost TCP port ("1234" or ":1234") or, for
+// anything with a '/', a UNIX domain socket; one debugger at a time, e.g.
+//     (gdb) set architecture z80
+//     (gdb) target remote :1234
+//
+// The CPU stops only at instruction boundaries: Check() watches the tv80
+// bus for the opcode fetch that starts an instruction and, when a
+// breakpoint (Z0/Z1), a single step or a break from the debugger is due,
+// stops the sim when that fetch's M1 ends, once the previous instruction
+// has written back (tv80 is built without TV80_REFRESH, so there is no
+// rfsh_n to wait for). Registers are read from tv80 there and reported in
+// GDB's z80 order (af bc de hl sp pc ix iy af' bc' de' hl' ir); they are
+// read only. Without TV80_REFRESH the core has no R, so it reads as 0. Memory goes through the current Amstrad_MMU.v
+// mapping to the SDRAM: reads see ROM where the gate array enables it,
+// writes always land in RAM, as a Z80 write would. The opcode at the
+// stopped PC has already been fetched, so a write there takes effect the
+// next time it runs.
+//
+// The sim runs while the debugger has the target running: main calls
+// Poll() between batches and lets Check() end the batch. When a debugger
+// connects the CPU is stopped at the next instruction first.
+
+#define GDB_REGS 13
+
+struct SimGdb {
+public:
+	SimSignals* signals;
+	SimSDRAM* sdram;		// SDRAM=dpi build
+	uint8_t* ram;			// otherwise the 8MB array inside the model
+
+	bool running;			// the debugger wants the CPU to run
+	std::string status;
+
+	bool Check() {
+		if (!running || clientFd < 0) { return false; }
+		bool rd = !rd_n->Read();
+		bool m1 = !m1_n->Read();
+		bool m1End = !m1 && lastM1;
+		lastM1 = m1;
+		if (rd && !lastRd) {
+			bool fetch = m1 && !mreq_n->Read();
+			if (fetch && !prefixPending) { Started((uint16_t)addr->Read()); }
+			fetching = fetch;
+		}
+		if (!rd && lastRd) {
+			if (fetching) { prefixPending = sim_z80_prefix(lastPrefix, (uint8_t)di_reg->Read()); }
+			else {
+				prefixPending = false;
+				lastPrefix = 0;
+			}
+		}
+		lastRd = rd;
+		if (stopDue && m1End) {
+			Stopped();
+			return true;
+		}
+		return false;
+	}
+
+	bool Open(std::string address);
+	void Close();
+	bool IsOpen() { return listenFd >= 0; }
+	bool Connected() { return clientFd >= 0; }
+	// Handle what the debugger sent, waiting up to timeoutMs (-1 = forever)
+	void Poll(int timeoutMs);
+
+	SimGdb();
+	~SimGdb();
+
+private:
+	int listenFd;
+	int clientFd;
+	std::string input;
+	std::string deferred;		// needs the CPU stopped
+	std::string lastPacket;
+	bool noAck;
+
+	// Bus and core signals
+	const SimSignal* m1_n;
+	const SimSignal* mreq_n;
+	const SimSignal* rd_n;
+	const SimSignal* addr;
+	const SimSignal* di_reg;
+	const SimSignal* core[11];	// ACC F Ap Fp I SP R IntE_FF1 IntE_FF2 IStatus Alternate; R optional
+	const SimSignal* halt_ff;
+	const SimSignal* regsH;
+	const SimSignal* regsL;
+	const SimSignal* mmu[5];	// RAMmap RAMpage ROMbank lromen hromen
+
+	bool lastRd;
+	bool lastM1;
+	bool fetching;
+	bool prefixPending;
+	uint8_t lastPrefix;
+
+	std::set<uint16_t> breakpoints;
+	bool stepping;
+	bool breakIn;			// ^C from the debugger
+	bool stopDue;
+	bool replyDue;			// the debugger is waiting for a stop reply
+	int stopSignal;
+	uint16_t stopPc;
+	SimZ80_Regs regs;
+
+	bool Attach();
+	void Accept();
+	void Disconnect();
+	void Started(uint16_t pc);
+	void Stopped();
+	void Send(const std::string& packet);
+	void SendRaw(const std::string& text);
+	bool Handle(const std::string& packet);
+	std::string ReadRegisters();
+	void ReadRTL();
+	uint32_t Physical(uint16_t a, bool write);
+	uint8_t Peek(uint32_t a) { return sdram ? sdram->Read(a) : ram[a & 0x7FFFFF]; }
+	void Poke(uint32_t a, uint8_t d) {
+		if (sdram) { sdram->Write(a, d); }
+		else { ram[a & 0x7FFFFF] = d; }
+	}
+};
@@ -5,17 +5,17 @@
 
 #ifndef _MSC_VER
 #include <SDL2/SDL.h>
-int m_keyboardStateCount;
-const Uint8* m_keyboardState;
-Uint8* m_keyboardState_last = NULL;
+// The host keyboard is one per process; each SimInput keeps its own last state
+static int m_keyboardStateCount;
+static const Uint8* m_keyboardState;
 #else
 #define WIN32
 #include <dinput.h>
 //#define DIRECTINPUT_VERSION 0x0800
-IDirectInput8* m_directInput;
-IDirectInputDevice8* m_keyboard;
-unsigned char m_keyboardState[256];
-unsigned char m_keyboardState_last[256];
+static IDirectInput8* m_directInput;
+static IDirectInputDevice8* m_keyboard;
+static int m_keyboardStateCount = 256;
+static unsigned char m_keyboardState[256];
 #endif
 
 #include <vector>
@@ -521,7 +521,7 @@ static const int ev2ps2[] =
 };
 /* http://www-personal.umich.edu/~bazald/l/api/_s_d_l__scancode_8h.html */
 #endif
-bool ReadKeyboard()
+static bool ReadKeyboard()
 {
 #ifdef WIN32
 	HRESULT result;
@@ -536,7 +536,6 @@ bool ReadKeyboard()
 	}
 #else
 	m_keyboardState = SDL_GetKeyboardState(&m_keyboardStateCount);
-	if (!m_keyboardState_last) m_keyboardState_last = (Uint8*)calloc(m_keyboardStateCount, sizeof(Uint8));
 	////fprintf(stderr,"count: %d\n",m_keyboardStateCount);
 #endif
 
@@ -568,6 +567,7 @@ int SimInput::Initialise() {
 void SimInput::Read() {
 	// Read keyboard state
 	bool pr = ReadKeyboard();
+	if ((int)keyboardLast.size() < m_keyboardStateCount) { keyboardLast.resize(m_keyboardStateCount, 0); }
 
 	// Collect inputs
 	for (int i = 0; i < inputCount; i++) {
@@ -581,22 +581,22 @@ void SimInput::Read() {
 #ifdef WIN32
 	for (unsigned char k = 0; k < 220; k++) {
 
-		if (m_keyboardState_last[k] != m_keyboardState[k]) {
+		if (keyboardLast[k] != m_keyboardState[k]) {
 			unsigned int ext = ev2ps2[k] & EXT;
 			//fprintf(stderr, "ev2ps2[k] = %x  ext = %x  temp = %x\n", ev2ps2[k], ext, EXT | 0x6b);
 			SimInput_PS2KeyEvent evt = SimInput_PS2KeyEvent(k, m_keyboardState[k], ext, ev2ps2[k]);
 			keyEvents.push(evt);
 		}
-		m_keyboardState_last[k] = m_keyboardState[k];
+		keyboardLast[k] = m_keyboardState[k];
 	}
 #else
 	for (int k = 0; k < m_keyboardStateCount; k++) {
-		if (m_keyboardState_last[k] != m_keyboardState[k]) {
+		if (keyboardLast[k] != m_keyboardState[k]) {
 			bool ext = 0;
 			SimInput_PS2KeyEvent evt = SimInput_PS2KeyEvent(k, m_keyboardState[k], ext, ev2ps2[k]);
 			keyEvents.push(evt);
 		}
-		m_keyboardState_last[k] = m_keyboardState[k];
+		keyboardLast[k] = m_keyboardState[k];
 	}
 #endif
 
@@ -620,8 +620,121 @@ void SimInput::CleanUp() {
 #endif
 }
 
-unsigned int ps2_key_temp;
-bool ps2_clock = 1;
+// Autotype character map: PS/2 code as decoded by hid.sv, whether CPC shift
+// is needed, and the keyboard matrix row the key sits on
+struct SimInput_AutoTypeKey {
+	char c;
+	unsigned char code;
+	bool shift;
+	unsigned char row;
+};
+
+static const SimInput_AutoTypeKey autotype_keys[] =
+{
+	{ 'a', 0x1C, 0, 8 }, { 'b', 0x32, 0, 6 }, { 'c', 0x21, 0, 7 }, { 'd', 0x23, 0, 7 },
+	{ 'e', 0x24, 0, 7 }, { 'f', 0x2B, 0, 6 }, { 'g', 0x34, 0, 6 }, { 'h', 0x33, 0, 5 },
+	{ 'i', 0x43, 0, 4 }, { 'j', 0x3B, 0, 5 }, { 'k', 0x42, 0, 4 }, { 'l', 0x4B, 0, 4 },
+	{ 'm', 0x3A, 0, 4 }, { 'n', 0x31, 0, 5 }, { 'o', 0x44, 0, 4 }, { 'p', 0x4D, 0, 3 },
+	{ 'q', 0x15, 0, 8 }, { 'r', 0x2D, 0, 6 }, { 's', 0x1B, 0, 7 }, { 't', 0x2C, 0, 6 },
+	{ 'u', 0x3C, 0, 5 }, { 'v', 0x2A, 0, 6 }, { 'w', 0x1D, 0, 7 }, { 'x', 0x22, 0, 7 },
+	{ 'y', 0x35, 0, 5 }, { 'z', 0x1A, 0, 8 },
+	{ '0', 0x45, 0, 4 }, { '1', 0x16, 0, 8 }, { '2', 0x1E, 0, 8 }, { '3', 0x26, 0, 7 },
+	{ '4', 0x25, 0, 7 }, { '5', 0x2E, 0, 6 }, { '6', 0x36, 0, 6 }, { '7', 0x3D, 0, 5 },
+	{ '8', 0x3E, 0, 5 }, { '9', 0x46, 0, 4 },
+	{ '_', 0x45, 1, 4 }, { '!', 0x16, 1, 8 }, { '"', 0x1E, 1, 8 }, { '#', 0x26, 1, 7 },
+	{ '$', 0x25, 1, 7 }, { '%', 0x2E, 1, 6 }, { '&', 0x36, 1, 6 }, { '\'', 0x3D, 1, 5 },
+	{ '(', 0x3E, 1, 5 }, { ')', 0x46, 1, 4 },
+	{ ' ', 0x29, 0, 5 }, { '\n', 0x5A, 0, 2 },
+	{ '-', 0x4E, 0, 3 }, { '=', 0x4E, 1, 3 }, { '^', 0x55, 0, 3 }, { '@', 0x54, 0, 3 },
+	{ '|', 0x54, 1, 3 }, { ':', 0x4C, 0, 3 }, { '*', 0x4C, 1, 3 }, { ';', 0x52, 0, 3 },
+	{ '+', 0x52, 1, 3 }, { ',', 0x41, 0, 4 }, { '<', 0x41, 1, 4 }, { '.', 0x49, 0, 3 },
+	{ '>', 0x49, 1, 3 }, { '/', 0x4A, 0, 3 }, { '?', 0x4A, 1, 3 }, { '[', 0x5B, 0, 2 },
+	{ '{', 0x5B, 1, 2 }, { ']', 0x5D, 0, 2 }, { '}', 0x5D, 1, 2 }, { '\\', 0x61, 0, 2 },
+	{ '`', 0x61, 1, 2 },
+};
+static const unsigned char autotype_shift = 0x12;
+
+static const SimInput_AutoTypeKey* autotype_find(char c, bool& shift) {
+	shift = (c >= 'A' && c <= 'Z');
+	if (shift) { c = c - 'A' + 'a'; }
+	for (size_t i = 0; i < sizeof(autotype_keys) / sizeof(autotype_keys[0]); i++) {
+		if (autotype_keys[i].c == c) {
+			shift |= autotype_keys[i].shift;
+			return &autotype_keys[i];
+		}
+	}
+	return NULL;
+}
+
+void SimInput::SendPS2(unsigned int code, bool pressed)
+{
+	unsigned int word = code;
+	if (pressed) { word |= (1UL << 9); }
+	autotypeWords.push(word);
+}
+
+void SimInput::AutoType(std::string text)
+{
+	autotypeText += text;
+}
+
+// Autotype states
+#define AUTOTYPE_IDLE    0
+#define AUTOTYPE_HOLD    1
+#define AUTOTYPE_RELEASE 2
+
+void SimInput::AutoTypeStep()
+{
+	// Flush queued PS/2 words a few clocks apart so hid.sv sees every toggle
+	if (autotypeDelay) { autotypeDelay--; }
+	else if (!autotypeWords.empty()) {
+		ps2_key_temp = autotypeWords.front();
+		autotypeWords.pop();
+		if (ps2_clock) { ps2_key_temp |= (1UL << 10); }
+		ps2_clock = !ps2_clock;
+		*ps2_key = ps2_key_temp;
+		Log('k', ps2_key_temp);
+		autotypeDelay = 4;
+	}
+
+	// Count firmware scans of the row we care about: the row is selected with
+	// the PSG in read mode (BDIR=0, BC1=1) while port A is read
+	bool scanning = kbd_row && ((*kbd_row & 0xCF) == (0x40 | autotypeRow));
+	if (scanning && !autotypeScanning && autotypeWords.empty()) { autotypeCount++; }
+	autotypeScanning = scanning;
+
+	switch (autotypeState) {
+	case AUTOTYPE_IDLE: {
+		if (autotypePos >= autotypeText.size()) {
+			autotypeText.clear();
+			autotypePos = 0;
+			break;
+		}
+		bool shift;
+		const SimInput_AutoTypeKey* key = autotype_find(autotypeText[autotypePos++], shift);
+		if (!key) { break; }
+		if (shift) { SendPS2(autotype_shift, true); }
+		SendPS2(key->code, true);
+		autotypeRow = key->row;
+		autotypeCount = 0;
+		autotypeState = AUTOTYPE_HOLD;
+		break;
+	}
+	case AUTOTYPE_HOLD:
+		if (autotypeCount >= autotypeScans) {
+			bool shift;
+			const SimInput_AutoTypeKey* key = autotype_find(autotypeText[autotypePos - 1], shift);
+			SendPS2(key->code, false);
+			if (shift) { SendPS2(autotype_shift, false); }
+			autotypeCount = 0;
+			autotypeState = AUTOTYPE_RELEASE;
+		}
+		break;
+	case AUTOTYPE_RELEASE:
+		if (autotypeCount >= autotypeScans) { autotypeState = AUTOTYPE_IDLE; }
+		break;
+	}
+}
 
 
 void SimInput::BeforeEval()
@@ -629,6 +742,23 @@ void SimInput::BeforeEval()
 	if (ps2_key == NULL) {
 		return;
 	}
+	if (playing) {
+		// Replay everything due by now, live input is ignored
+		while (playbackPos < playback.size() && playback[playbackPos].time <= *time) {
+			SimInput_LogEvent& evt = playback[playbackPos++];
+			if (evt.type == 'k') { *ps2_key = evt.value; }
+			if (evt.type == 'j' && joystick) { *joystick = evt.value; }
+		}
+		if (playbackPos == playback.size()) {
+			console.AddLog("Input playback complete");
+			StopPlayback();
+		}
+		return;
+	}
+	if (IsTyping() || !autotypeWords.empty()) {
+		AutoTypeStep();
+		return;
+	}
 	if (keyEventTimer == 0) {
 
 		if (keyEvents.size() > 0) {
@@ -641,6 +771,7 @@ void SimInput::BeforeEval()
 			if (ps2_clock) { ps2_key_temp |= (1UL << 10); }
 			ps2_clock = !ps2_clock;
 			*ps2_key = ps2_key_temp;
+			Log('k', ps2_key_temp);
 			keyEventTimer = keyEventWait;
 		}
 	}
@@ -649,6 +780,68 @@ void SimInput::BeforeEval()
 	}
 }
 
+void SimInput::Log(char type, unsigned int value) {
+	if (recordFile && time) {
+		fprintf(recordFile, "%llu %c 0x%x\n", (unsigned long long)*time, type, value);
+	}
+}
+
+// Live joystick state from the GUI; ignored while a log is playing
+void SimInput::SetJoystick(unsigned int mask) {
+	if (playing || !joystick) { return; }
+	*joystick = mask;
+	if (mask != lastJoystick) { Log('j', mask); }
+	lastJoystick = mask;
+}
+
+bool SimInput::StartRecording(std::string file) {
+	StopRecording();
+	recordFile = fopen(file.c_str(), "w");
+	if (!recordFile) {
+		console.AddLog("[error] Cannot open input log %s", file.c_str());
+		return false;
+	}
+	fprintf(recordFile, "# amstrad input log v1\n");
+	// Start from the current joystick state so playback matches
+	Log('j', lastJoystick);
+	return true;
+}
+
+void SimInput::StopRecording() {
+	if (recordFile) { fclose(recordFile); }
+	recordFile = NULL;
+}
+
+bool SimInput::StartPlayback(std::string file) {
+	FILE* f = fopen(file.c_str(), "r");
+	if (!f) {
+		console.AddLog("[error] Cannot open input log %s", file.c_str());
+		return false;
+	}
+	playback.clear();
+	char line[128];
+	while (fgets(line, sizeof(line), f)) {
+		SimInput_LogEvent evt;
+		unsigned long long t;
+		if (line[0] == '#') { continue; }
+		if (sscanf(line, "%llu %c %i", &t, &evt.type, (int*)&evt.value) != 3) { continue; }
+		evt.time = t;
+		playback.push_back(evt);
+	}
+	fclose(f);
+	// Drop anything queued from the keyboard so it can't leak into the run
+	while (!keyEvents.empty()) { keyEvents.pop(); }
+	playbackPos = 0;
+	playing = playback.size() > 0;
+	return true;
+}
+
+void SimInput::StopPlayback() {
+	playing = false;
+	playback.clear();
+	playbackPos = 0;
+}
+
 SimInput::SimInput(int count)
 {
 	inputCount = count;
@@ -665,6 +858,7 @@ SimInput::SimInput(int count, DebugConsole c)
 
 SimInput::~SimInput()
 {
+	StopRecording();
 
 }
 
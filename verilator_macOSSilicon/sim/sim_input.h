@@ -8,6 +8,8 @@
 #include "verilated_heavy.h"
 #include <queue>
 #include <vector>
+#include <string>
+#include <stdio.h>
 
 
 struct SimInput_PS2KeyEvent {
@@ -25,6 +27,16 @@ public:
 	}
 };
 
+// One entry of a cycle-stamped input log. Text format, one per line:
+//   <main_time> k <ps2_key word>     value written to the ps2_key port
+//   <main_time> j <input mask>       value written to the joystick inputs
+struct SimInput_LogEvent {
+public:
+	vluint64_t time;
+	char type;
+	unsigned int value;
+};
+
 struct SimInput {
 public:
 
@@ -37,6 +49,25 @@ public:
 	unsigned int keyEventTimer = 0;
 	unsigned int keyEventWait = 50000;
 
+	// Input logs: events are stamped with *time when they reach the model
+	vluint64_t* time = NULL;
+	CData* joystick = NULL;
+	bool StartRecording(std::string file);
+	void StopRecording();
+	bool StartPlayback(std::string file);
+	void StopPlayback();
+	bool IsRecording() { return recordFile != NULL; }
+	bool IsPlaying() { return playing; }
+	void SetJoystick(unsigned int mask);
+
+	// Autotype: each character is held until the firmware has scanned its
+	// keyboard row autotypeScans times, then released for as many scans.
+	// kbd_row is the PPI port C output (row select in bits 3:0).
+	CData* kbd_row = NULL;
+	int autotypeScans = 2;
+	void AutoType(std::string text);
+	bool IsTyping() { return autotypePos < autotypeText.size() || autotypeState != 0; }
+
 #define NONE         0xFF
 #define LCTRL        0x000100
 #define LSHIFT       0x000200
@@ -63,4 +94,28 @@ public:
 	SimInput(int count);
 	/*SimInput(int count, DebugConsole c);*/
 	~SimInput();
+
+private:
+	FILE* recordFile = NULL;
+	bool playing = false;
+	std::vector<SimInput_LogEvent> playback;
+	size_t playbackPos = 0;
+	unsigned int lastJoystick = 0;
+	void Log(char type, unsigned int value);
+
+	// Last PS/2 word sent; bit 10 toggles with every word
+	unsigned int ps2_key_temp = 0;
+	bool ps2_clock = 1;
+	std::vector<unsigned char> keyboardLast;	// host keyboard as of the last Read()
+
+	std::string autotypeText;
+	size_t autotypePos = 0;
+	int autotypeState = 0;
+	int autotypeRow = 0;
+	int autotypeCount = 0;
+	bool autotypeScanning = false;
+	std::queue<unsigned int> autotypeWords;
+	unsigned int autotypeDelay = 0;
+	void SendPS2(unsigned int code, bool pressed);
+	void AutoTypeStep();
 };
@@ -0,0 +1,386 @@
+#include "sim_lockstep.h"
+#include "sim_console.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+static DebugConsole console;
+
+static const char* cpu_scope = "motherboard.CPU.";
+static const char* core_scope = "motherboard.CPU.i_tv80_core.";
+static const char* core_names[] = { "ACC", "F", "Ap", "Fp", "I", "SP", "PC", "IntE_FF1", "IntE_FF2", "IStatus", "Alternate" };
+static const char* kind_names[] = { "fetch", "read", "write", "in", "out", "int ack", "nmi fetch" };
+
+SimLockstep::SimLockstep() {
+	signals = NULL;
+	time = NULL;
+	enabled = false;
+	compareRegs = true;
+	flagMask = (uint8_t)~(Z80_FLAG_X | Z80_FLAG_Y);
+	instructions = 0;
+	diverged = false;
+	z80.bus = this;
+	lastRd = lastWr = lastAck = lastM1 = false;
+	writeMreq = false;
+	prefixPending = false;
+	lastPrefix = 0;
+	cursor = 0;
+	starved = false;
+	syncing = false;
+	compareDue = false;
+	adoptA = false;
+	historyHead = 0;
+}
+
+bool SimLockstep::Enable() {
+	struct { const SimSignal** signal; const char* scope; const char* name; } wanted[] = {
+		{ &mreq_n, cpu_scope, "mreq_n_reg" }, { &iorq_n, cpu_scope, "iorq_n_reg" },
+		{ &rd_n, cpu_scope, "rd_n_reg" }, { &wr_n, cpu_scope, "wr_n_reg" }, { &di_reg, cpu_scope, "di_reg" },
+		{ &m1_n, core_scope, "m1_n" },
+		{ &addr, core_scope, "A" }, { &dout, core_scope, "dout" },
+		{ &regsH, "motherboard.CPU.i_tv80_core.i_reg.", "RegsH" }, { &regsL, "motherboard.CPU.i_tv80_core.i_reg.", "RegsL" },
+	};
+	for (size_t i = 0; i < sizeof(wanted) / sizeof(wanted[0]); i++) {
+		*wanted[i].signal = signals->Get(std::string(wanted[i].scope) + wanted[i].name);
+		if (!*wanted[i].signal) {
+			console.AddLog("[error] Lockstep: %s%s is not public in this model", wanted[i].scope, wanted[i].name);
+			return false;
+		}
+	}
+	for (int i = 0; i < 11; i++) {
+		core[i] = signals->Get(std::string(core_scope) + core_names[i]);
+		if (!core[i]) {
+			console.AddLog("[error] Lockstep: %s%s is not public in this model", core_scope, core_names[i]);
+			return false;
+		}
+	}
+	// Optional: without these NMIs and HALT show up as divergences
+	nmi_cycle = signals->Get(std::string(core_scope) + "NMICycle");
+	halt_ff = signals->Get(std::string(core_scope) + "Halt_FF");
+
+	// A cycle already under way has no start, so pick up from the next one
+	lastRd = false;
+	lastWr = false;
+	lastAck = false;
+	lastM1 = false;
+	enabled = true;
+	instructions = 0;
+	Resync();
+	return true;
+}
+
+void SimLockstep::Disable() {
+	enabled = false;
+	cycles.clear();
+}
+
+// Start again from the RTL registers at the next instruction boundary
+void SimLockstep::Resync() {
+	diverged = false;
+	syncing = true;
+	compareDue = false;
+	adoptA = false;
+	prefixPending = false;
+	lastPrefix = 0;
+	cycles.clear();
+	report.clear();
+}
+
+void SimLockstep::Begin(bool m1, bool mreq) {
+	pending.addr = (uint16_t)addr->Read();
+	if (m1 && !mreq) { pending.kind = LOCKSTEP_INTACK; }
+	else if (m1) { pending.kind = (nmi_cycle && nmi_cycle->Read()) ? LOCKSTEP_NMI : LOCKSTEP_FETCH; }
+	else { pending.kind = mreq ? LOCKSTEP_READ : LOCKSTEP_IN; }
+}
+
+void SimLockstep::Complete() {
+	pending.data = (uint8_t)di_reg->Read();
+	bool start = true;
+	if (pending.kind == LOCKSTEP_FETCH) {
+		start = !prefixPending;
+		prefixPending = sim_z80_prefix(lastPrefix, pending.data);
+	}
+	else {
+		start = pending.kind != LOCKSTEP_READ && pending.kind != LOCKSTEP_IN;
+		prefixPending = false;
+		lastPrefix = 0;
+	}
+
+	if (syncing) {
+		// Only keep cycles from the first opcode fetch that starts an instruction
+		if (!start || pending.kind != LOCKSTEP_FETCH) { return; }
+		cycles.clear();
+		cycles.push_back(pending);
+		return;
+	}
+	cycles.push_back(pending);
+	if (start) { Advance(); }
+}
+
+void SimLockstep::Written(bool mreq) {
+	if (syncing && cycles.empty()) { return; }
+	SimLockstep_Cycle c;
+	c.kind = mreq ? LOCKSTEP_WRITE : LOCKSTEP_OUT;
+	c.addr = (uint16_t)addr->Read();
+	c.data = (uint8_t)dout->Read();
+	cycles.push_back(c);
+	prefixPending = false;
+	lastPrefix = 0;
+}
+
+void SimLockstep::EndM1() {
+	if (syncing) {
+		if (cycles.size() != 1) { return; }
+		ReadRTL(z80.regs);
+		z80.regs.pc = cycles[0].addr;
+		syncing = false;
+		console.Log(LOG_INFO, LOG_SIM, "Lockstep synced at PC %04X", z80.regs.pc);
+		return;
+	}
+	if (compareDue) {
+		compareDue = false;
+		CompareRegs();
+	}
+}
+
+void SimLockstep::Advance() {
+	while (!diverged && TryStep()) {}
+}
+
+// Run the reference over the oldest complete instruction in the list
+bool SimLockstep::TryStep() {
+	if (cycles.empty()) { return false; }
+	SimZ80_Regs saved = z80.regs;
+	SimLockstep_Cycle first = cycles[0];
+	cursor = 0;
+	starved = false;
+
+	switch (first.kind) {
+	case LOCKSTEP_FETCH:
+		z80.Step();
+		break;
+	case LOCKSTEP_INTACK:
+		cursor = 1;
+		z80.Interrupt(first.data);
+		break;
+	case LOCKSTEP_NMI:
+		cursor = 1;
+		z80.Nmi();
+		break;
+	default:
+		Diverge("RTL %s %04X outside any instruction", kind_names[first.kind], first.addr);
+		return false;
+	}
+	if (diverged) { return false; }
+
+	// Not all of it on the bus yet, try again at the next opcode fetch
+	if (starved || cursor >= cycles.size()) {
+		z80.regs = saved;
+		return false;
+	}
+	const SimLockstep_Cycle& next = cycles[cursor];
+	if (next.kind != LOCKSTEP_FETCH && next.kind != LOCKSTEP_INTACK && next.kind != LOCKSTEP_NMI) {
+		Diverge("RTL made an extra %s cycle at %04X", kind_names[next.kind], next.addr);
+		return false;
+	}
+
+	SimLockstep_Instr& h = history[historyHead++ % LOCKSTEP_HISTORY];
+	h.pc = first.addr;
+	h.length = 0;
+	h.time = time ? *time : 0;
+	for (size_t i = 0; i < cursor && h.length < 4; i++) {
+		const SimLockstep_Cycle& c = cycles[i];
+		if ((c.kind == LOCKSTEP_FETCH || c.kind == LOCKSTEP_READ) && (uint16_t)(c.addr - h.pc) < 4) { h.bytes[h.length++] = c.data; }
+	}
+	adoptA = h.length >= 2 && h.bytes[0] == 0xED && h.bytes[1] == 0x5F;
+
+	cycles.erase(cycles.begin(), cycles.begin() + cursor);
+	instructions++;
+	// Registers can only be compared if the RTL is still at the start of the next instruction
+	compareDue = compareRegs && cycles.size() == 1;
+	return true;
+}
+
+// Next recorded cycle, which must match what the reference wants to do
+const SimLockstep_Cycle* SimLockstep::Next(uint8_t kind, uint16_t a) {
+	if (starved || diverged) { return NULL; }
+	if (cursor >= cycles.size()) {
+		starved = true;
+		return NULL;
+	}
+	const SimLockstep_Cycle& c = cycles[cursor];
+	bool any_addr = kind == LOCKSTEP_FETCH && z80.regs.halted;
+	if (c.kind != kind || (c.addr != a && !any_addr)) {
+		Diverge("reference %s %04X, RTL %s %04X", kind_names[kind], a, kind_names[c.kind], c.addr);
+		return NULL;
+	}
+	cursor++;
+	return &c;
+}
+
+uint8_t SimLockstep::Fetch(uint16_t a) {
+	const SimLockstep_Cycle* c = Next(LOCKSTEP_FETCH, a);
+	return c ? c->data : 0x00;
+}
+
+uint8_t SimLockstep::Read(uint16_t a) {
+	const SimLockstep_Cycle* c = Next(LOCKSTEP_READ, a);
+	return c ? c->data : 0xFF;
+}
+
+void SimLockstep::Write(uint16_t a, uint8_t data) {
+	const SimLockstep_Cycle* c = Next(LOCKSTEP_WRITE, a);
+	if (c && c->data != data) {
+		cursor--;
+		Diverge("write %04X: reference %02X, RTL %02X", a, data, c->data);
+	}
+}
+
+uint8_t SimLockstep::In(uint16_t port) {
+	const SimLockstep_Cycle* c = Next(LOCKSTEP_IN, port);
+	return c ? c->data : 0xFF;
+}
+
+void SimLockstep::Out(uint16_t port, uint8_t data) {
+	const SimLockstep_Cycle* c = Next(LOCKSTEP_OUT, port);
+	if (c && c->data != data) {
+		cursor--;
+		Diverge("out %04X: reference %02X, RTL %02X", port, data, c->data);
+	}
+}
+
+void SimLockstep::ReadRTL(SimZ80_Regs& r) {
+	r.a = (uint8_t)core[0]->Read();
+	r.f = (uint8_t)core[1]->Read();
+	r.a_ = (uint8_t)core[2]->Read();
+	r.f_ = (uint8_t)core[3]->Read();
+	r.i = (uint8_t)core[4]->Read();
+	r.sp = (uint16_t)core[5]->Read();
+	r.pc = (uint16_t)core[6]->Read();
+	r.iff1 = (uint8_t)core[7]->Read();
+	r.iff2 = (uint8_t)core[8]->Read();
+	r.im = (uint8_t)core[9]->Read();
+	r.r = 0;
+	r.halted = halt_ff && halt_ff->Read();
+
+	// Register file: BC DE HL at 0-2 (4-6 while Alternate), IX at 3, IY at 7
+	int bank = core[10]->Read() ? 4 : 0;
+	int alt = 4 - bank;
+	r.b = (uint8_t)regsH->Read(bank); r.c = (uint8_t)regsL->Read(bank);
+	r.d = (uint8_t)regsH->Read(bank + 1); r.e = (uint8_t)regsL->Read(bank + 1);
+	r.h = (uint8_t)regsH->Read(bank + 2); r.l = (uint8_t)regsL->Read(bank + 2);
+	r.b_ = (uint8_t)regsH->Read(alt); r.c_ = (uint8_t)regsL->Read(alt);
+	r.d_ = (uint8_t)regsH->Read(alt + 1); r.e_ = (uint8_t)regsL->Read(alt + 1);
+	r.h_ = (uint8_t)regsH->Read(alt + 2); r.l_ = (uint8_t)regsL->Read(alt + 2);
+	r.ixh = (uint8_t)regsH->Read(3); r.ixl = (uint8_t)regsL->Read(3);
+	r.iyh = (uint8_t)regsH->Read(7); r.iyl = (uint8_t)regsL->Read(7);
+}
+
+void SimLockstep::CompareRegs() {
+	SimZ80_Regs rtl;
+	ReadRTL(rtl);
+	SimZ80_Regs& ref = z80.regs;
+	if (adoptA) {
+		// LD A,R: the RTL is built without an R register
+		ref.a = rtl.a;
+		ref.f = rtl.f;
+		adoptA = false;
+	}
+	struct { const char* name; int ref; int rtl; } regs[] = {
+		{ "A", ref.a, rtl.a }, { "F", ref.f & flagMask, rtl.f & flagMask },
+		{ "B", ref.b, rtl.b }, { "C", ref.c, rtl.c }, { "D", ref.d, rtl.d }, { "E", ref.e, rtl.e },
+		{ "H", ref.h, rtl.h }, { "L", ref.l, rtl.l },
+		{ "A'", ref.a_, rtl.a_ }, { "F'", ref.f_ & flagMask, rtl.f_ & flagMask },
+		{ "B'", ref.b_, rtl.b_ }, { "C'", ref.c_, rtl.c_ }, { "D'", ref.d_, rtl.d_ }, { "E'", ref.e_, rtl.e_ },
+		{ "H'", ref.h_, rtl.h_ }, { "L'", ref.l_, rtl.l_ },
+		{ "IXH", ref.ixh, rtl.ixh }, { "IXL", ref.ixl, rtl.ixl }, { "IYH", ref.iyh, rtl.iyh }, { "IYL", ref.iyl, rtl.iyl },
+		{ "SP", ref.sp, rtl.sp }, { "I", ref.i, rtl.i },
+		{ "IFF1", ref.iff1, rtl.iff1 }, { "IFF2", ref.iff2, rtl.iff2 }, { "IM", ref.im, rtl.im },
+	};
+	for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+		if (regs[i].ref != regs[i].rtl) {
+			Diverge("%s: reference %02X, RTL %02X", regs[i].name, regs[i].ref, regs[i].rtl);
+			return;
+		}
+	}
+}
+
+static void append_regs(std::string& out, const char* label, const SimZ80_Regs& r) {
+	char line[200];
+	snprintf(line, sizeof(line), "%-4s AF %02X%02X BC %02X%02X DE %02X%02X HL %02X%02X IX %02X%02X IY %02X%02X SP %04X I %02X IFF %d%d IM %d\n"
+		"     AF'%02X%02X BC'%02X%02X DE'%02X%02X HL'%02X%02X\n",
+		label, r.a, r.f, r.b, r.c, r.d, r.e, r.h, r.l, r.ixh, r.ixl, r.iyh, r.iyl, r.sp, r.i, r.iff1, r.iff2, r.im,
+		r.a_, r.f_, r.b_, r.c_, r.d_, r.e_, r.h_, r.l_);
+	out += line;
+}
+
+// Stop at the first difference, keeping the recent instructions and both register sets
+void SimLockstep::Diverge(const char* fmt, ...) {
+	if (diverged) { return; }
+	diverged = true;
+	compareDue = false;
+
+	char message[200];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(message, sizeof(message), fmt, args);
+	va_end(args);
+
+	char line[200];
+	SimZ80_Regs rtl;
+	ReadRTL(rtl);
+	uint16_t pc = cycles.empty() ? z80.regs.pc : cycles[0].addr;
+	snprintf(line, sizeof(line), "Lockstep divergence at %llu after %llu instructions, instruction at %04X: %s\n",
+		(unsigned long long)(time ? *time : 0), (unsigned long long)instructions, pc, message);
+	report = line;
+	append_regs(report, "ref", z80.regs);
+	append_regs(report, "rtl", rtl);
+	report += "Last instructions:\n";
+	int count = historyHead < LOCKSTEP_HISTORY ? historyHead : LOCKSTEP_HISTORY;
+	for (int i = historyHead - count; i < historyHead; i++) {
+		const SimLockstep_Instr& h = history[i % LOCKSTEP_HISTORY];
+		int n = snprintf(line, sizeof(line), "  %12llu  %04X ", (unsigned long long)h.time, h.pc);
+		for (int b = 0; b < h.length; b++) { n += snprintf(line + n, sizeof(line) - n, " %02X", h.bytes[b]); }
+		report += line;
+		report += "\n";
+	}
+	report += "Pending bus cycles:\n";
+	for (size_t i = 0; i < cycles.size() && i < 16; i++) {
+		snprintf(line, sizeof(line), "  %-9s %04X %02X%s\n", kind_names[cycles[i].kind], cycles[i].addr, cycles[i].data, i == cursor ? "  <" : "");
+		report += line;
+	}
+	console.Log(LOG_ERROR, LOG_SIM, "Lockstep: %s at PC %04X", message, pc);
+}
+
+void SimLockstep::Draw(const char* title, bool* p_open, ImVec2 size) {
+	ImGui::SetNextWindowSize(size, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin(title, p_open)) {
+		ImGui::End();
+		return;
+	}
+	bool on = enabled;
+	if (ImGui::Checkbox("Lockstep with reference Z80", &on)) {
+		if (on) { Enable(); }
+		else { Disable(); }
+	}
+	ImGui::SameLine();
+	ImGui::Checkbox("Registers", &compareRegs);
+	ImGui::SameLine();
+	bool xy = (flagMask & (Z80_FLAG_X | Z80_FLAG_Y)) != 0;
+	if (ImGui::Checkbox("X/Y flags", &xy)) {
+		flagMask = xy ? 0xFF : (uint8_t)~(Z80_FLAG_X | Z80_FLAG_Y);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Resync") && enabled) { Resync(); }
+
+	if (!enabled) { ImGui::TextDisabled("off"); }
+	else if (diverged) { ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "diverged after %llu instructions", (unsigned long long)instructions); }
+	else if (syncing) { ImGui::Text("waiting for an instruction boundary"); }
+	else { ImGui::Text("%llu instructions match, PC %04X", (unsigned long long)instructions, z80.regs.pc); }
+
+	if (!report.empty()) {
+		ImGui::BeginChild("report", ImVec2(0, 0), true, ImGuiWindowFlags_HorizontalScrollbar);
+		ImGui::TextUnformatted(report.c_str());
+		ImGui::EndChild();
+	}
+	ImGui::End();
+}
@@ -0,0 +1,146 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "imgui.h"
+#include "sim_signals.h"
+#include "sim_z80.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// Lockstep check of the tv80 RTL CPU against the SimZ80 reference
+//
+// Check() runs on every rising edge and turns the CPU bus into a list of
+// completed cycles: opcode fetches, memory and port reads with the data the
+// CPU latched, writes with the data it drove, and interrupt acknowledges.
+// Each time a new instruction starts, the reference runs the previous one
+// with its reads served from that list and every access compared against
+// it in order, so a wrong address, wrong write data, or a missing or extra
+// bus cycle is caught on the instruction that caused it. The registers are
+// compared when M1 of the following opcode fetch ends, once the RTL has
+// finished writing back. That is where a Z80 starts refresh, but tv80 is
+// built without TV80_REFRESH and never drives rfsh_n.
+//
+// The reference starts from the RTL registers at the first instruction
+// boundary after Enable(), and can be resynced the same way after a
+// divergence. All signals are found by name, so a model without a public
+// tv80 ("make hier") just reports that lockstep is unavailable.
+
+#define LOCKSTEP_FETCH  0
+#define LOCKSTEP_READ   1
+#define LOCKSTEP_WRITE  2
+#define LOCKSTEP_IN     3
+#define LOCKSTEP_OUT    4
+#define LOCKSTEP_INTACK 5
+#define LOCKSTEP_NMI    6	// opcode fetch of an NMI response
+
+#define LOCKSTEP_HISTORY 16
+
+struct SimLockstep_Cycle {
+public:
+	uint8_t kind;
+	uint8_t data;
+	uint16_t addr;
+};
+
+struct SimLockstep_Instr {
+public:
+	uint16_t pc;
+	uint8_t bytes[4];
+	int length;
+	vluint64_t time;
+};
+
+struct SimLockstep : public SimZ80_Bus {
+public:
+	SimSignals* signals;
+	vluint64_t* time;
+
+	bool enabled;
+	bool compareRegs;
+	uint8_t flagMask;		// F bits compared, X/Y left out by default
+	vluint64_t instructions;
+	bool diverged;
+	std::string report;
+
+	bool Check() {
+		if (!enabled || diverged) { return false; }
+		bool rd = !rd_n->Read();
+		bool wr = !wr_n->Read();
+		bool m1 = !m1_n->Read();
+		bool iorq = !iorq_n->Read();
+		if (rd && !lastRd) { Begin(m1, !mreq_n->Read()); }
+		if (!rd && lastRd) { Complete(); }
+		if (wr && !lastWr) { writeMreq = !mreq_n->Read(); }
+		if (!wr && lastWr) { Written(writeMreq); }
+		if (m1 && iorq && !lastAck) { Begin(true, false); }
+		if (!(m1 && iorq) && lastAck) { Complete(); }
+		if (!m1 && lastM1) { EndM1(); }
+		lastRd = rd;
+		lastWr = wr;
+		lastAck = m1 && iorq;
+		lastM1 = m1;
+		return diverged;
+	}
+
+	bool Enable();
+	void Disable();
+	void Resync();
+	void Draw(const char* title, bool* p_open, ImVec2 size);
+
+	// SimZ80_Bus, fed from the recorded cycles
+	uint8_t Fetch(uint16_t addr);
+	uint8_t Read(uint16_t addr);
+	void Write(uint16_t addr, uint8_t data);
+	uint8_t In(uint16_t port);
+	void Out(uint16_t port, uint8_t data);
+
+	SimLockstep();
+
+private:
+	SimZ80 z80;
+
+	// Bus and core signals
+	const SimSignal* m1_n;
+	const SimSignal* mreq_n;
+	const SimSignal* iorq_n;
+	const SimSignal* rd_n;
+	const SimSignal* wr_n;
+	const SimSignal* addr;
+	const SimSignal* dout;
+	const SimSignal* di_reg;
+	const SimSignal* nmi_cycle;
+	const SimSignal* halt_ff;
+	const SimSignal* core[11];	// ACC F Ap Fp I SP PC IntE_FF1 IntE_FF2 IStatus Alternate
+	const SimSignal* regsH;
+	const SimSignal* regsL;
+
+	bool lastRd;
+	bool lastWr;
+	bool lastAck;
+	bool lastM1;
+	bool writeMreq;
+	SimLockstep_Cycle pending;
+	bool prefixPending;		// the last fetch was a prefix, so the next one is not an instruction start
+	uint8_t lastPrefix;
+
+	std::vector<SimLockstep_Cycle> cycles;
+	size_t cursor;
+	bool starved;
+	bool syncing;
+	bool compareDue;
+	bool adoptA;			// LD A,R: the RTL has no R register
+
+	SimLockstep_Instr history[LOCKSTEP_HISTORY];
+	int historyHead;
+
+	void Begin(bool m1, bool mreq);
+	void Complete();
+	void Written(bool mreq);
+	void EndM1();
+	void Advance();
+	bool TryStep();
+	const SimLockstep_Cycle* Next(uint8_t kind, uint16_t addr);
+	void ReadRTL(SimZ80_Regs& r);
+	void CompareRegs();
+	void Diverge(const char* fmt, ...);
+};
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+// Amstrad_MMU.v address mapping, for host code that reads guest memory
+//
+// Z80 address a to the SDRAM address the RTL uses: ROM reads go to the
+// lower ROM at 0 or the selected upper ROM at (0x100 | romBank) << 14,
+// everything else to RAM at {page or 2, bank}, where map is the RAM
+// configuration (C0-C7) and page the MMU's RAMpage. Writes always go to RAM.
+
+inline uint32_t sim_mmu_physical(uint16_t a, bool rom, uint8_t map, uint8_t page, uint8_t romBank) {
+	int bank = a >> 14;
+	uint32_t offset = a & 0x3FFF;
+	if (rom) { return bank == 0 ? offset : ((uint32_t)(0x100 | romBank) << 14) | offset; }
+	uint32_t high = 2;
+	uint32_t low = bank;
+	if ((map == 1 || map == 3) && bank == 3) { high = page; }
+	else if (map == 2) { high = page; }
+	else if (map == 3 && bank == 1) { low = 3; }
+	else if ((map & 4) && bank == 1) { high = page; low = map & 3; }
+	return (high << 16) | (low << 14) | offset;
+}
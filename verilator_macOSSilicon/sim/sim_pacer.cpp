@@ -0,0 +1,61 @@
+#include "sim_pacer.h"
+#include <chrono>
+
+SimPacer::SimPacer(double hz) {
+	frame_ms = 1000.0 / hz;
+	max_catchup = 3;
+	running = false;
+	drift_ms = 0;
+	dropped = 0;
+	fps = 0;
+	anchor_time = 0;
+	anchor_frame = 0;
+	fps_time = 0;
+	fps_frame = 0;
+}
+
+double SimPacer::Now() {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Anchor the schedule so the next frame is due straight away
+void SimPacer::Start(int count_frame) {
+	anchor_time = Now();
+	anchor_frame = count_frame;
+	fps_time = anchor_time;
+	fps_frame = count_frame;
+	drift_ms = 0;
+	dropped = 0;
+	running = true;
+}
+
+void SimPacer::Stop() {
+	running = false;
+}
+
+int SimPacer::FramesDue(int count_frame) {
+	if (!running) { Start(count_frame); }
+	double now = Now();
+	double elapsed = now - anchor_time;
+	int target = anchor_frame + 1 + (int)(elapsed / frame_ms);
+	int due = target - count_frame;
+	if (due > max_catchup) {
+		dropped += due - max_catchup;
+		anchor_frame -= due - max_catchup;
+		due = max_catchup;
+	}
+	drift_ms = (count_frame - anchor_frame - 1) * frame_ms - elapsed;
+
+	if (now - fps_time >= 1000.0) {
+		fps = (float)((count_frame - fps_frame) * 1000.0 / (now - fps_time));
+		fps_time = now;
+		fps_frame = count_frame;
+	}
+	return due > 0 ? due : 0;
+}
+
+double SimPacer::MsUntilNext(int count_frame) {
+	double due_at = anchor_time + (count_frame - anchor_frame) * frame_ms;
+	double ms = due_at - Now();
+	return ms > 0 ? ms : 0;
+}
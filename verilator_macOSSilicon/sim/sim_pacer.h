@@ -0,0 +1,35 @@
+#pragma once
+
+// Real time pacing of emulated frames
+//
+// Frames are scheduled against a monotonic clock from an anchor taken when
+// pacing starts: frame n is due at anchor + n * frame_ms. FramesDue() says
+// how many emulated frames the caller should run now to catch up. If the
+// model falls more than max_catchup frames behind, the excess is counted as
+// dropped and the schedule slips rather than trying to catch up forever.
+
+struct SimPacer {
+public:
+	double frame_ms;		// 20ms = 50Hz
+	int max_catchup;		// most frames run in one go when behind
+	bool running;
+
+	// Statistics
+	double drift_ms;		// emulated time minus wall time, negative = behind
+	int dropped;			// frames skipped since Start() because the model could not keep up
+	float fps;				// emulated frames per wall second
+
+	void Start(int count_frame);
+	void Stop();
+	int FramesDue(int count_frame);
+	double MsUntilNext(int count_frame);
+	static double Now();
+
+	SimPacer(double hz);
+
+private:
+	double anchor_time;
+	int anchor_frame;
+	double fps_time;
+	int fps_frame;
+};
@@ -0,0 +1,222 @@
+#include "sim_sdram.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <map>
+#include <mutex>
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#define WIN32
+#endif
+
+#include "sim_console.h"
+
+static DebugConsole console;
+
+thread_local SimSDRAM* sim_sdram_active = NULL;
+
+// Shared by every unallocated page of every instance
+alignas(64) static const uint8_t zero_page[SimSDRAM::page_size] = { 0 };
+
+// DPI-C imports of rtl/mock_sdram_dpi.v
+extern "C" unsigned char sdram_dpi_read(unsigned int a) {
+	return sim_sdram_active->Read(a);
+}
+extern "C" unsigned short sdram_dpi_read16(unsigned int a) {
+	return sim_sdram_active->Read16(a);
+}
+extern "C" void sdram_dpi_write(unsigned int a, unsigned char d) {
+	sim_sdram_active->Write(a, d);
+}
+
+SimSDRAM_Image::SimSDRAM_Image() {
+	data = NULL;
+	size = 0;
+	map = NULL;
+	map_size = 0;
+	owned = NULL;
+}
+
+SimSDRAM_Image::~SimSDRAM_Image() {
+#ifndef WIN32
+	if (map) { munmap(map, map_size); }
+#endif
+	if (owned) { free(owned); }
+}
+
+bool SimSDRAM_Image::Open(std::string file) {
+	this->file = file;
+#ifndef WIN32
+	int fd = open(file.c_str(), O_RDONLY);
+	if (fd < 0) { return false; }
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p != MAP_FAILED) {
+			map = p;
+			map_size = st.st_size;
+			data = (const uint8_t*)p;
+			size = st.st_size;
+		}
+	}
+	close(fd);
+	return data != NULL;
+#else
+	FILE* f = fopen(file.c_str(), "rb");
+	if (!f) { return false; }
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	owned = (uint8_t*)malloc(size);
+	size = fread(owned, 1, size, f);
+	fclose(f);
+	data = owned;
+	return size > 0;
+#endif
+}
+
+SimSDRAM::SimSDRAM() {
+	for (int p = 0; p < page_count; p++) {
+		pages[p] = (uint8_t*)zero_page;
+		flags[p] = 0;
+		image_offset[p] = 0;
+	}
+}
+
+SimSDRAM::~SimSDRAM() {
+	Clear();
+	if (sim_sdram_active == this) { sim_sdram_active = NULL; }
+}
+
+void SimSDRAM::MakeActive() {
+	sim_sdram_active = this;
+}
+
+// Copy on write: give page p private storage seeded from what it shows now
+void SimSDRAM::Own(uint32_t p) {
+	uint8_t* page = (uint8_t*)malloc(page_size);
+	memcpy(page, pages[p], page_size);
+	pages[p] = page;
+	flags[p] |= PAGE_OWNED;
+}
+
+// Drop private storage for page p and fall back to its image or zero page
+void SimSDRAM::Release(uint32_t p) {
+	if (flags[p] & PAGE_OWNED) { free(pages[p]); }
+	flags[p] &= ~PAGE_OWNED;
+	pages[p] = images[p] ? (uint8_t*)images[p]->data + image_offset[p] : (uint8_t*)zero_page;
+}
+
+// One mapping per file for the whole process, kept while any page uses it
+std::shared_ptr<SimSDRAM_Image> SimSDRAM::OpenImage(std::string file) {
+	static std::mutex lock;
+	static std::map<std::string, std::weak_ptr<SimSDRAM_Image> > open;
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<SimSDRAM_Image> image = open[file].lock();
+	if (image) { return image; }
+	image = std::make_shared<SimSDRAM_Image>();
+	if (!image->Open(file)) {
+		console.AddLog("[error] Cannot map %s", file.c_str());
+		return NULL;
+	}
+	open[file] = image;
+	return image;
+}
+
+// Share the whole pages of addr..addr+size that hold exactly the image's
+// bytes from offset on. Returns how many pages were shared.
+int SimSDRAM::ShareImage(uint32_t addr, std::shared_ptr<SimSDRAM_Image> image, size_t offset, size_t size) {
+	if (!image || offset >= image->size) { return 0; }
+	if (size > image->size - offset) { size = image->size - offset; }
+	int shared = 0;
+	for (uint32_t a = (addr + page_mask) & ~page_mask; a + page_size <= addr + size && a < mem_size; a += page_size) {
+		uint32_t p = a >> page_bits;
+		const uint8_t* data = image->data + offset + (a - addr);
+		if (pages[p] == data || memcmp(pages[p], data, page_size) != 0) { continue; }
+		images[p] = image;
+		image_offset[p] = data - image->data;
+		Release(p);
+		shared++;
+	}
+	return shared;
+}
+
+// Back to all zeros
+void SimSDRAM::Clear() {
+	for (int p = 0; p < page_count; p++) {
+		images[p].reset();
+		Release(p);
+		flags[p] = 0;
+	}
+}
+
+void SimSDRAM::ClearDirty() {
+	for (int p = 0; p < page_count; p++) { flags[p] &= ~PAGE_DIRTY; }
+}
+
+int SimSDRAM::ResidentPages() {
+	int n = 0;
+	for (int p = 0; p < page_count; p++) { if (flags[p] & PAGE_OWNED) { n++; } }
+	return n;
+}
+
+int SimSDRAM::SharedPages() {
+	int n = 0;
+	for (int p = 0; p < page_count; p++) { if (!(flags[p] & PAGE_OWNED) && images[p]) { n++; } }
+	return n;
+}
+
+int SimSDRAM::DirtyPages() {
+	int n = 0;
+	for (int p = 0; p < page_count; p++) { if (flags[p] & PAGE_DIRTY) { n++; } }
+	return n;
+}
+
+// Snapshot format: dirtyOnly flag, page count, then (index, 4K data) records.
+// A full snapshot holds every page that is not zeros, shared ones included;
+// a dirty one only those written since the last ClearDirty() and must be
+// applied on top of its base.
+void SimSDRAM::Save(VerilatedSerialize& os, bool dirtyOnly) {
+	vluint32_t count = 0;
+	for (int p = 0; p < page_count; p++) {
+		if (dirtyOnly ? (flags[p] & PAGE_DIRTY) : pages[p] != zero_page) { count++; }
+	}
+	os << dirtyOnly;
+	os << count;
+	for (vluint32_t p = 0; p < (vluint32_t)page_count; p++) {
+		if (dirtyOnly ? (flags[p] & PAGE_DIRTY) : pages[p] != zero_page) {
+			os << p;
+			os.write(pages[p], page_size);
+		}
+	}
+}
+
+// False if the page records are not ours; the pages read so far stay
+bool SimSDRAM::Restore(VerilatedDeserialize& os) {
+	bool dirtyOnly;
+	vluint32_t count;
+	os >> dirtyOnly;
+	os >> count;
+	if (count > (vluint32_t)page_count) {
+		console.AddLog("[error] SDRAM snapshot has %u pages, at most %d fit", count, page_count);
+		return false;
+	}
+	if (!dirtyOnly) { Clear(); }
+	for (vluint32_t i = 0; i < count; i++) {
+		vluint32_t p;
+		os >> p;
+		if (p >= (vluint32_t)page_count) {
+			console.AddLog("[error] SDRAM snapshot names page %u, only %d exist", p, page_count);
+			return false;
+		}
+		if (!(flags[p] & PAGE_OWNED)) { Own(p); }
+		os.read(pages[p], page_size);
+		flags[p] |= PAGE_DIRTY;
+	}
+	return true;
+}
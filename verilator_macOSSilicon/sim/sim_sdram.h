@@ -0,0 +1,94 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include "verilated_save.h"
+
+// Host side storage for rtl/mock_sdram_dpi.v
+//
+// The 8MB SDRAM is split into 4K pages. Every page starts out pointing at a
+// shared zero page and is only allocated on its first write that changes
+// it. Once a ROM or CPR download has gone through the RTL, ShareImage()
+// points every page that now holds exactly the file's bytes back at one
+// read-only mapping of the file and frees the copy; a later write copies
+// the page again. Images come from OpenImage(), which hands every instance
+// the same mapping of a file, so they all share its pages.
+//
+// Save() writes every page that is not zeros, or with dirtyOnly just the
+// pages written since the last ClearDirty(), to go on top of a full save.
+//
+// The DPI functions imported by the RTL go to the instance made active on the
+// calling thread with MakeActive(), so each thread can run its own model.
+
+struct SimSDRAM_Image {
+public:
+	std::string file;
+	const uint8_t* data;
+	size_t size;
+
+	SimSDRAM_Image();
+	~SimSDRAM_Image();
+	bool Open(std::string file);
+
+private:
+	void* map;
+	size_t map_size;
+	uint8_t* owned;
+};
+
+struct SimSDRAM {
+public:
+
+	static const int page_bits = 12;
+	static const uint32_t page_size = 1 << page_bits;
+	static const uint32_t page_mask = page_size - 1;
+	static const uint32_t mem_size = 8 * 1024 * 1024;
+	static const int page_count = mem_size >> page_bits;
+
+	// Page flags
+	static const uint8_t PAGE_OWNED = 0x01;	// allocated by us, writable
+	static const uint8_t PAGE_DIRTY = 0x02;	// written since the last ClearDirty()
+
+	uint8_t* pages[page_count];
+	uint8_t flags[page_count];
+
+	inline uint8_t Read(uint32_t a) const {
+		a &= mem_size - 1;
+		return pages[a >> page_bits][a & page_mask];
+	}
+	inline uint16_t Read16(uint32_t a) const {
+		return (uint16_t)(Read(a + 1) << 8) | Read(a);
+	}
+	inline void Write(uint32_t a, uint8_t d) {
+		a &= mem_size - 1;
+		uint32_t p = a >> page_bits;
+		if (!(flags[p] & PAGE_OWNED)) {
+			if (pages[p][a & page_mask] == d) { return; }
+			Own(p);
+		}
+		pages[p][a & page_mask] = d;
+		flags[p] |= PAGE_DIRTY;
+	}
+
+	void MakeActive();
+	static std::shared_ptr<SimSDRAM_Image> OpenImage(std::string file);
+	int ShareImage(uint32_t addr, std::shared_ptr<SimSDRAM_Image> image, size_t offset, size_t size);
+	void Clear();
+	void ClearDirty();
+	int ResidentPages();
+	int SharedPages();
+	int DirtyPages();
+	void Save(VerilatedSerialize& os, bool dirtyOnly);
+	bool Restore(VerilatedDeserialize& os);
+
+	SimSDRAM();
+	~SimSDRAM();
+
+private:
+	std::shared_ptr<SimSDRAM_Image> images[page_count];
+	size_t image_offset[page_count];	// of the page's first byte in its image
+	void Own(uint32_t p);
+	void Release(uint32_t p);
+};
+
+extern thread_local SimSDRAM* sim_sdram_active;
@@ -0,0 +1,161 @@
+#include "sim_shm.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#else
+#define WIN32
+#endif
+
+SimShm::SimShm() {
+	header = NULL;
+	base = NULL;
+	size = 0;
+	owner = 0;
+}
+
+SimShm::~SimShm() {
+	Close();
+}
+
+#ifndef WIN32
+
+static void seq_begin(uint32_t* seq) {
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void seq_end(uint32_t* seq) {
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+// True if the object called name was left by a run that is gone: its
+// header names a writer pid that no longer exists. One without a finished
+// header may still be being set up, so it counts as in use.
+static bool shm_stale(const std::string& name) {
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) { return errno == ENOENT; }
+	struct stat st;
+	bool stale = false;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SimShm_Header)) {
+		void* p = mmap(NULL, sizeof(SimShm_Header), PROT_READ, MAP_SHARED, fd, 0);
+		if (p != MAP_FAILED) {
+			const SimShm_Header* h = (const SimShm_Header*)p;
+			if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) == SIM_SHM_MAGIC) {
+				pid_t pid = (pid_t)h->writer_pid;
+				stale = pid <= 0 || (kill(pid, 0) != 0 && errno == ESRCH);
+			}
+			munmap(p, sizeof(SimShm_Header));
+		}
+	}
+	close(fd);
+	return stale;
+}
+
+bool SimShm::Open(std::string shm_name, int width, int height, int slots) {
+	Close();
+	if (slots < 2) { slots = 2; }
+	if (slots > SIM_SHM_MAX_SLOTS) { slots = SIM_SHM_MAX_SLOTS; }
+	name = shm_name[0] == '/' ? shm_name : "/" + shm_name;
+
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t header_size = (sizeof(SimShm_Header) + page - 1) / page * page;
+	size_t frame_size = (size_t)width * height * 4;
+	size = header_size + frame_size * slots;
+
+	// Never take over a live instance's object; replace one left by a
+	// crashed run
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0 && errno == EEXIST) {
+		if (!shm_stale(name)) {
+			fprintf(stderr, "Shared memory %s is in use by another sim (or half made; remove it by hand)\n", name.c_str());
+			return false;
+		}
+		shm_unlink(name.c_str());
+		fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (fd < 0) {
+		fprintf(stderr, "Cannot create shared memory %s\n", name.c_str());
+		return false;
+	}
+	if (ftruncate(fd, size) != 0) {
+		fprintf(stderr, "Cannot size shared memory %s\n", name.c_str());
+		close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "Cannot map shared memory %s\n", name.c_str());
+		shm_unlink(name.c_str());
+		return false;
+	}
+	base = (uint8_t*)p;
+	header = (SimShm_Header*)p;
+
+	// Fill in the header before the magic, so a viewer that finds the magic
+	// sees valid geometry
+	memset(header, 0, sizeof(SimShm_Header));
+	header->version = SIM_SHM_VERSION;
+	header->header_size = (uint32_t)header_size;
+	header->width = width;
+	header->height = height;
+	header->stride = width * 4;
+	header->slots = slots;
+	owner = (int)getpid();
+	header->writer_pid = (uint32_t)owner;
+	header->frame_size = frame_size;
+	header->latest = slots - 1;
+	__atomic_store_n(&header->magic, (uint32_t)SIM_SHM_MAGIC, __ATOMIC_RELEASE);
+	return true;
+}
+
+void SimShm::Publish(const uint32_t* pixels, uint64_t frame, uint64_t time) {
+	if (!header) { return; }
+	uint32_t index = (header->latest + 1) % header->slots;
+	SimShm_Slot* slot = &header->slot[index];
+
+	seq_begin(&slot->seq);
+	memcpy(base + header->header_size + index * header->frame_size, pixels, header->frame_size);
+	slot->frame = frame;
+	slot->time = time;
+	seq_end(&slot->seq);
+
+	seq_begin(&header->seq);
+	header->latest = index;
+	header->frame = frame;
+	seq_end(&header->seq);
+}
+
+// The creator removes the name; viewers that still have it mapped keep
+// their mapping until they unmap it. A forked child only drops its copy.
+void SimShm::Close() {
+	if (!header) { return; }
+	munmap(base, size);
+	if (owner == (int)getpid()) { shm_unlink(name.c_str()); }
+	header = NULL;
+	base = NULL;
+	size = 0;
+}
+
+#else
+
+bool SimShm::Open(std::string shm_name, int width, int height, int slots) {
+	fprintf(stderr, "Shared memory export is not supported on Windows\n");
+	return false;
+}
+
+void SimShm::Publish(const uint32_t* pixels, uint64_t frame, uint64_t time) {
+}
+
+void SimShm::Close() {
+}
+
+#endif
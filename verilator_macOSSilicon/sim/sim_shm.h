@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <stdint.h>
+
+// Framebuffer export through POSIX shared memory
+//
+// SimVideo publishes each completed frame into a ring of slots in a named
+// shared memory object, so an out of process viewer can mirror a running
+// (usually headless) sim by mapping the same name read only.
+//
+// Layout: a SimShm_Header, then `slots` frames of frame_size bytes starting
+// at header_size. Pixels are width * height 32 bit words, row stride
+// `stride` bytes, in the same byte order as the GUI texture (R, G, B, A).
+//
+// Both the header and each slot carry a sequence lock: the writer makes seq
+// odd before it changes anything and even again when it is done. To read
+// the newest frame without copying it:
+//
+//     do { s = header.seq } while (s odd); slot = header.latest;
+//     if (header.seq != s) retry;
+//     do { t = slot.seq } while (t odd); ...use pixels...;
+//     if (slot.seq != t) the frame was overwritten while in use, retry
+//
+// The writer never waits for readers; with N slots a reader has N - 1
+// frames of time before the slot it is looking at is reused.
+
+#define SIM_SHM_MAGIC     0x4D465043	// "CPFM"
+#define SIM_SHM_VERSION   1
+#define SIM_SHM_MAX_SLOTS 8
+
+struct SimShm_Slot {
+public:
+	uint32_t seq;
+	uint32_t pad;
+	uint64_t frame;			// SimVideo count_frame
+	uint64_t time;			// main_time at the end of the frame
+};
+
+struct SimShm_Header {
+public:
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;	// offset of slot 0 pixels, page aligned
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;		// bytes per row
+	uint32_t slots;
+	uint32_t writer_pid;
+	uint64_t frame_size;	// bytes per slot
+	uint32_t seq;			// guards latest and frame
+	uint32_t latest;		// slot holding the newest complete frame
+	uint64_t frame;
+	SimShm_Slot slot[SIM_SHM_MAX_SLOTS];
+};
+
+struct SimShm {
+public:
+	std::string name;
+
+	bool Open(std::string name, int width, int height, int slots);
+	void Publish(const uint32_t* pixels, uint64_t frame, uint64_t time);
+	void Close();
+	bool IsOpen() { return header != NULL; }
+
+	SimShm();
+	~SimShm();
+
+private:
+	SimShm_Header* header;
+	uint8_t* base;
+	size_t size;
+	int owner;
+};
@@ -0,0 +1,164 @@
+#include "sim_signals.h"
+#include "verilated_syms.h"
+#include <string.h>
+
+SimSignals::SimSignals() {
+	context = NULL;
+	watchName[0] = 0;
+	browseFilter[0] = 0;
+}
+
+// Strip the scope prefix Verilator puts above the top module: the instance
+// name (or TOP), then the top module
+std::string SimSignals::ShortScope(const char* scope) {
+	std::string s = scope;
+	const std::string roots[] = { root, "TOP" };
+	for (int i = 0; i < 2; i++) {
+		const std::string& r = roots[i];
+		if (r.empty() || s.compare(0, r.size(), r) != 0) { continue; }
+		if (s.size() == r.size() || s == r + ".top") { return ""; }
+		if (s.compare(r.size(), 5, ".top.") == 0) { return s.substr(r.size() + 5); }
+		if (s[r.size()] == '.') { return s.substr(r.size() + 1); }
+	}
+	return s;
+}
+
+bool SimSignals::Lookup(const std::string& name, SimSignal& signal) {
+	std::string path = name.compare(0, 4, "top.") == 0 ? name.substr(4) : name;
+	size_t dot = path.rfind('.');
+	std::string scope = dot == std::string::npos ? "" : path.substr(0, dot);
+	std::string var = dot == std::string::npos ? path : path.substr(dot + 1);
+
+	const std::string prefixes[] = { root + ".top", root, "TOP.top", "TOP" };
+	for (int i = root.empty() ? 2 : 0; i < 4; i++) {
+		std::string full = scope.empty() ? prefixes[i] : prefixes[i] + "." + scope;
+		const VerilatedScope* scopep = context ? context->scopeFind(full.c_str()) : Verilated::scopeFind(full.c_str());
+		if (!scopep) { continue; }
+		const VerilatedVar* varp = scopep->varFind(var.c_str());
+		if (!varp) { continue; }
+
+		signal.name = name;
+		signal.ptr = varp->datap();
+		signal.width = varp->dims() > 0 ? varp->packed().elements() : 1;
+		signal.elements = varp->udims() > 0 ? varp->unpacked().elements() : 1;
+		switch (varp->vltype()) {
+		case VLVT_UINT8: signal.bytes = 1; break;
+		case VLVT_UINT16: signal.bytes = 2; break;
+		case VLVT_UINT32: signal.bytes = 4; break;
+		case VLVT_UINT64: signal.bytes = 8; break;
+		case VLVT_WDATA: signal.bytes = ((signal.width + 31) / 32) * 4; break;
+		default: return false;
+		}
+		return true;
+	}
+	return false;
+}
+
+const SimSignal* SimSignals::Get(const std::string& name) {
+	std::unordered_map<std::string, SimSignal>::iterator it = cache.find(name);
+	if (it != cache.end()) { return &it->second; }
+	if (missing.count(name)) { return NULL; }
+	SimSignal signal;
+	if (!Lookup(name, signal)) {
+		missing[name] = true;
+		return NULL;
+	}
+	return &(cache[name] = signal);
+}
+
+void SimSignals::AddHost(const std::string& name, void* ptr, int bytes) {
+	SimSignal signal;
+	signal.name = name;
+	signal.ptr = ptr;
+	signal.bytes = bytes;
+	signal.width = bytes * 8;
+	signal.elements = 1;
+	cache[name] = signal;
+	missing.erase(name);
+}
+
+// Every public signal whose name contains filter
+void SimSignals::List(std::vector<std::string>& names, const char* filter) {
+	const VerilatedScopeNameMap* scopes = context ? context->scopeNameMap() : Verilated::scopeNameMap();
+	if (!scopes) { return; }
+	for (VerilatedScopeNameMap::const_iterator s = scopes->begin(); s != scopes->end(); ++s) {
+		VerilatedVarNameMap* vars = s->second->varsp();
+		if (!vars) { continue; }
+		std::string scope = ShortScope(s->first);
+		for (VerilatedVarNameMap::const_iterator v = vars->begin(); v != vars->end(); ++v) {
+			std::string name = scope.empty() ? v->first : scope + "." + v->first;
+			if (!filter || !filter[0] || name.find(filter) != std::string::npos) { names.push_back(name); }
+		}
+	}
+}
+
+static void draw_value(const SimSignal* s) {
+	if (!s) { ImGui::TextDisabled("?"); return; }
+	if (s->elements > 1) { ImGui::TextDisabled("[%d]", s->elements); return; }
+	ImGui::Text("0x%0*llX", (s->width + 3) / 4, (unsigned long long)s->Read());
+}
+
+void SimSignals::DrawList(const char* const* names, int count) {
+	for (int i = 0; i < count; i++) {
+		ImGui::Text("%-28s", names[i]);
+		ImGui::SameLine();
+		draw_value(Get(names[i]));
+	}
+}
+
+void SimSignals::DrawWatch(const char* title, bool* p_open, ImVec2 size) {
+	ImGui::SetNextWindowSize(size, ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin(title, p_open)) {
+		ImGui::End();
+		return;
+	}
+
+	ImGui::SetNextItemWidth(260);
+	bool add = ImGui::InputText("##name", watchName, IM_ARRAYSIZE(watchName), ImGuiInputTextFlags_EnterReturnsTrue);
+	ImGui::SameLine();
+	add |= ImGui::Button("Watch");
+	if (add && watchName[0]) {
+		watch.push_back(watchName);
+		watchName[0] = 0;
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Browse")) { ImGui::OpenPopup("browse"); }
+	if (ImGui::BeginPopup("browse")) {
+		ImGui::SetNextItemWidth(200);
+		ImGui::InputText("filter", browseFilter, IM_ARRAYSIZE(browseFilter));
+		std::vector<std::string> names;
+		if (browseFilter[0]) { List(names, browseFilter); }
+		ImGui::BeginChild("names", ImVec2(400, 300));
+		ImGuiListClipper clipper;
+		clipper.Begin((int)names.size());
+		while (clipper.Step()) {
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+				if (ImGui::Selectable(names[i].c_str())) { watch.push_back(names[i]); }
+			}
+		}
+		ImGui::EndChild();
+		ImGui::EndPopup();
+	}
+	ImGui::Separator();
+
+	int remove = -1;
+	if (ImGui::BeginTable("watch", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersV | ImGuiTableFlags_ScrollY)) {
+		ImGui::TableSetupColumn("signal", ImGuiTableColumnFlags_WidthStretch);
+		ImGui::TableSetupColumn("value", ImGuiTableColumnFlags_WidthFixed, 140);
+		ImGui::TableSetupColumn("", ImGuiTableColumnFlags_WidthFixed, 20);
+		for (int i = 0; i < (int)watch.size(); i++) {
+			ImGui::PushID(i);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(watch[i].c_str());
+			ImGui::TableNextColumn();
+			draw_value(Get(watch[i]));
+			ImGui::TableNextColumn();
+			if (ImGui::SmallButton("x")) { remove = i; }
+			ImGui::PopID();
+		}
+		ImGui::EndTable();
+	}
+	if (remove >= 0) { watch.erase(watch.begin() + remove); }
+	ImGui::End();
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "imgui.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+// Name to pointer lookup for public model signals
+//
+// Names are dotted paths below the top module, e.g.
+// "motherboard.CRTC.R0_h_total" or "asic_inst.acid_inst.state". They are
+// found through the Verilator scope tables (the model is built with
+// --public --vpi) the first time they are asked for; after that Get()
+// returns the cached SimSignal, so panels and watch lists can hold on to
+// the pointer and read the value directly every frame.
+//
+// Host variables such as main_time can be added with AddHost() and are
+// looked up the same way.
+//
+// Each model registers its scopes in its own VerilatedContext, named after
+// the name it was created with; set context and root to that model's, or
+// the lookups go to whichever model was last created on this thread.
+
+struct SimSignal {
+public:
+	std::string name;
+	void* ptr;
+	int bytes;		// 1, 2, 4, 8, or a multiple of 4 for wide signals
+	int width;		// bits
+	int elements;	// unpacked array length, 1 for plain signals
+
+	uint64_t Read(int index = 0) const {
+		const uint8_t* p = (const uint8_t*)ptr + (size_t)index * bytes;
+		switch (bytes) {
+		case 1: return *(const uint8_t*)p;
+		case 2: return *(const uint16_t*)p;
+		case 4: return *(const uint32_t*)p;
+		default: return *(const uint64_t*)p;	// low 64 bits of wide signals
+		}
+	}
+};
+
+struct SimSignals {
+public:
+	VerilatedContext* context;	// NULL = the thread's
+	std::string root;			// Vtop instance name
+
+	const SimSignal* Get(const std::string& name);
+	void AddHost(const std::string& name, void* ptr, int bytes);
+	void List(std::vector<std::string>& names, const char* filter);
+
+	// Label/value rows for a fixed list of names, "?" for unknown ones
+	void DrawList(const char* const* names, int count);
+	// Watch window: add signals by name at runtime
+	void DrawWatch(const char* title, bool* p_open, ImVec2 size);
+
+	SimSignals();
+
+private:
+	std::unordered_map<std::string, SimSignal> cache;
+	std::unordered_map<std::string, bool> missing;
+	std::vector<std::string> watch;
+	char watchName[128];
+	char browseFilter[64];
+
+	bool Lookup(const std::string& name, SimSignal& signal);
+	std::string ShortScope(const char* scope);
+};
@@ -0,0 +1,177 @@
+#include "sim_sna.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char sna_id[8] = { 'M', 'V', ' ', '-', ' ', 'S', 'N', 'A' };
+
+SimSna::SimSna() {
+	memset(&regs, 0, sizeof(regs));
+	gaPen = 0;
+	memset(gaInks, 0, sizeof(gaInks));
+	gaMode = 0x80;
+	ramConfig = 0xC0;
+	romSelect = 0;
+	crtcSelect = 0;
+	memset(crtc, 0, sizeof(crtc));
+	ppiA = ppiB = ppiC = 0;
+	ppiControl = 0x82;
+	psgSelect = 0;
+	memset(psg, 0, sizeof(psg));
+	machine = SNA_CPC6128;
+}
+
+bool SimSna::Load(const std::string& file) {
+	FILE* f = fopen(file.c_str(), "rb");
+	if (!f) {
+		error = "cannot open " + file;
+		return false;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) { data.insert(data.end(), buffer, buffer + n); }
+	fclose(f);
+	if (data.size() < SNA_HEADER_SIZE || memcmp(data.data(), sna_id, sizeof(sna_id))) {
+		error = file + " is not a snapshot";
+		return false;
+	}
+
+	const uint8_t* h = data.data();
+	int version = h[0x10];
+	regs.f = h[0x11]; regs.a = h[0x12];
+	regs.c = h[0x13]; regs.b = h[0x14];
+	regs.e = h[0x15]; regs.d = h[0x16];
+	regs.l = h[0x17]; regs.h = h[0x18];
+	regs.r = h[0x19];
+	regs.i = h[0x1A];
+	regs.iff1 = h[0x1B] & 1;
+	regs.iff2 = h[0x1C] & 1;
+	regs.ixl = h[0x1D]; regs.ixh = h[0x1E];
+	regs.iyl = h[0x1F]; regs.iyh = h[0x20];
+	regs.sp = (uint16_t)(h[0x21] | h[0x22] << 8);
+	regs.pc = (uint16_t)(h[0x23] | h[0x24] << 8);
+	regs.im = h[0x25] & 3;
+	regs.f_ = h[0x26]; regs.a_ = h[0x27];
+	regs.c_ = h[0x28]; regs.b_ = h[0x29];
+	regs.e_ = h[0x2A]; regs.d_ = h[0x2B];
+	regs.l_ = h[0x2C]; regs.h_ = h[0x2D];
+	regs.halted = false;
+	gaPen = h[0x2E] & 0x1F;
+	for (int i = 0; i < 17; i++) { gaInks[i] = h[0x2F + i] & 0x1F; }
+	gaMode = h[0x40];
+	ramConfig = h[0x41];
+	crtcSelect = h[0x42];
+	memcpy(crtc, h + 0x43, sizeof(crtc));
+	romSelect = h[0x55];
+	ppiA = h[0x56];
+	ppiB = h[0x57];
+	ppiC = h[0x58];
+	ppiControl = h[0x59];
+	psgSelect = h[0x5A];
+	memcpy(psg, h + 0x5B, sizeof(psg));
+	machine = version >= 2 ? h[0x6D] : SNA_CPC6128;
+
+	// Plain dump, then (version 3) chunks
+	size_t dump = (size_t)(h[0x6B] | h[0x6C] << 8) * 1024;
+	if (SNA_HEADER_SIZE + dump > data.size()) {
+		error = file + " is truncated";
+		return false;
+	}
+	memory.assign(data.begin() + SNA_HEADER_SIZE, data.begin() + SNA_HEADER_SIZE + dump);
+	memory.resize((memory.size() + 0xFFFF) & ~(size_t)0xFFFF, 0);
+	if (version >= 3 && !ReadChunks(data.data() + SNA_HEADER_SIZE + dump, data.size() - SNA_HEADER_SIZE - dump)) { return false; }
+	if (memory.empty()) {
+		error = file + " has no memory";
+		return false;
+	}
+	return true;
+}
+
+// MEMn chunks, compressed when shorter than 64K; anything else is skipped
+bool SimSna::ReadChunks(const uint8_t* data, size_t size) {
+	size_t pos = 0;
+	while (pos + 8 <= size) {
+		const uint8_t* c = data + pos;
+		size_t length = c[4] | c[5] << 8 | c[6] << 16 | (size_t)c[7] << 24;
+		pos += 8;
+		if (length > size - pos) {
+			error = "snapshot chunk overruns the file";
+			return false;
+		}
+		if (!memcmp(c, "MEM", 3) && c[3] >= '0' && c[3] <= '8') {
+			size_t base = (size_t)(c[3] - '0') << 16;
+			if (memory.size() < base + 0x10000) { memory.resize(base + 0x10000, 0); }
+			uint8_t* out = memory.data() + base;
+			const uint8_t* in = data + pos;
+			if (length == 0x10000) { memcpy(out, in, 0x10000); }
+			else {
+				size_t o = 0;
+				for (size_t i = 0; i < length && o < 0x10000; i++) {
+					if (in[i] == 0xE5 && i + 1 < length) {
+						int count = in[++i];
+						if (count == 0) {
+							out[o++] = 0xE5;
+							continue;
+						}
+						uint8_t v = i + 1 < length ? in[++i] : 0;
+						for (int k = 0; k < count && o < 0x10000; k++) { out[o++] = v; }
+					}
+					else { out[o++] = in[i]; }
+				}
+			}
+		}
+		pos += length;
+	}
+	return true;
+}
+
+bool SimSna::Save(const std::string& file) {
+	uint8_t h[SNA_HEADER_SIZE];
+	memset(h, 0, sizeof(h));
+	memcpy(h, sna_id, sizeof(sna_id));
+	h[0x10] = 3;
+	h[0x11] = regs.f; h[0x12] = regs.a;
+	h[0x13] = regs.c; h[0x14] = regs.b;
+	h[0x15] = regs.e; h[0x16] = regs.d;
+	h[0x17] = regs.l; h[0x18] = regs.h;
+	h[0x19] = regs.r;
+	h[0x1A] = regs.i;
+	h[0x1B] = regs.iff1;
+	h[0x1C] = regs.iff2;
+	h[0x1D] = regs.ixl; h[0x1E] = regs.ixh;
+	h[0x1F] = regs.iyl; h[0x20] = regs.iyh;
+	h[0x21] = (uint8_t)regs.sp; h[0x22] = (uint8_t)(regs.sp >> 8);
+	h[0x23] = (uint8_t)regs.pc; h[0x24] = (uint8_t)(regs.pc >> 8);
+	h[0x25] = regs.im;
+	h[0x26] = regs.f_; h[0x27] = regs.a_;
+	h[0x28] = regs.c_; h[0x29] = regs.b_;
+	h[0x2A] = regs.e_; h[0x2B] = regs.d_;
+	h[0x2C] = regs.l_; h[0x2D] = regs.h_;
+	h[0x2E] = gaPen;
+	memcpy(h + 0x2F, gaInks, sizeof(gaInks));
+	h[0x40] = gaMode;
+	h[0x41] = ramConfig;
+	h[0x42] = crtcSelect;
+	memcpy(h + 0x43, crtc, sizeof(crtc));
+	h[0x55] = romSelect;
+	h[0x56] = ppiA;
+	h[0x57] = ppiB;
+	h[0x58] = ppiC;
+	h[0x59] = ppiControl;
+	h[0x5A] = psgSelect;
+	memcpy(h + 0x5B, psg, sizeof(psg));
+	size_t kb = memory.size() / 1024;
+	h[0x6B] = (uint8_t)kb;
+	h[0x6C] = (uint8_t)(kb >> 8);
+	h[0x6D] = machine;
+
+	FILE* f = fopen(file.c_str(), "wb");
+	if (!f) {
+		error = "cannot create " + file;
+		return false;
+	}
+	bool ok = fwrite(h, 1, sizeof(h), f) == sizeof(h) && fwrite(memory.data(), 1, memory.size(), f) == memory.size();
+	ok = fclose(f) == 0 && ok;
+	if (!ok) { error = "cannot write " + file; }
+	return ok;
+}
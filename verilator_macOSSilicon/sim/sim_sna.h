@@ -0,0 +1,48 @@
+#pragma once
+#include "sim_z80.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+// CPC snapshot (.SNA) files
+//
+// Reads versions 1-3 and writes version 3. Memory is either the plain dump
+// after the 256 byte header (64K or 128K) or, in version 3 files, MEM0-MEM8
+// chunks of 64K each, optionally run-length compressed (E5 count byte).
+// memory holds 64K banks in file order: bank 0 is the base RAM, bank n the
+// extension RAM selected by RAM configuration C4-C7 with page n - 1.
+//
+// Only the file format lives here. SimFastForward moves a SimSna into and
+// out of the running model.
+
+#define SNA_HEADER_SIZE 256
+#define SNA_CPC464      0
+#define SNA_CPC6128     2
+#define SNA_GX4000      6
+
+struct SimSna {
+public:
+	SimZ80_Regs regs;
+	uint8_t gaPen;
+	uint8_t gaInks[17];		// hardware colour numbers, 16 is the border
+	uint8_t gaMode;			// multi configuration, 10xxxxxx
+	uint8_t ramConfig;		// 11xxxxxx
+	uint8_t romSelect;
+	uint8_t crtcSelect;
+	uint8_t crtc[18];
+	uint8_t ppiA, ppiB, ppiC, ppiControl;
+	uint8_t psgSelect;
+	uint8_t psg[16];
+	uint8_t machine;
+	std::vector<uint8_t> memory;	// multiple of 64K
+
+	std::string error;
+
+	bool Load(const std::string& file);
+	bool Save(const std::string& file);
+
+	SimSna();
+
+private:
+	bool ReadChunks(const uint8_t* data, size_t size);
+};
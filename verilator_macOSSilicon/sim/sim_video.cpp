@@ -20,58 +20,45 @@
 
 // Renderer variables
 // ------------------
+// The window, GL context and texture belong to the process: only one
+// SimVideo calls Initialise(). Everything the emulated display needs is
+// kept per instance, so headless SimVideos can run side by side.
 
-int output_width = 512;
-int output_height = 512;
-int output_rotate = 0;
-bool output_vflip = false;
-bool output_usevsync = 1;
+static bool output_usevsync = 1;
 
-uint32_t* output_ptr = NULL;
-unsigned int output_size;
 #ifdef WIN32
-HWND hwnd;
-WNDCLASSEX wc;
+static HWND hwnd;
+static WNDCLASSEX wc;
 #else
-SDL_Window* window;
-SDL_GLContext gl_context;
-GLuint tex;
+static SDL_Window* window;
+static SDL_GLContext gl_context;
+static GLuint tex;
 #endif
-ImTextureID texture_id;
-ImGuiIO io;
+static ImGuiIO io;
 
-ImVec4 clear_color = ImVec4(0.25f, 0.35f, 0.40f, 0.80f);
+static ImVec4 clear_color = ImVec4(0.25f, 0.35f, 0.40f, 0.80f);
 
-int count_pixel;
-int count_line;
-int count_frame;
-bool last_hblank;
-bool last_vblank;
-bool last_hsync;
-bool last_vsync;
-bool frame_ready = 1;
-
-// Statistics
-#ifdef WIN32
-SYSTEMTIME actualtime;
-LONG time_ms;
-LONG old_time;
-LONG stats_frameTime;
-#else
-double time_ms;
-double old_time;
-double stats_frameTime;
+// Streaming upload
+// ----------------
+// Clock() marks the rows whose pixels actually changed; UpdateTexture()
+// sends just those rows into the existing texture with glTexSubImage2D.
+// When the driver has pixel unpack buffers, rows are staged through
+// VIDEO_PBO_COUNT of them in turn so the copy into one overlaps the GPU
+// still reading the last.
+#ifndef WIN32
+#define VIDEO_PBO_COUNT 2
+static GLuint pbo[VIDEO_PBO_COUNT];
+static int pbo_index = 0;
+static bool pbo_ok = false;
+static PFNGLGENBUFFERSPROC p_glGenBuffers;
+static PFNGLDELETEBUFFERSPROC p_glDeleteBuffers;
+static PFNGLBINDBUFFERPROC p_glBindBuffer;
+static PFNGLBUFFERDATAPROC p_glBufferData;
+static PFNGLMAPBUFFERPROC p_glMapBuffer;
+static PFNGLUNMAPBUFFERPROC p_glUnmapBuffer;
 #endif
-float stats_fps;
-int stats_xMax;
-int stats_yMax;
-int stats_xMin;
-int stats_yMin;
-
 
 #ifndef WIN32
-SDL_Renderer* renderer = NULL;
-SDL_Texture* texture = NULL;
 #else
 // DirectX data
 static ID3D11Device* g_pd3dDevice = NULL;
@@ -112,14 +99,14 @@ void CleanupRenderTarget()
 	if (g_mainRenderTargetView) { g_mainRenderTargetView->Release(); g_mainRenderTargetView = NULL; }
 }
 
-HRESULT CreateDeviceD3D(HWND hWnd)
+HRESULT CreateDeviceD3D(HWND hWnd, int width, int height)
 {
 	// Setup swap chain
 	DXGI_SWAP_CHAIN_DESC sd;
 	ZeroMemory(&sd, sizeof(sd));
 	sd.BufferCount = 2;
-	sd.BufferDesc.Width = output_width;
-	sd.BufferDesc.Height = output_height;
+	sd.BufferDesc.Width = width;
+	sd.BufferDesc.Height = height;
 	sd.BufferDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	sd.BufferDesc.RefreshRate.Numerator = 60;
 	sd.BufferDesc.RefreshRate.Denominator = 1;
@@ -184,12 +171,20 @@ SimVideo::SimVideo(int width, int height, int rotate)
 	output_size = output_width * output_height * 4;
 	output_rotate = rotate;
 	output_vflip = 0;
+	time = NULL;
+
+	output_ptr = NULL;
+	frame_ready = 1;
+	frame_hash = 0;
+	texture_id = 0;
 
 	count_pixel = 0;
 	count_line = 0;
 	count_frame = 0;
 	last_hblank = 0;
 	last_vblank = 0;
+	last_hsync = 0;
+	last_vsync = 0;
 
 	old_time = 0;
 	stats_frameTime = 0;
@@ -198,11 +193,17 @@ SimVideo::SimVideo(int width, int height, int rotate)
 	stats_yMax = -1000;
 	stats_xMin = 1000;
 	stats_yMin = 1000;
+	stats_rowsUploaded = 0;
+
+	dirty_rows = (uint8_t*)calloc(output_height, 1);
+	dirty_min = output_height;
+	dirty_max = -1;
 }
 
 SimVideo::~SimVideo()
 {
-
+	free(output_ptr);
+	free(dirty_rows);
 }
 
 int SimVideo::Initialise(const char* windowTitle) {
@@ -217,7 +218,7 @@ int SimVideo::Initialise(const char* windowTitle) {
 	hwnd = CreateWindow(wc.lpszClassName, _T(windowTitle), WS_OVERLAPPEDWINDOW, 100, 100, 1600, 1100, NULL, NULL, wc.hInstance, NULL);
 
 	// Initialize Direct3D
-	if (CreateDeviceD3D(hwnd) < 0)
+	if (CreateDeviceD3D(hwnd, output_width, output_height) < 0)
 	{
 		CleanupDeviceD3D();
 		UnregisterClass(wc.lpszClassName, wc.hInstance);
@@ -329,18 +330,68 @@ int SimVideo::Initialise(const char* windowTitle) {
 	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, output_width, output_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, output_ptr);
 	texture_id = (ImTextureID)tex;
+
+	// Pixel unpack buffers are GL 2.1; without them rows go straight from output_ptr
+	p_glGenBuffers = (PFNGLGENBUFFERSPROC)SDL_GL_GetProcAddress("glGenBuffers");
+	p_glDeleteBuffers = (PFNGLDELETEBUFFERSPROC)SDL_GL_GetProcAddress("glDeleteBuffers");
+	p_glBindBuffer = (PFNGLBINDBUFFERPROC)SDL_GL_GetProcAddress("glBindBuffer");
+	p_glBufferData = (PFNGLBUFFERDATAPROC)SDL_GL_GetProcAddress("glBufferData");
+	p_glMapBuffer = (PFNGLMAPBUFFERPROC)SDL_GL_GetProcAddress("glMapBuffer");
+	p_glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)SDL_GL_GetProcAddress("glUnmapBuffer");
+	pbo_ok = p_glGenBuffers && p_glDeleteBuffers && p_glBindBuffer && p_glBufferData && p_glMapBuffer && p_glUnmapBuffer
+		&& SDL_GL_ExtensionSupported("GL_ARB_pixel_buffer_object");
+	if (pbo_ok) {
+		p_glGenBuffers(VIDEO_PBO_COUNT, pbo);
+		for (int i = 0; i < VIDEO_PBO_COUNT; i++) {
+			p_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[i]);
+			p_glBufferData(GL_PIXEL_UNPACK_BUFFER, output_size, NULL, GL_STREAM_DRAW);
+		}
+		p_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
 #endif
 	return 0;
 }
 
+// Allocate the frame buffer only, for runs without a window or GPU
+int SimVideo::InitialiseHeadless() {
+	output_ptr = (uint32_t*)malloc(output_size);
+	memset(output_ptr, 0xAA, output_size);
+	return 0;
+}
+
+// Write the current frame as a binary PPM
+bool SimVideo::SaveFrame(std::string file) {
+	if (!output_ptr) { return false; }
+	FILE* f = fopen(file.c_str(), "wb");
+	if (!f) { return false; }
+	fprintf(f, "P6\n%d %d\n255\n", output_width, output_height);
+	std::string row(output_width * 3, 0);
+	bool ok = true;
+	for (int y = 0; y < output_height && ok; y++) {
+		const uint32_t* p = output_ptr + y * output_width;
+		for (int x = 0; x < output_width; x++) {
+			row[x * 3 + 0] = (char)(p[x] & 0xFF);
+			row[x * 3 + 1] = (char)(p[x] >> 8 & 0xFF);
+			row[x * 3 + 2] = (char)(p[x] >> 16 & 0xFF);
+		}
+		ok = fwrite(row.data(), 1, row.size(), f) == row.size();
+	}
+	return fclose(f) == 0 && ok;
+}
+
 void SimVideo::UpdateTexture() {
 
 #ifdef WIN32
 	// Update the texture!
 	// D3D11_USAGE_DEFAULT MUST be set in the texture description (somewhere above) for this to work.
 	// (D3D11_USAGE_DYNAMIC is for use with map / unmap.) ElectronAsh.
-	if (frame_ready) {
-		g_pd3dDeviceContext->UpdateSubresource(texture, 0, NULL, output_ptr, output_width * 4, 0);
+	if (frame_ready && dirty_max >= dirty_min) {
+		D3D11_BOX box = { 0, (UINT)dirty_min, 0, (UINT)output_width, (UINT)dirty_max + 1, 1 };
+		g_pd3dDeviceContext->UpdateSubresource(texture, 0, &box, output_ptr + dirty_min * output_width, output_width * 4, 0);
+		stats_rowsUploaded = dirty_max - dirty_min + 1;
+		memset(dirty_rows + dirty_min, 0, dirty_max - dirty_min + 1);
+		dirty_min = output_height;
+		dirty_max = -1;
 	}
 	// Rendering
 	ImGui::Render();
@@ -349,8 +400,8 @@ void SimVideo::UpdateTexture() {
 	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
 	g_pSwapChain->Present(output_usevsync, 0); // Present without vsync
 #else
-	if (frame_ready) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, output_width, output_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, output_ptr);
+	if (frame_ready && dirty_max >= dirty_min) {
+		UploadDirtyRows();
 	}
 	// Rendering
 	ImGui::Render();
@@ -366,6 +417,45 @@ void SimVideo::UpdateTexture() {
 
 }
 
+#ifndef WIN32
+// Send each run of dirty rows with one glTexSubImage2D
+void SimVideo::UploadDirtyRows() {
+	size_t row_bytes = output_width * 4;
+	const uint8_t* src = (const uint8_t*)output_ptr;
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (pbo_ok) {
+		p_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[pbo_index]);
+		// Orphan the old storage so mapping never waits on a pending upload
+		p_glBufferData(GL_PIXEL_UNPACK_BUFFER, output_size, NULL, GL_STREAM_DRAW);
+		uint8_t* dst = (uint8_t*)p_glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (dst) {
+			memcpy(dst + dirty_min * row_bytes, src + dirty_min * row_bytes, (dirty_max - dirty_min + 1) * row_bytes);
+			p_glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			src = NULL;	// offsets into the bound buffer from here on
+		}
+		else {
+			p_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+	stats_rowsUploaded = 0;
+	for (int y = dirty_min; y <= dirty_max; y++) {
+		if (!dirty_rows[y]) { continue; }
+		int start = y;
+		while (y <= dirty_max && dirty_rows[y]) { dirty_rows[y++] = 0; }
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, start, output_width, y - start, GL_RGBA, GL_UNSIGNED_BYTE, src + start * row_bytes);
+		stats_rowsUploaded += y - start;
+	}
+	if (pbo_ok) {
+		p_glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		pbo_index = (pbo_index + 1) % VIDEO_PBO_COUNT;
+	}
+	dirty_min = output_height;
+	dirty_max = -1;
+}
+#endif
+
 void SimVideo::CleanUp() {
 #ifdef WIN32
 	// Close imgui stuff properly...
@@ -378,6 +468,7 @@ void SimVideo::CleanUp() {
 	UnregisterClass(wc.lpszClassName, wc.hInstance);
 #else
 	// Cleanup
+	if (pbo_ok) { p_glDeleteBuffers(VIDEO_PBO_COUNT, pbo); }
 	ImGui_ImplOpenGL2_Shutdown();
 	ImGui_ImplSDL2_Shutdown();
 	ImGui::DestroyContext();
@@ -425,16 +516,23 @@ void SimVideo::Clock(bool hblank, bool vblank, bool hsync, bool vsync, uint32_t
 		count_frame++;
 		count_line = 0;
 #ifdef WIN32
+		SYSTEMTIME actualtime;
 		GetSystemTime(&actualtime);
-		time_ms = (actualtime.wSecond * 1000) + actualtime.wMilliseconds;
+		double time_ms = (actualtime.wSecond * 1000) + actualtime.wMilliseconds;
 #else
 		struct timeval tv;
 		gettimeofday(&tv, NULL);
-		time_ms = (tv.tv_sec) * 1000 + (tv.tv_usec) / 1000; // convert tv_sec & tv_usec to millisecond
+		double time_ms = (tv.tv_sec) * 1000 + (tv.tv_usec) / 1000; // convert tv_sec & tv_usec to millisecond
 #endif
 		stats_frameTime = time_ms - old_time;
 		old_time = time_ms;
 		stats_fps = (float)(1000.0 / stats_frameTime);
+		if (output_ptr) {
+			uint64_t h = 0xcbf29ce484222325ULL;
+			for (int i = 0; i < output_width * output_height; i++) { h = (h ^ output_ptr[i]) * 0x100000001b3ULL; }
+			frame_hash = h;
+		}
+		if (shm.IsOpen()) { shm.Publish(output_ptr, count_frame, time ? *time : 0); }
 	}
 
 	// Only draw outside of blanks
@@ -470,8 +568,13 @@ void SimVideo::Clock(bool hblank, bool vblank, bool hsync, bool vsync, uint32_t
 		// Generate texture address
 		uint32_t vga_addr = (y * xs) + x;
 
-		// Write pixel to texture
-		output_ptr[vga_addr] = colour;
+		// Write pixel to texture, noting rows that need uploading
+		if (output_ptr[vga_addr] != colour) {
+			output_ptr[vga_addr] = colour;
+			dirty_rows[y] = 1;
+			if (y < dirty_min) { dirty_min = y; }
+			if (y > dirty_max) { dirty_max = y; }
+		}
 
 	}
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include "sim_shm.h"
 #ifndef _MSC_VER
 #include "imgui_impl_sdl2.h"
 #include "imgui_impl_opengl2.h"
@@ -30,9 +31,14 @@ public:
 	int stats_xMin;
 	int stats_yMax;
 	int stats_yMin;
+	int stats_rowsUploaded;
 
 	ImTextureID texture_id;
 
+	// Completed frames are copied here when open (--shm)
+	SimShm shm;
+	uint64_t* time;
+
 	SimVideo(int width, int height, int rotate);
 	~SimVideo();
 	void UpdateTexture();
@@ -40,4 +46,24 @@ public:
 	void StartFrame();
 	void Clock(bool hblank, bool vblank, bool hsync, bool vsync, uint32_t colour);
 	int Initialise(const char* windowTitle);
+	int InitialiseHeadless();
+	bool SaveFrame(std::string file);
+
+	// Emulated display, ARGB, output_width * output_height
+	uint32_t* output_ptr;
+	bool frame_ready;		// a vsync happened since the last UpdateTexture()
+	uint64_t frame_hash;	// FNV-1a over the pixels of the last completed frame
+
+private:
+	unsigned int output_size;
+	bool last_hblank;
+	bool last_vblank;
+	bool last_hsync;
+	bool last_vsync;
+	double old_time;
+	uint8_t* dirty_rows;	// rows changed since the last upload
+	int dirty_min;
+	int dirty_max;
+
+	void UploadDirtyRows();
 };
@@ -0,0 +1,112 @@
+#include "sim_watchdog.h"
+#include "sim_console.h"
+#include <stdio.h>
+
+static DebugConsole console;
+
+static const char* reason_names[] = { "none", "no vsync", "pc loop", "frozen" };
+
+SimWatchdog::SimWatchdog() {
+	signals = NULL;
+	video = NULL;
+	time = NULL;
+	noVsyncCycles = 0;
+	pcFrames = 0;
+	pcRange = 16;
+	hashFrames = 0;
+	reason = WATCHDOG_NONE;
+	armed = false;
+	m1_n = mreq_n = rd_n = addr = download = NULL;
+	lastRd = false;
+	lastFrame = 0;
+	lastVsync = 0;
+	lastHash = 0;
+	hashSame = 0;
+	loopMin = loopMax = 0;
+	loopFetched = false;
+	loopFrame = 0;
+}
+
+const char* SimWatchdog::ReasonName(int reason) {
+	return reason >= WATCHDOG_NONE && reason <= WATCHDOG_FROZEN ? reason_names[reason] : "?";
+}
+
+bool SimWatchdog::Arm() {
+	if (!noVsyncCycles && !pcFrames && !hashFrames) { return false; }
+	download = signals->Get("ioctl_download");
+	m1_n = NULL;
+	if (pcFrames) {
+		const SimSignal* m1 = signals->Get("motherboard.CPU.i_tv80_core.m1_n");
+		mreq_n = signals->Get("motherboard.CPU.mreq_n_reg");
+		rd_n = signals->Get("motherboard.CPU.rd_n_reg");
+		addr = signals->Get("motherboard.CPU.i_tv80_core.A");
+		if (m1 && mreq_n && rd_n && addr) { m1_n = m1; }
+		else { console.AddLog("[error] Watchdog: tv80 is not public in this model, no pc loop test"); }
+	}
+	armed = true;
+	Reset();
+	return true;
+}
+
+void SimWatchdog::Reset() {
+	reason = WATCHDOG_NONE;
+	report.clear();
+	lastRd = rd_n && m1_n ? !rd_n->Read() : false;
+	lastFrame = video->count_frame;
+	lastVsync = *time;
+	lastHash = video->frame_hash;
+	hashSame = 0;
+	loopFetched = false;
+	loopFrame = video->count_frame;
+}
+
+void SimWatchdog::Fetched(uint16_t pc) {
+	if (!loopFetched) {
+		loopMin = loopMax = pc;
+		loopFetched = true;
+		return;
+	}
+	if (pc < loopMin) { loopMin = pc; }
+	if (pc > loopMax) { loopMax = pc; }
+	if (loopMax - loopMin >= pcRange) {
+		// Out of the window: start a new one here
+		loopMin = loopMax = pc;
+		loopFrame = video->count_frame;
+	}
+}
+
+void SimWatchdog::Frame() {
+	lastFrame = video->count_frame;
+	lastVsync = *time;
+	if (hashFrames) {
+		if (video->frame_hash == lastHash) { hashSame++; }
+		else {
+			hashSame = 0;
+			lastHash = video->frame_hash;
+		}
+		if (hashSame >= hashFrames) {
+			Fire(WATCHDOG_FROZEN);
+			return;
+		}
+	}
+	if (m1_n && video->count_frame - loopFrame >= pcFrames) { Fire(WATCHDOG_PC_LOOP); }
+}
+
+void SimWatchdog::Fire(int why) {
+	reason = why;
+	char buf[160];
+	if (why == WATCHDOG_NO_VSYNC) {
+		snprintf(buf, sizeof(buf), "no vsync for %llu cycles", (unsigned long long)(*time - lastVsync));
+	}
+	else if (why == WATCHDOG_PC_LOOP && !loopFetched) {
+		snprintf(buf, sizeof(buf), "no opcode fetched for %d frames", video->count_frame - loopFrame);
+	}
+	else if (why == WATCHDOG_PC_LOOP) {
+		snprintf(buf, sizeof(buf), "pc in %04X-%04X for %d frames", loopMin, loopMax, video->count_frame - loopFrame);
+	}
+	else {
+		snprintf(buf, sizeof(buf), "frame %016llx unchanged for %d frames", (unsigned long long)lastHash, hashSame);
+	}
+	report = buf;
+	console.AddLog("Watchdog: %s: %s at frame %d, %llu", ReasonName(why), report.c_str(), video->count_frame, (unsigned long long)*time);
+}
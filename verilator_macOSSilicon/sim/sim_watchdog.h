@@ -0,0 +1,88 @@
+#pragma once
+#include "verilated_heavy.h"
+#include "sim_signals.h"
+#include "sim_video.h"
+#include <string>
+#include <stdint.h>
+
+// Hang detection for unattended runs
+//
+// Check() runs on every rising edge and fires when the run looks stuck:
+//   no vsync     no frame has completed for noVsyncCycles main_time ticks
+//   pc loop      every opcode fetch for pcFrames frames fell inside a
+//                window of pcRange bytes, or there were none at all
+//   frozen       video.frame_hash has not changed for hashFrames frames
+// A test is off while its limit is 0. Everything is held off while an
+// ioctl download runs, as the CPU sits in reset and the screen stands
+// still then. Once fired, Check() keeps returning true and reason/report
+// say what was seen until Reset(). What to do about it (stop the run, save
+// a snapshot) is up to main.
+
+#define WATCHDOG_NONE     0
+#define WATCHDOG_NO_VSYNC 1
+#define WATCHDOG_PC_LOOP  2
+#define WATCHDOG_FROZEN   3
+
+struct SimWatchdog {
+public:
+	SimSignals* signals;
+	SimVideo* video;
+	vluint64_t* time;
+
+	vluint64_t noVsyncCycles;
+	int pcFrames;
+	int pcRange;		// bytes
+	int hashFrames;
+
+	int reason;			// WATCHDOG_*
+	std::string report;
+
+	bool Check() {
+		if (!armed) { return false; }
+		if (reason) { return true; }
+		if (download && download->Read()) {
+			Reset();
+			return false;
+		}
+		if (m1_n) {
+			bool rd = !rd_n->Read();
+			if (rd && !lastRd && !m1_n->Read() && !mreq_n->Read()) { Fetched((uint16_t)addr->Read()); }
+			lastRd = rd;
+		}
+		if (video->count_frame != lastFrame) { Frame(); }
+		else if (noVsyncCycles && *time - lastVsync >= noVsyncCycles) { Fire(WATCHDOG_NO_VSYNC); }
+		return reason != WATCHDOG_NONE;
+	}
+
+	// Start watching with the limits set above; false if none is set
+	bool Arm();
+	void Disarm() { armed = false; }
+	bool Armed() { return armed; }
+	// Forget what has been seen so far and clear a fired reason
+	void Reset();
+	static const char* ReasonName(int reason);
+
+	SimWatchdog();
+
+private:
+	bool armed;
+	const SimSignal* m1_n;	// NULL when tv80 is not public: no pc loop test
+	const SimSignal* mreq_n;
+	const SimSignal* rd_n;
+	const SimSignal* addr;
+	const SimSignal* download;
+
+	bool lastRd;
+	int lastFrame;
+	vluint64_t lastVsync;
+	uint64_t lastHash;
+	int hashSame;
+	uint16_t loopMin;		// fetch window since loopFrame
+	uint16_t loopMax;
+	bool loopFetched;
+	int loopFrame;
+
+	void Fetched(uint16_t pc);
+	void Frame();
+	void Fire(int why);
+};
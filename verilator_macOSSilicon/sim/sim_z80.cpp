@@ -0,0 +1,654 @@
+#include "sim_z80.h"
+#include <string.h>
+
+#define FC Z80_FLAG_C
+#define FN Z80_FLAG_N
+#define FP Z80_FLAG_P
+#define FX Z80_FLAG_X
+#define FH Z80_FLAG_H
+#define FY Z80_FLAG_Y
+#define FZ Z80_FLAG_Z
+#define FS Z80_FLAG_S
+
+// S, Z, and the undocumented X/Y copies of bits 3 and 5, with and without parity
+static uint8_t sz53[256];
+static uint8_t sz53p[256];
+
+static void init_tables() {
+	for (int i = 0; i < 256; i++) {
+		int bits = 0;
+		for (int b = 0; b < 8; b++) { bits += (i >> b) & 1; }
+		sz53[i] = (uint8_t)((i & (FS | FY | FX)) | (i == 0 ? FZ : 0));
+		sz53p[i] = (uint8_t)(sz53[i] | ((bits & 1) ? 0 : FP));
+	}
+}
+
+SimZ80::SimZ80() {
+	if (!sz53[0]) { init_tables(); }
+	bus = NULL;
+	index = 0;
+	uint8_t* plain[8] = { &regs.b, &regs.c, &regs.d, &regs.e, &regs.h, &regs.l, NULL, &regs.a };
+	for (int i = 0; i < 3; i++) { memcpy(r8[i], plain, sizeof(plain)); }
+	r8[1][4] = &regs.ixh;
+	r8[1][5] = &regs.ixl;
+	r8[2][4] = &regs.iyh;
+	r8[2][5] = &regs.iyl;
+	Reset();
+}
+
+void SimZ80::Reset() {
+	memset(&regs, 0, sizeof(regs));
+	regs.a = regs.f = 0xFF;
+	regs.sp = 0xFFFF;
+}
+
+// Bus helpers, in Z80 order: low byte first, pushes high byte first
+
+uint8_t SimZ80::Fetch() {
+	regs.r = (uint8_t)((regs.r & 0x80) | ((regs.r + 1) & 0x7F));
+	return bus->Fetch(regs.pc++);
+}
+
+uint8_t SimZ80::Imm() {
+	return bus->Read(regs.pc++);
+}
+
+uint16_t SimZ80::Imm16() {
+	uint8_t lo = Imm();
+	return Pair(Imm(), lo);
+}
+
+uint16_t SimZ80::Read16(uint16_t addr) {
+	uint8_t lo = bus->Read(addr);
+	return Pair(bus->Read((uint16_t)(addr + 1)), lo);
+}
+
+void SimZ80::Write16(uint16_t addr, uint16_t v) {
+	bus->Write(addr, (uint8_t)v);
+	bus->Write((uint16_t)(addr + 1), (uint8_t)(v >> 8));
+}
+
+void SimZ80::Push(uint16_t v) {
+	bus->Write(--regs.sp, (uint8_t)(v >> 8));
+	bus->Write(--regs.sp, (uint8_t)v);
+}
+
+uint16_t SimZ80::Pop() {
+	uint8_t lo = bus->Read(regs.sp++);
+	return Pair(bus->Read(regs.sp++), lo);
+}
+
+// HL, or IX/IY under a DD/FD prefix
+uint16_t SimZ80::HL() {
+	if (index == 1) { return Pair(regs.ixh, regs.ixl); }
+	if (index == 2) { return Pair(regs.iyh, regs.iyl); }
+	return Pair(regs.h, regs.l);
+}
+
+void SimZ80::SetHL(uint16_t v) {
+	*r8[index][4] = (uint8_t)(v >> 8);
+	*r8[index][5] = (uint8_t)v;
+}
+
+uint16_t SimZ80::RP(int p) {
+	switch (p) {
+	case 0: return Pair(regs.b, regs.c);
+	case 1: return Pair(regs.d, regs.e);
+	case 2: return HL();
+	default: return regs.sp;
+	}
+}
+
+void SimZ80::SetRP(int p, uint16_t v) {
+	switch (p) {
+	case 0: regs.b = (uint8_t)(v >> 8); regs.c = (uint8_t)v; break;
+	case 1: regs.d = (uint8_t)(v >> 8); regs.e = (uint8_t)v; break;
+	case 2: SetHL(v); break;
+	default: regs.sp = v; break;
+	}
+}
+
+// Address of the (HL) operand; reads the displacement under a prefix
+uint16_t SimZ80::MemAddr() {
+	if (!index) { return Pair(regs.h, regs.l); }
+	int8_t d = (int8_t)Imm();
+	return (uint16_t)(HL() + d);
+}
+
+bool SimZ80::Cond(int y) {
+	switch (y) {
+	case 0: return !(regs.f & FZ);
+	case 1: return (regs.f & FZ) != 0;
+	case 2: return !(regs.f & FC);
+	case 3: return (regs.f & FC) != 0;
+	case 4: return !(regs.f & FP);
+	case 5: return (regs.f & FP) != 0;
+	case 6: return !(regs.f & FS);
+	default: return (regs.f & FS) != 0;
+	}
+}
+
+// ALU
+
+uint8_t SimZ80::Inc8(uint8_t v) {
+	uint8_t r = (uint8_t)(v + 1);
+	regs.f = (uint8_t)((regs.f & FC) | sz53[r] | ((r & 0x0F) == 0 ? FH : 0) | (r == 0x80 ? FP : 0));
+	return r;
+}
+
+uint8_t SimZ80::Dec8(uint8_t v) {
+	uint8_t r = (uint8_t)(v - 1);
+	regs.f = (uint8_t)((regs.f & FC) | FN | sz53[r] | ((r & 0x0F) == 0x0F ? FH : 0) | (r == 0x7F ? FP : 0));
+	return r;
+}
+
+// ADD ADC SUB SBC AND XOR OR CP
+void SimZ80::Alu(int op, uint8_t v) {
+	uint8_t a = regs.a;
+	int carry = (op == 1 || op == 3) ? (regs.f & FC) : 0;
+	int r;
+	switch (op) {
+	case 0:
+	case 1:
+		r = a + v + carry;
+		regs.f = (uint8_t)(sz53[r & 0xFF] | ((r >> 8) & FC) | ((a ^ v ^ r) & FH) | ((((a ^ ~v) & (a ^ r)) & 0x80) >> 5));
+		regs.a = (uint8_t)r;
+		break;
+	case 2:
+	case 3:
+	case 7:
+		r = a - v - carry;
+		regs.f = (uint8_t)(FN | ((r >> 8) & FC) | ((a ^ v ^ r) & FH) | ((((a ^ v) & (a ^ r)) & 0x80) >> 5));
+		if (op == 7) {
+			// CP takes X/Y from the operand
+			regs.f |= (uint8_t)((sz53[r & 0xFF] & (FS | FZ)) | (v & (FX | FY)));
+		}
+		else {
+			regs.f |= sz53[r & 0xFF];
+			regs.a = (uint8_t)r;
+		}
+		break;
+	case 4:
+		regs.a = a & v;
+		regs.f = (uint8_t)(sz53p[regs.a] | FH);
+		break;
+	case 5:
+		regs.a = a ^ v;
+		regs.f = sz53p[regs.a];
+		break;
+	default:
+		regs.a = a | v;
+		regs.f = sz53p[regs.a];
+		break;
+	}
+}
+
+uint16_t SimZ80::Add16(uint16_t a, uint16_t v) {
+	int r = a + v;
+	regs.f = (uint8_t)((regs.f & (FS | FZ | FP)) | ((r >> 16) & FC) | (((a ^ v ^ r) >> 8) & FH) | ((r >> 8) & (FX | FY)));
+	return (uint16_t)r;
+}
+
+uint16_t SimZ80::Adc16(uint16_t a, uint16_t v) {
+	int r = a + v + (regs.f & FC);
+	regs.f = (uint8_t)(((r >> 16) & FC) | (((a ^ v ^ r) >> 8) & FH) | ((r >> 8) & (FS | FX | FY))
+		| ((r & 0xFFFF) ? 0 : FZ) | ((((a ^ ~v) & (a ^ r)) & 0x8000) >> 13));
+	return (uint16_t)r;
+}
+
+uint16_t SimZ80::Sbc16(uint16_t a, uint16_t v) {
+	int r = a - v - (regs.f & FC);
+	regs.f = (uint8_t)(FN | ((r >> 16) & FC) | (((a ^ v ^ r) >> 8) & FH) | ((r >> 8) & (FS | FX | FY))
+		| ((r & 0xFFFF) ? 0 : FZ) | ((((a ^ v) & (a ^ r)) & 0x8000) >> 13));
+	return (uint16_t)r;
+}
+
+// RLC RRC RL RR SLA SRA SLL SRL, CB flags
+uint8_t SimZ80::Rot(int op, uint8_t v) {
+	uint8_t r;
+	uint8_t c;
+	switch (op) {
+	case 0: c = v >> 7; r = (uint8_t)((v << 1) | c); break;
+	case 1: c = v & 1; r = (uint8_t)((v >> 1) | (c << 7)); break;
+	case 2: c = v >> 7; r = (uint8_t)((v << 1) | (regs.f & FC)); break;
+	case 3: c = v & 1; r = (uint8_t)((v >> 1) | ((regs.f & FC) << 7)); break;
+	case 4: c = v >> 7; r = (uint8_t)(v << 1); break;
+	case 5: c = v & 1; r = (uint8_t)((v >> 1) | (v & 0x80)); break;
+	case 6: c = v >> 7; r = (uint8_t)((v << 1) | 1); break;
+	default: c = v & 1; r = (uint8_t)(v >> 1); break;
+	}
+	regs.f = (uint8_t)(sz53p[r] | c);
+	return r;
+}
+
+void SimZ80::Daa() {
+	uint8_t a = regs.a;
+	uint8_t corr = 0;
+	uint8_t c = regs.f & FC;
+	uint8_t h;
+	if ((regs.f & FH) || (a & 0x0F) > 9) { corr |= 0x06; }
+	if (c || a > 0x99) { corr |= 0x60; c = FC; }
+	if (regs.f & FN) {
+		h = ((regs.f & FH) && (a & 0x0F) < 6) ? FH : 0;
+		a = (uint8_t)(a - corr);
+	}
+	else {
+		h = (a & 0x0F) > 9 ? FH : 0;
+		a = (uint8_t)(a + corr);
+	}
+	regs.a = a;
+	regs.f = (uint8_t)(sz53p[a] | h | (regs.f & FN) | c);
+}
+
+// Execution
+
+void SimZ80::Step() {
+	if (regs.halted) {
+		// HALT keeps fetching and discarding the next opcode
+		regs.r = (uint8_t)((regs.r & 0x80) | ((regs.r + 1) & 0x7F));
+		bus->Fetch(regs.pc);
+		return;
+	}
+	index = 0;
+	uint8_t op = Fetch();
+	while (op == 0xDD || op == 0xFD) {
+		index = op == 0xDD ? 1 : 2;
+		op = Fetch();
+	}
+	if (op == 0xCB) {
+		if (index) {
+			// DD CB d op: displacement and opcode are plain reads
+			uint16_t addr = MemAddr();
+			ExecCB(Imm(), true, addr);
+		}
+		else {
+			ExecCB(Fetch(), false, 0);
+		}
+	}
+	else if (op == 0xED) {
+		index = 0;
+		ExecED(Fetch());
+	}
+	else {
+		ExecMain(op);
+	}
+}
+
+void SimZ80::Interrupt(uint8_t data) {
+	regs.halted = false;
+	regs.iff1 = regs.iff2 = 0;
+	switch (regs.im) {
+	case 2:
+		Push(regs.pc);
+		regs.pc = Read16(Pair(regs.i, data));
+		break;
+	case 1:
+		Push(regs.pc);
+		regs.pc = 0x38;
+		break;
+	default:
+		// Only RST is supported on the data bus in mode 0, which is all the CPC puts there
+		Push(regs.pc);
+		regs.pc = data & 0x38;
+		break;
+	}
+}
+
+void SimZ80::Nmi() {
+	regs.halted = false;
+	regs.iff1 = 0;
+	Push(regs.pc);
+	regs.pc = 0x66;
+}
+
+void SimZ80::ExecMain(uint8_t op) {
+	int x = op >> 6;
+	int y = (op >> 3) & 7;
+	int z = op & 7;
+	int p = y >> 1;
+	int q = y & 1;
+
+	if (x == 1) {
+		if (op == 0x76) {
+			regs.halted = true;
+		}
+		else if (z == 6) {
+			uint16_t addr = MemAddr();
+			*r8[0][y] = bus->Read(addr);
+		}
+		else if (y == 6) {
+			uint16_t addr = MemAddr();
+			bus->Write(addr, *r8[0][z]);
+		}
+		else {
+			*r8[index][y] = *r8[index][z];
+		}
+		return;
+	}
+	if (x == 2) {
+		Alu(y, z == 6 ? bus->Read(MemAddr()) : *r8[index][z]);
+		return;
+	}
+
+	if (x == 0) {
+		switch (z) {
+		case 0:
+			if (y == 0) { }
+			else if (y == 1) {
+				uint8_t t = regs.a; regs.a = regs.a_; regs.a_ = t;
+				t = regs.f; regs.f = regs.f_; regs.f_ = t;
+			}
+			else {
+				int8_t d = (int8_t)Imm();
+				bool jump;
+				if (y == 2) { jump = --regs.b != 0; }
+				else if (y == 3) { jump = true; }
+				else { jump = Cond(y - 4); }
+				if (jump) { regs.pc = (uint16_t)(regs.pc + d); }
+			}
+			break;
+		case 1:
+			if (q == 0) { SetRP(p, Imm16()); }
+			else { SetHL(Add16(HL(), RP(p))); }
+			break;
+		case 2:
+			switch (y) {
+			case 0: bus->Write(RP(0), regs.a); break;
+			case 1: regs.a = bus->Read(RP(0)); break;
+			case 2: bus->Write(RP(1), regs.a); break;
+			case 3: regs.a = bus->Read(RP(1)); break;
+			case 4: Write16(Imm16(), HL()); break;
+			case 5: SetHL(Read16(Imm16())); break;
+			case 6: bus->Write(Imm16(), regs.a); break;
+			default: regs.a = bus->Read(Imm16()); break;
+			}
+			break;
+		case 3:
+			SetRP(p, (uint16_t)(RP(p) + (q ? -1 : 1)));
+			break;
+		case 4:
+		case 5:
+			if (y == 6) {
+				uint16_t addr = MemAddr();
+				uint8_t v = bus->Read(addr);
+				bus->Write(addr, z == 4 ? Inc8(v) : Dec8(v));
+			}
+			else {
+				*r8[index][y] = z == 4 ? Inc8(*r8[index][y]) : Dec8(*r8[index][y]);
+			}
+			break;
+		case 6:
+			if (y == 6) {
+				uint16_t addr = MemAddr();
+				bus->Write(addr, Imm());
+			}
+			else {
+				*r8[index][y] = Imm();
+			}
+			break;
+		default: {
+			uint8_t a = regs.a;
+			uint8_t keep = regs.f & (FS | FZ | FP);
+			switch (y) {
+			case 0: regs.a = (uint8_t)((a << 1) | (a >> 7)); regs.f = (uint8_t)(keep | (a >> 7)); break;
+			case 1: regs.a = (uint8_t)((a >> 1) | (a << 7)); regs.f = (uint8_t)(keep | (a & 1)); break;
+			case 2: regs.a = (uint8_t)((a << 1) | (regs.f & FC)); regs.f = (uint8_t)(keep | (a >> 7)); break;
+			case 3: regs.a = (uint8_t)((a >> 1) | ((regs.f & FC) << 7)); regs.f = (uint8_t)(keep | (a & 1)); break;
+			case 4: Daa(); return;
+			case 5: regs.a = (uint8_t)~a; regs.f = (uint8_t)((regs.f & (FS | FZ | FP | FC)) | FH | FN); break;
+			case 6: regs.f = (uint8_t)(keep | FC); break;
+			default: regs.f = (uint8_t)(keep | ((regs.f & FC) ? FH : FC)); break;
+			}
+			regs.f |= regs.a & (FX | FY);
+			break;
+		}
+		}
+		return;
+	}
+
+	// x == 3
+	switch (z) {
+	case 0:
+		if (Cond(y)) { regs.pc = Pop(); }
+		break;
+	case 1:
+		if (q == 0) {
+			uint16_t v = Pop();
+			if (p == 3) { regs.a = (uint8_t)(v >> 8); regs.f = (uint8_t)v; }
+			else { SetRP(p, v); }
+		}
+		else if (p == 0) { regs.pc = Pop(); }
+		else if (p == 1) {
+			uint8_t t;
+			t = regs.b; regs.b = regs.b_; regs.b_ = t;
+			t = regs.c; regs.c = regs.c_; regs.c_ = t;
+			t = regs.d; regs.d = regs.d_; regs.d_ = t;
+			t = regs.e; regs.e = regs.e_; regs.e_ = t;
+			t = regs.h; regs.h = regs.h_; regs.h_ = t;
+			t = regs.l; regs.l = regs.l_; regs.l_ = t;
+		}
+		else if (p == 2) { regs.pc = HL(); }
+		else { regs.sp = HL(); }
+		break;
+	case 2: {
+		uint16_t nn = Imm16();
+		if (Cond(y)) { regs.pc = nn; }
+		break;
+	}
+	case 3:
+		switch (y) {
+		case 0: regs.pc = Imm16(); break;
+		case 2: {
+			uint8_t n = Imm();
+			bus->Out(Pair(regs.a, n), regs.a);
+			break;
+		}
+		case 3: {
+			uint8_t n = Imm();
+			regs.a = bus->In(Pair(regs.a, n));
+			break;
+		}
+		case 4: {
+			uint16_t v = Read16(regs.sp);
+			uint16_t hl = HL();
+			bus->Write((uint16_t)(regs.sp + 1), (uint8_t)(hl >> 8));
+			bus->Write(regs.sp, (uint8_t)hl);
+			SetHL(v);
+			break;
+		}
+		case 5: {
+			uint8_t t;
+			t = regs.d; regs.d = regs.h; regs.h = t;
+			t = regs.e; regs.e = regs.l; regs.l = t;
+			break;
+		}
+		case 6: regs.iff1 = regs.iff2 = 0; break;
+		case 7: regs.iff1 = regs.iff2 = 1; break;
+		}
+		break;
+	case 4: {
+		uint16_t nn = Imm16();
+		if (Cond(y)) {
+			Push(regs.pc);
+			regs.pc = nn;
+		}
+		break;
+	}
+	case 5:
+		if (q == 0) {
+			Push(p == 3 ? Pair(regs.a, regs.f) : RP(p));
+		}
+		else {
+			uint16_t nn = Imm16();
+			Push(regs.pc);
+			regs.pc = nn;
+		}
+		break;
+	case 6:
+		Alu(y, Imm());
+		break;
+	default:
+		Push(regs.pc);
+		regs.pc = (uint16_t)(y * 8);
+		break;
+	}
+}
+
+void SimZ80::ExecCB(uint8_t op, bool indexed, uint16_t addr) {
+	int x = op >> 6;
+	int y = (op >> 3) & 7;
+	int z = op & 7;
+	bool mem = indexed || z == 6;
+	if (mem && !indexed) { addr = Pair(regs.h, regs.l); }
+	uint8_t v = mem ? bus->Read(addr) : *r8[0][z];
+	uint8_t r;
+
+	if (x == 1) {
+		// BIT: X/Y come from the address high byte for memory operands
+		uint8_t xy = mem ? (uint8_t)(addr >> 8) : v;
+		regs.f = (uint8_t)((regs.f & FC) | FH | (xy & (FX | FY)));
+		if (!(v & (1 << y))) { regs.f |= FZ | FP; }
+		else if (y == 7) { regs.f |= FS; }
+		return;
+	}
+	if (x == 0) { r = Rot(y, v); }
+	else if (x == 2) { r = (uint8_t)(v & ~(1 << y)); }
+	else { r = (uint8_t)(v | (1 << y)); }
+
+	if (mem) {
+		bus->Write(addr, r);
+		// DD CB d op with a register field also copies the result there
+		if (indexed && z != 6) { *r8[0][z] = r; }
+	}
+	else {
+		*r8[0][z] = r;
+	}
+}
+
+void SimZ80::ExecED(uint8_t op) {
+	int x = op >> 6;
+	int y = (op >> 3) & 7;
+	int z = op & 7;
+	int p = y >> 1;
+	int q = y & 1;
+
+	if (x == 2 && z <= 3 && y >= 4) {
+		ExecBlock(y, z);
+		return;
+	}
+	if (x != 1) { return; }	// the rest are two byte NOPs
+
+	switch (z) {
+	case 0: {
+		uint8_t v = bus->In(Pair(regs.b, regs.c));
+		if (y != 6) { *r8[0][y] = v; }
+		regs.f = (uint8_t)((regs.f & FC) | sz53p[v]);
+		break;
+	}
+	case 1:
+		bus->Out(Pair(regs.b, regs.c), y == 6 ? 0 : *r8[0][y]);
+		break;
+	case 2:
+		SetHL(q ? Adc16(HL(), RP(p)) : Sbc16(HL(), RP(p)));
+		break;
+	case 3: {
+		uint16_t nn = Imm16();
+		if (q) { SetRP(p, Read16(nn)); }
+		else { Write16(nn, RP(p)); }
+		break;
+	}
+	case 4: {
+		uint8_t a = regs.a;
+		regs.a = 0;
+		Alu(2, a);
+		break;
+	}
+	case 5:
+		// RETN and RETI both restore IFF1
+		regs.pc = Pop();
+		regs.iff1 = regs.iff2;
+		break;
+	case 6: {
+		static const uint8_t modes[8] = { 0, 0, 1, 2, 0, 0, 1, 2 };
+		regs.im = modes[y];
+		break;
+	}
+	default:
+		switch (y) {
+		case 0: regs.i = regs.a; break;
+		case 1: regs.r = regs.a; break;
+		case 2:
+		case 3:
+			regs.a = y == 2 ? regs.i : regs.r;
+			regs.f = (uint8_t)((regs.f & FC) | sz53[regs.a] | (regs.iff2 ? FP : 0));
+			break;
+		case 4:
+		case 5: {
+			uint16_t hl = Pair(regs.h, regs.l);
+			uint8_t v = bus->Read(hl);
+			if (y == 4) {
+				bus->Write(hl, (uint8_t)((regs.a << 4) | (v >> 4)));
+				regs.a = (uint8_t)((regs.a & 0xF0) | (v & 0x0F));
+			}
+			else {
+				bus->Write(hl, (uint8_t)((v << 4) | (regs.a & 0x0F)));
+				regs.a = (uint8_t)((regs.a & 0xF0) | (v >> 4));
+			}
+			regs.f = (uint8_t)((regs.f & FC) | sz53p[regs.a]);
+			break;
+		}
+		}
+		break;
+	}
+}
+
+// LDI CPI INI OUTI and their D / R / DR forms, one iteration per Step()
+void SimZ80::ExecBlock(int y, int z) {
+	int dir = (y & 1) ? -1 : 1;
+	bool repeat = y >= 6;
+	uint16_t hl = Pair(regs.h, regs.l);
+	uint16_t bc = Pair(regs.b, regs.c);
+
+	switch (z) {
+	case 0: {
+		uint8_t v = bus->Read(hl);
+		uint16_t de = Pair(regs.d, regs.e);
+		bus->Write(de, v);
+		SetRP(1, (uint16_t)(de + dir));
+		SetRP(0, --bc);
+		uint8_t n = (uint8_t)(v + regs.a);
+		regs.f = (uint8_t)((regs.f & (FS | FZ | FC)) | (bc ? FP : 0) | (n & FX) | ((n << 4) & FY));
+		if (repeat && bc) { regs.pc -= 2; }
+		break;
+	}
+	case 1: {
+		uint8_t v = bus->Read(hl);
+		uint8_t r = (uint8_t)(regs.a - v);
+		uint8_t h = (regs.a ^ v ^ r) & FH;
+		uint8_t n = (uint8_t)(r - (h ? 1 : 0));
+		SetRP(0, --bc);
+		regs.f = (uint8_t)((regs.f & FC) | FN | h | (sz53[r] & (FS | FZ)) | (bc ? FP : 0) | (n & FX) | ((n << 4) & FY));
+		if (repeat && bc && r) { regs.pc -= 2; }
+		break;
+	}
+	case 2: {
+		uint8_t v = bus->In(bc);
+		bus->Write(hl, v);
+		regs.b--;
+		unsigned k = v + (uint8_t)(regs.c + dir);
+		regs.f = (uint8_t)(sz53[regs.b] | ((v & 0x80) ? FN : 0) | (k > 0xFF ? FH | FC : 0) | (sz53p[(k & 7) ^ regs.b] & FP));
+		if (repeat && regs.b) { regs.pc -= 2; }
+		break;
+	}
+	default: {
+		uint8_t v = bus->Read(hl);
+		regs.b--;
+		bus->Out(Pair(regs.b, regs.c), v);
+		unsigned k = v + (uint8_t)(hl + dir);
+		regs.f = (uint8_t)(sz53[regs.b] | ((v & 0x80) ? FN : 0) | (k > 0xFF ? FH | FC : 0) | (sz53p[(k & 7) ^ regs.b] & FP));
+		if (repeat && regs.b) { regs.pc -= 2; }
+		break;
+	}
+	}
+	SetRP(2, (uint16_t)(hl + dir));
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+
+// Reference Z80 instruction interpreter
+//
+// A plain C++ Z80 with no memory of its own: every opcode fetch, memory
+// access and port access goes through a SimZ80_Bus, in the same order a
+// real Z80 puts them on its bus. That lets the lockstep checker feed it
+// the cycles the RTL CPU actually made and compare what comes back.
+//
+// Step() runs one whole instruction, prefixes included. Interrupts are not
+// sampled here: the caller decides when one was accepted (from the
+// acknowledge cycle on the bus) and calls Interrupt() or Nmi().
+
+#define Z80_FLAG_C 0x01
+#define Z80_FLAG_N 0x02
+#define Z80_FLAG_P 0x04
+#define Z80_FLAG_X 0x08
+#define Z80_FLAG_H 0x10
+#define Z80_FLAG_Y 0x20
+#define Z80_FLAG_Z 0x40
+#define Z80_FLAG_S 0x80
+
+struct SimZ80_Bus {
+public:
+	virtual uint8_t Fetch(uint16_t addr) = 0;	// M1 opcode fetch
+	virtual uint8_t Read(uint16_t addr) = 0;
+	virtual void Write(uint16_t addr, uint8_t data) = 0;
+	virtual uint8_t In(uint16_t port) = 0;
+	virtual void Out(uint16_t port, uint8_t data) = 0;
+	virtual ~SimZ80_Bus() {}
+};
+
+struct SimZ80_Regs {
+public:
+	uint8_t a, f, b, c, d, e, h, l;
+	uint8_t a_, f_, b_, c_, d_, e_, h_, l_;
+	uint8_t ixh, ixl, iyh, iyl;
+	uint16_t sp, pc;
+	uint8_t i, r;
+	uint8_t iff1, iff2, im;
+	bool halted;
+};
+
+struct SimZ80 {
+public:
+	SimZ80_Regs regs;
+	SimZ80_Bus* bus;
+
+	void Reset();
+	void Step();
+	void Interrupt(uint8_t data);
+	void Nmi();
+
+	SimZ80();
+
+private:
+	uint8_t* r8[3][8];	// B C D E H L - A, plain / DD / FD
+	int index;			// 0, 1 = IX, 2 = IY for the current instruction
+
+	uint8_t Fetch();
+	uint8_t Imm();
+	uint16_t Imm16();
+	uint16_t Read16(uint16_t addr);
+	void Write16(uint16_t addr, uint16_t v);
+	void Push(uint16_t v);
+	uint16_t Pop();
+
+	uint16_t Pair(uint8_t hi, uint8_t lo) { return (uint16_t)((hi << 8) | lo); }
+	uint16_t HL();
+	void SetHL(uint16_t v);
+	uint16_t RP(int p);
+	void SetRP(int p, uint16_t v);
+	uint16_t MemAddr();
+	bool Cond(int y);
+
+	uint8_t Inc8(uint8_t v);
+	uint8_t Dec8(uint8_t v);
+	void Alu(int op, uint8_t v);
+	uint16_t Add16(uint16_t a, uint16_t v);
+	uint16_t Adc16(uint16_t a, uint16_t v);
+	uint16_t Sbc16(uint16_t a, uint16_t v);
+	uint8_t Rot(int op, uint8_t v);
+	void Daa();
+
+	void ExecMain(uint8_t op);
+	void ExecCB(uint8_t op, bool indexed, uint16_t addr);
+	void ExecED(uint8_t op);
+	void ExecBlock(int y, int z);
+};
+
+// For bus watchers that find instruction starts from the M1 fetches: true
+// when the opcode byte just fetched is a prefix, so the next M1 fetch is
+// not a new instruction. 'last' is the previous prefix byte (0 = none) and
+// is updated. The byte after CB or ED is the opcode proper even when it
+// looks like a prefix (CB CB is SET 1,E). DD/FD CB d op fetches d and op
+// as plain reads, so a watcher resets last to 0 and its pending flag on
+// any read that is not an opcode fetch.
+inline bool sim_z80_prefix(uint8_t& last, uint8_t op) {
+	bool prefix = last != 0xCB && last != 0xED && (op == 0xCB || op == 0xDD || op == 0xED || op == 0xFD);
+	last = prefix ? op : 0;
+	return prefix;
+}
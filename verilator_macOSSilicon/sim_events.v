@@ -0,0 +1,78 @@
+`timescale 1ns/1ns
+
+// Sim only event probes
+//
+// Watches a handful of signals and calls sim_event() on the host when
+// something interesting happens. Each event is a kind plus two integer
+// arguments; the host timestamps it and keeps it in a ring buffer
+// (sim/sim_events.cpp), so nothing is formatted while the model runs.
+// Kinds must match SIM_EVENT_* in sim/sim_events.h.
+
+module sim_events (
+    input        clk,
+    input        reset,
+
+    // Downloads
+    input        ioctl_download,
+    input        ioctl_wr,
+    input  [7:0] ioctl_index,
+    input        download_started,
+    input [24:0] download_addr,
+    input        plus_download,
+    input        plus_valid,
+
+    // ASIC
+    input  [1:0] acid_state,
+    input  [4:0] acid_seq_index,
+    input  [2:0] dma_status,
+    input        asic_ram_we,
+    input [13:0] asic_ram_waddr,
+    input  [7:0] asic_ram_wdata,
+    input  [7:0] sprite_collision
+);
+
+import "DPI-C" function void sim_event(input int kind, input int a, input int b);
+
+localparam EV_DOWNLOAD_START   = 0;
+localparam EV_DOWNLOAD_DONE    = 1;
+localparam EV_RESET            = 2;
+localparam EV_ACID_STATE       = 3;
+localparam EV_DMA_START        = 4;
+localparam EV_PALETTE_WRITE    = 5;
+localparam EV_SPRITE_COLLISION = 6;
+
+reg        old_download = 0;
+reg        old_reset = 0;
+reg  [1:0] old_acid_state = 0;
+reg  [2:0] old_dma_status = 0;
+reg        old_asic_ram_we = 0;
+reg  [7:0] old_sprite_collision = 0;
+
+always @(posedge clk) begin
+    old_download <= ioctl_download;
+    old_reset <= reset;
+    old_acid_state <= acid_state;
+    old_dma_status <= dma_status;
+    old_asic_ram_we <= asic_ram_we;
+    old_sprite_collision <= sprite_collision;
+
+    if (ioctl_download && ioctl_wr && !download_started)
+        sim_event(EV_DOWNLOAD_START, {24'd0, ioctl_index}, 0);
+    if (old_download && !ioctl_download)
+        sim_event(EV_DOWNLOAD_DONE, {7'd0, download_addr}, {30'd0, plus_download, plus_valid});
+    if (reset && !old_reset)
+        sim_event(EV_RESET, 0, 0);
+
+    if (acid_state != old_acid_state)
+        sim_event(EV_ACID_STATE, {30'd0, acid_state}, {27'd0, acid_seq_index});
+    if (dma_status & ~old_dma_status)
+        sim_event(EV_DMA_START, {29'd0, dma_status & ~old_dma_status}, {29'd0, dma_status});
+    // Palette is 6400-643F in the ASIC page, 2400-243F in ASIC RAM; a write
+    // is reported by its CPU address with the byte that was stored
+    if (asic_ram_we && !old_asic_ram_we && asic_ram_waddr >= 14'h2400 && asic_ram_waddr < 14'h2440)
+        sim_event(EV_PALETTE_WRITE, {16'd0, 2'b01, asic_ram_waddr}, {24'd0, asic_ram_wdata});
+    if (sprite_collision != old_sprite_collision && sprite_collision != 0)
+        sim_event(EV_SPRITE_COLLISION, {24'd0, sprite_collision}, {24'd0, old_sprite_collision});
+end
+
+endmodule
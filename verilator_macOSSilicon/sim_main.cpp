@@ -19,6 +19,23 @@
 #include "sim_audio.h"
 #include "sim_input.h"
 #include "sim_clock.h"
+#include "sim_sdram.h"
+#include "sim_fork.h"
+#include "sim_events.h"
+#include "sim_breakpoints.h"
+#include "sim_expr.h"
+#include "sim_signals.h"
+#include "sim_pacer.h"
+#include "sim_analyzer.h"
+#include "sim_lockstep.h"
+#include "sim_fastfwd.h"
+#include "sim_amstrad.h"
+#include "sim_control.h"
+#include "sim_gdb.h"
+#include "sim_watchdog.h"
+#include "sim_cache.h"
+#include "sim_bisect.h"
+#include "sim_diff.h"
 
 #include "../imgui/imgui_memory_editor.h"
 #include <verilated_fst_c.h> // FST Trace
@@ -26,6 +43,10 @@
 
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <stdarg.h>
 using namespace std;
 
 // Simulation control
@@ -36,6 +57,53 @@ int batchSize   = 150000;
 bool single_step = 0;
 bool multi_step  = 0;
 int  multi_step_amount = 1024;
+bool stop_requested = false;	// set by breakpoints / run until, ends the current batch
+
+// Batch sizing: how much to simulate per GUI frame
+#define BATCH_FIXED    0	// batchSize verilate() calls
+#define BATCH_ADAPTIVE 1	// batchSize tuned to keep the GUI frame near batch_target_ms
+#define BATCH_FRAMES   2	// batch_frames emulated frames (vsyncs)
+#define BATCH_REALTIME 3	// emulated frames paced to 50Hz wall clock, Tab = turbo
+const char* batch_mode_names[] = { "Fixed cycles", "Adaptive", "Emulated frames", "Real time 50Hz" };
+int   batch_mode = BATCH_FIXED;
+float batch_target_ms = 16.7f;
+int   batch_frames = 1;
+int   batch_frame_limit = 4000000;	// verilate() calls per frame before giving up
+double batch_sim_ms = 0;	// time spent in the last batch
+double gui_frame_ms = 0;	// time between the last two GUI frames
+double gui_frame_start = 0;
+SimPacer pacer(50.0);
+bool turbo = false;		// unthrottled while in real time mode (held Tab or checkbox)
+bool turbo_lock = false;
+
+// Headless runs
+// -------------
+bool headless = false;
+int  headless_boot_frames = 0;
+int  headless_run_frames = 100;
+vluint64_t headless_max_cycles = 0;	// 0 = no limit
+const char* fork_variants = NULL;
+int  fork_jobs = 0;	// 0 = one per core
+std::vector<std::string> load_files;
+const char* record_input = NULL;
+const char* play_input = NULL;
+std::string autotype_text;
+const char* until_text = NULL;
+const char* shm_name = NULL;	// export frames to POSIX shared memory for viewers
+int  shm_slots = 3;
+bool lockstep_start = false;	// check the CPU against the reference Z80 from the start
+const char* fastfwd_text = NULL;	// boot through the C++ model up to this checkpoint
+const char* load_sna = NULL;		// hand this snapshot to the RTL once it is out of reset
+const char* save_sna = NULL;		// snapshot the RTL at the end of a headless run
+const char* control_path = NULL;	// JSON-lines control socket, "-" for stdin
+const char* gdb_address = NULL;		// GDB remote stub: TCP port or UNIX socket path
+std::string hang_save = "hang";		// hung runs save <prefix>.sav and <prefix>.ppm
+const char* cache_dir = NULL;		// answer repeated headless runs from here
+const char* bisect_text = NULL;		// find the first cycle this holds at
+const char* golden_file = NULL;		// ... or the first frame that differs from these hashes
+vluint64_t bisect_every = AMSTRAD_CLK_SYS / 50;	// checkpoint spacing, about a frame
+std::string bisect_save = "bisect.sav";
+const char* diff_files[2] = { NULL, NULL };	// compare two saved states and exit
 
 // Debug GUI 
 // ---------
@@ -45,17 +113,38 @@ const char* windowTitle_DebugLog = "Debug log";
 const char* windowTitle_Video = "VGA output";
 const char* windowTitle_Trace = "Trace/FST control";
 const char* windowTitle_Audio = "Audio output";
+const char* windowTitle_Events = "RTL events";
+const char* windowTitle_Breakpoints = "Breakpoints";
+const char* windowTitle_Watch = "Watch";
+const char* windowTitle_Analyzer = "Logic analyzer";
+const char* windowTitle_Lockstep = "CPU lockstep";
+const char* windowTitle_FastForward = "Fast-forward";
+char InputLog_File[64] = "input.log";
+char AutoType_Text[128] = "run\\\"disc\\n";
+char RunUntil_Text[128] = "asic_inst.acid_inst.state == 2";
 bool  showDebugLog = true;
+bool  showEvents = true;
+bool  showBreakpoints = true;
+bool  showWatch = true;
+bool  showAnalyzer = false;
+bool  showLockstep = false;
+bool  showFastForward = false;
 DebugConsole console;
 MemoryEditor mem_edit;
 
+// The model
+// ---------
+// Vtop plus its bus, video, audio, input and SDRAM; the names below are the
+// parts of it the GUI and tools use
+AmstradSim amstrad;
+
 // HPS emulator
 // ------------
-SimBus bus(console);
+SimBus& bus = amstrad.bus;
 
 // Input handling
 // --------------
-SimInput input(12);
+SimInput& input = amstrad.input;
 const int input_right   = 0;
 const int input_left    = 1;
 const int input_down    = 2;
@@ -71,27 +160,120 @@ const int input_pause   = 11;
 
 // Video
 // -----
-#define VGA_ROTATE 0
-#define VGA_WIDTH  320
-#define VGA_HEIGHT 200
 #define VGA_SCALE_X vga_scale
 #define VGA_SCALE_Y vga_scale
-SimVideo video(VGA_WIDTH, VGA_HEIGHT, VGA_ROTATE);
+SimVideo& video = amstrad.video;
 float vga_scale = 2;
 
 // Verilog module
 // --------------
 Vtop* top = NULL;
 
-// Main simulation time in Verilator
-vluint64_t main_time = 0;
-double sc_time_stamp() {
-    return main_time;
+// SDRAM
+// -----
+// Built with SDRAM=dpi the 8MB RAM is host side (rtl/mock_sdram_dpi.v)
+#ifdef SIM_SDRAM_DPI
+SimSDRAM& sdram = amstrad.sdram;
+ImU8 sdram_read(const ImU8* data, size_t off) { return ((SimSDRAM*)data)->Read((uint32_t)off); }
+void sdram_write(ImU8* data, size_t off, ImU8 d) { ((SimSDRAM*)data)->Write((uint32_t)off, d); }
+#else
+uint8_t* model_ram = NULL;		// sdram.ram inside the model, found by name in main()
+#endif
+uint8_t* asic_ram = NULL;		// asic_inst.asic_ram
+
+// RTL event probes (sim_events.v)
+// ---------------
+SimEvents& events = amstrad.events;
+
+// Breakpoints
+// -----------
+SimBreakpoints breakpoints;
+
+// Signal lookup
+// -------------
+SimSignals& signals = amstrad.signals;
+
+// A byte array in the model by name, NULL if it is not public or too small
+uint8_t* find_memory(const char* name, int size) {
+	const SimSignal* s = signals.Get(name);
+	if (!s || s->bytes != 1 || s->elements < size) { return NULL; }
+	return (uint8_t*)s->ptr;
+}
+
+// Logic analyzer
+// --------------
+SimAnalyzer analyzer;
+
+// CPU lockstep against the reference Z80
+// --------------------------------------
+SimLockstep lockstep;
+
+// Fast-forward through the C++ model, then hand off to the RTL
+// ------------------------------------------------------------
+SimFastForward fastfwd;
+
+// Scripted control
+// ----------------
+SimControl control;
+bool control_quit = false;
+
+// GDB remote stub
+// ----------------
+SimGdb gdb;
+
+// Hang detection
+// --------------
+SimWatchdog watchdog;
+
+// Headless result cache
+// ---------------------
+SimCache cache;
+
+// Golden frame hashes for --bisect-golden
+// ---------------------------------------
+std::vector<uint64_t> golden_hashes;
+int golden_checked = 0;
+int golden_bad = 0;		// first frame that differed, sticky
+
+// Compare the frame just completed against the golden run
+void check_golden() {
+	golden_checked = video.count_frame;
+	int i = golden_checked - 1;
+	if (!golden_bad && i >= 0 && i < (int)golden_hashes.size() && golden_hashes[i] != video.frame_hash) { golden_bad = golden_checked; }
 }
 
-int  clk_sys_freq = 64000000;
-SimClock clk_48(1); 
-//SimClock clk_24(2); 
+// Debug panel contents, resolved by name through signals
+const char* cpu_control[] = { "motherboard.M1_n", "motherboard.MREQ_n", "motherboard.IORQ_n", "motherboard.INT_n",
+	"motherboard.RD_n", "motherboard.WR_n" };
+const char* cpu_data[] = { "motherboard.cpu_addr", "motherboard.cpu_dout", "motherboard.cpu_din" };
+const char* cpu_status[] = { "RESET" };
+const char* crtc_internal[] = { "motherboard.CRTC.RS", "motherboard.CRTC.DO", "motherboard.CRTC.DI" };
+const char* crtc_regs[] = { "motherboard.CRTC.R0_h_total", "motherboard.CRTC.R1_h_displayed", "motherboard.CRTC.R2_h_sync_pos",
+	"motherboard.CRTC.R3_v_sync_width", "motherboard.CRTC.R3_h_sync_width", "motherboard.CRTC.R4_v_total",
+	"motherboard.CRTC.R5_v_total_adj", "motherboard.CRTC.R6_v_displayed", "motherboard.CRTC.R7_v_sync_pos",
+	"motherboard.CRTC.R8_skew", "motherboard.CRTC.R8_interlace", "motherboard.CRTC.R9_v_max_line",
+	"motherboard.CRTC.R10_cursor_mode", "motherboard.CRTC.R10_cursor_start", "motherboard.CRTC.R11_cursor_end",
+	"motherboard.CRTC.R12_start_addr_h", "motherboard.CRTC.R13_start_addr_l", "motherboard.CRTC.R14_cursor_h",
+	"motherboard.CRTC.R15_cursor_l" };
+const char* asic_general[] = { "asic_inst.rmr2", "asic_inst.plus_bios_valid", "asic_inst.pri_irq", "asic_inst.asic_video_active",
+	"asic_inst.config_mode", "asic_inst.mrer_mode", "asic_inst.asic_mode", "asic_inst.asic_enabled" };
+const char* asic_acid[] = { "asic_inst.acid_inst.state", "asic_inst.acid_inst.seq_index", "asic_inst.acid_inst.status_reg",
+	"asic_inst.acid_inst.next_byte", "asic_inst.acid_inst.unlock_addr" };
+const char* asic_dma[] = { "asic_inst.dma_status_audio", "asic_inst.dma_irq_audio" };
+const char* asic_control_regs[] = { "asic_inst.asic_control", "asic_inst.asic_config", "asic_inst.asic_version" };
+const char* asic_video_regs[] = { "asic_inst.video_control", "asic_inst.video_status", "asic_inst.video_config",
+	"asic_inst.video_palette", "asic_inst.video_effect" };
+const char* asic_sprite_regs[] = { "asic_inst.sprite_control", "asic_inst.sprite_status", "asic_inst.sprite_config",
+	"asic_inst.sprite_priority", "asic_inst.sprite_collision" };
+const char* asic_audio_regs[] = { "asic_inst.audio_control", "asic_inst.audio_config", "asic_inst.audio_volume" };
+
+// Run until
+// ---------
+SimExpr run_until;
+bool run_until_active = false;
+
+// Main simulation time in Verilator
+vluint64_t& main_time = amstrad.main_time;
 
 // FST trace logging
 // -----------------
@@ -104,150 +286,768 @@ char Trace_File_tmp[30] = "sim.fst";
 int  iTrace_Deep_tmp = 99;
 char SaveModel_File_tmp[20] = "test", SaveModel_File[20] = "test";
 
+static bool file_exists(const std::string& file) {
+	FILE* f = fopen(file.c_str(), "rb");
+	if (f) { fclose(f); }
+	return f != NULL;
+}
+
 //Trace Save/Restore
-void save_model(const char* filenamep) {
+// With SDRAM=dpi a save also names its base: empty for a full save, which
+// becomes the base for later ones, or the last full save for a delta save
+// (save_model(file, true)) that only holds the SDRAM pages written since.
+#ifdef SIM_SDRAM_DPI
+std::string sdram_base;
+#endif
+void save_model(const char* filenamep, bool delta = false) {
 	VerilatedSave os;
 	os.open(filenamep);
 	os << main_time; // user code must save the timestamp, etc
+#ifdef SIM_SDRAM_DPI
+	if (delta && sdram_base.empty()) { console.AddLog("No full save to base %s on, saving it whole", filenamep); }
+	std::string base = delta ? sdram_base : "";
+	os << base;
+#endif
 	os << *top;
+#ifdef SIM_SDRAM_DPI
+	sdram.Save(os, !base.empty());
+	if (base.empty()) {
+		sdram.ClearDirty();
+		sdram_base = filenamep;
+	}
+#endif
 }
-void restore_model(const char* filenamep) {
+// False if the save cannot be restored. A missing or broken base is found
+// before anything changes; SDRAM pages that are not ours are only found
+// after the model, so then the state is half restored.
+bool restore_model(const char* filenamep) {
 	VerilatedRestore os;
 	os.open(filenamep);
-	os >> main_time;
+	vluint64_t time;
+	os >> time;
+#ifdef SIM_SDRAM_DPI
+	std::string base;
+	os >> base;
+	if (!base.empty()) {
+		if (!file_exists(base)) {
+			console.AddLog("[error] %s needs its base %s", filenamep, base.c_str());
+			return false;
+		}
+		if (!restore_model(base.c_str())) { return false; }
+	}
+#endif
 	os >> *top;
+#ifdef SIM_SDRAM_DPI
+	if (!sdram.Restore(os)) {
+		console.AddLog("[error] %s: SDRAM pages are not from this build", filenamep);
+		return false;
+	}
+	if (base.empty()) {
+		sdram.ClearDirty();
+		sdram_base = filenamep;
+	}
+#endif
+	main_time = time;
+	return true;
 }
 
 // Audio
 // -----
 //#define DISABLE_AUDIO
 #ifndef DISABLE_AUDIO
-SimAudio audio(clk_sys_freq, true);
+SimAudio& audio = amstrad.audio;
 #endif
 
 // Reset simulation variables and clocks
 void resetSim() {
-	main_time = 0;
-	clk_48.Reset();
-	//clk_24.Reset();
+	amstrad.Reset();
+}
+
+// Debugger hooks, called by the model on every rising edge after the bus
+void sim_rising(void* data) {
+	if (breakpoints.Check()) { stop_requested = true; }
+	analyzer.Sample();
+	if (lockstep.Check()) { stop_requested = true; }
+	fastfwd.Check();
+	if (gdb.Check()) { stop_requested = true; }
+	if (watchdog.Check()) { stop_requested = true; }
+	cache.Frame(video.count_frame, video.frame_hash);
+	if (!golden_hashes.empty() && video.count_frame != golden_checked) { check_golden(); }
+	if (run_until_active && run_until.Eval()) {
+		run_until_active = false;
+		stop_requested = true;
+		console.AddLog("Run until hit: %s at %llu", run_until.text.c_str(), (unsigned long long)main_time);
+	}
+
+	// FST trace dump
+	if (Trace) {
+		if (!tfp->isOpen()) {
+			tfp->open(Trace_File); // open if not already
+		}
+		tfp->dump(main_time);
+	}
 }
 
 //-----------------------------------------------------------------------
 // The primary simulation step function (fixed version)
 //-----------------------------------------------------------------------
 int verilate() {
-	if (!Verilated::gotFinish()) {
+	if (amstrad.Step()) { return 1; }
 
-		// Assert reset during startup
-		//top->reset = 0;
-		//if (main_time < initialReset) {
-		//	top->reset = 1;
-		//}
-		//if (main_time == initialReset) {
-		//	top->reset = 0;
-		//}
+	// If Verilator thinks we are finished, stop & cleanup (the model goes with amstrad)
+	tfp->close();
+	exit(0);
+	return 0;
+}
 
-		// 1) Tick the clock dividers every call
-		clk_48.Tick();
-		//clk_24.Tick();
+//-----------------------------------------------------------------------
+// GUI batches
+//-----------------------------------------------------------------------
 
-		// 2) Drive those clocks into the DUT
-		top->clk_48 = clk_48.clk;
-		//top->clk_24 = clk_24.clk;
+double now_ms() {
+	return SimPacer::Now();
+}
 
-		// 3) We can do host "BeforeEval" tasks on the rising edge
-		//    (e.g. CPU debug hooking, input sampling, etc.)
-		if (clk_48.IsRising()) {
-			// Possibly do "HPS" or "host" tasks here
-			input.BeforeEval();
-			bus.BeforeEval();
+// Run until 'frames' more vsyncs, giving up after batch_frame_limit calls each
+int run_gui_frames(int frames) {
+	int target = video.count_frame + frames;
+	int limit = batch_frame_limit * frames;
+	int steps = 0;
+	while (video.count_frame < target && steps < limit && !stop_requested) {
+		verilate();
+		steps++;
+	}
+	return steps;
+}
 
+// One GUI frame's worth of simulation, sized by batch_mode
+void run_batch() {
+	double start = now_ms();
+	int steps = 0;
+	if (batch_mode == BATCH_REALTIME && turbo) {
+		// Fast forward: as much as fits in the GUI frame budget
+		pacer.Stop();
+		while (now_ms() - start < batch_target_ms && !stop_requested) {
+			for (int i = 0; i < 10000 && !stop_requested; i++) { verilate(); }
 		}
+	}
+	else if (batch_mode == BATCH_REALTIME) {
+		int due = pacer.FramesDue(video.count_frame);
+		if (due) { run_gui_frames(due); }
+		else {
+			// Ahead of the wall clock: give the time back instead of spinning
+			double wait = pacer.MsUntilNext(video.count_frame);
+			if (wait > 1.0) { std::this_thread::sleep_for(std::chrono::microseconds((long long)((wait < 10.0 ? wait : 10.0) * 1000.0) - 500)); }
+		}
+	}
+	else if (batch_mode == BATCH_FRAMES) {
+		steps = run_gui_frames(batch_frames);
+	}
+	else {
+		for (; steps < batchSize && !stop_requested; steps++) {
+			verilate();
+		}
+	}
+	double sim_ms = now_ms() - start;
+
+	// Scale the batch so sim time fills what the GUI leaves of the budget.
+	// Only full batches are measured, and the step is limited to 2x either
+	// way so one slow frame (file dialog, trace open) doesn't swing it.
+	if (batch_mode == BATCH_ADAPTIVE && steps == batchSize && sim_ms > 0.01) {
+		double other_ms = gui_frame_ms - batch_sim_ms;
+		if (other_ms < 0) { other_ms = 0; }
+		double budget = batch_target_ms - other_ms;
+		if (budget < 1) { budget = 1; }
+		double scale = budget / sim_ms;
+		if (scale < 0.5) { scale = 0.5; }
+		if (scale > 2.0) { scale = 2.0; }
+		batchSize = (int)(batchSize * scale);
+		if (batchSize < 100) { batchSize = 100; }
+		if (batchSize > 5000000) { batchSize = 5000000; }
+	}
+	batch_sim_ms = sim_ms;
+}
 
-		// 4) Evaluate the design on *every* call (both edges)
-		top->eval_step();
+//-----------------------------------------------------------------------
+// Headless regression runs
+//-----------------------------------------------------------------------
 
-		// 5) If it's the rising edge, do "AfterEval" tasks,
-		//    audio sampling, VCD dump, etc.
-		if (clk_48.IsRising()) {
-			// Possibly do "AfterEval" tasks
-			bus.AfterEval();
+// Run until another 'frames' frames have completed or a breakpoint or run
+// until condition stops the sim. Gives up after max_cycles rising edges
+// (0 = no limit) and returns false.
+bool run_frames(int frames, vluint64_t max_cycles) {
+	int target = video.count_frame + frames;
+	vluint64_t end = main_time + max_cycles;
+	stop_requested = false;
+	while (video.count_frame < target && !stop_requested) {
+		if (max_cycles && main_time >= end) { return false; }
+		verilate();
+	}
+	return true;
+}
 
-#ifndef DISABLE_AUDIO
-			audio.Clock(top->AUDIO_L, top->AUDIO_R);
+// Queue a "file[:index]" download, index defaults to 5 (CPR)
+void queue_load(std::string spec) {
+	size_t colon = spec.rfind(':');
+	if (colon == std::string::npos || colon == 0) {
+		bus.QueueDownload(spec, 5, true);
+	}
+	else {
+		bus.QueueDownload(spec.substr(0, colon), atoi(spec.substr(colon + 1).c_str()), true);
+	}
+}
+
+// Expand \n (Enter) and \" in typed text
+std::string unescape_text(std::string text) {
+	std::string out;
+	for (size_t i = 0; i < text.size(); i++) {
+		if (text[i] == '\\' && i + 1 < text.size() && text[i + 1] == 'n') { out += '\n'; i++; }
+		else if (text[i] == '\\' && i + 1 < text.size() && text[i + 1] == '"') { out += '"'; i++; }
+		else { out += text[i]; }
+	}
+	return out;
+}
+
+// Names usable in run until expressions: any public signal by its dotted
+// path (e.g. asic_inst.acid_inst.state), plus the host variables added to
+// signals in main()
+bool resolve_signal(const std::string& name, SimExpr_Signal& signal) {
+	const SimSignal* s = signals.Get(name);
+	if (!s || s->elements != 1 || s->bytes > 8) { return false; }
+	signal.ptr = s->ptr;
+	signal.bytes = s->bytes;
+	return true;
+}
+
+// Arm the run until condition, false if it does not compile
+bool start_run_until(const std::string& text) {
+	run_until_active = run_until.Compile(text, resolve_signal);
+	if (!run_until_active) { console.AddLog("[error] Run until: %s", run_until.error.c_str()); }
+	return run_until_active;
+}
+
+// Headless results: printed, and kept for the cache entry
+void report_line(const char* fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int length = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+	if (length < 0) { return; }
+	std::string text(length + 1, '\0');
+	va_start(args, fmt);
+	vsnprintf(&text[0], text.size(), fmt, args);
+	va_end(args);
+	text.resize(length);
+	fputs(text.c_str(), stdout);
+	if (cache.recording) { cache.entry.report += text; }
+}
+
+// The watchdog fired: say why and keep the model state and screen for a
+// look later. Exit status 3 tells a hang from other failures.
+int report_hang(std::string name) {
+	std::string prefix = name.empty() ? hang_save : hang_save + "-" + name;
+	save_model((prefix + ".sav").c_str());
+	video.SaveFrame(prefix + ".ppm");
+	report_line("%s%shang: %s: %s frame=%d main_time=%llu snapshot=%s.sav\n", name.c_str(), name.empty() ? "" : ": ",
+		SimWatchdog::ReasonName(watchdog.reason), watchdog.report.c_str(), video.count_frame, (unsigned long long)main_time, prefix.c_str());
+	return 3;
+}
+
+// Fork server child: apply one variant to the warm model and run it out
+int play_variant(int index, SimFork_Variant& variant) {
+	// Each child exports under its own name, e.g. /cpc-fire
+	if (shm_name && !video.shm.Open(std::string(shm_name) + "-" + variant.Get("name", std::to_string(index)), video.output_width, video.output_height, shm_slots)) { return 2; }
+	if (variant.Has("download")) { queue_load(variant.Get("download", "")); }
+	if (variant.Has("input") && !input.StartPlayback(variant.Get("input", ""))) { return 2; }
+	if (variant.Has("type")) { input.AutoType(unescape_text(variant.Get("type", ""))); }
+	if (variant.Has("until") && !start_run_until(variant.Get("until", ""))) { return 2; }
+	bool ok = run_frames(variant.GetInt("frames", headless_run_frames), headless_max_cycles);
+	if (watchdog.reason) { return report_hang(variant.Get("name", std::to_string(index))); }
+	if (variant.Has("save")) { save_model(variant.Get("save", "").c_str()); }
+	printf("%s: %s frame=%d main_time=%llu\n", variant.Get("name", "").c_str(),
+		ok ? (stop_requested ? "stopped" : "done") : "cycle limit", video.count_frame, (unsigned long long)main_time);
+	return ok ? 0 : 1;
+}
+
+int run_variant(int index, SimFork_Variant& variant) {
+	int rc = play_variant(index, variant);
+	// The child leaves through _exit, so remove its export here
+	video.shm.Close();
+	return rc;
+}
+
+// SDRAM byte at a physical address, either build
+uint8_t peek_sdram(uint32_t a) {
+#ifdef SIM_SDRAM_DPI
+	return sdram.Read(a);
+#else
+	return model_ram[a & 0x7FFFFF];
 #endif
+}
 
-			// If the design has a "pixel" enable at rising edge
-			if (top->top__DOT__ce_pix) {
-				uint32_t colour = 0xFF000000;
-				
-				// Scale up the 2-bit color to 8-bit for better visibility
-				uint8_t r_val = top->VGA_R * 0x55;  // Scale 0-3 to 0-255
-				uint8_t g_val = top->VGA_G * 0x55;
-				uint8_t b_val = top->VGA_B * 0x55;
-				
-				colour = 0xFF000000 | (b_val << 16) | (g_val << 8) | r_val;
-				
-				video.Clock(top->VGA_HB, top->VGA_VB,
-				            top->VGA_HS, top->VGA_VS, colour);
-			}
+// --diff: restore each saved state in turn and compare them signal by
+// signal. Exits 0 when they are the same, 1 when not, like cmp.
+int run_diff() {
+	SimDiff diff;
+	diff.signals = &signals;
+	for (int side = 0; side < 2; side++) {
+		if (!file_exists(diff_files[side])) {
+			fprintf(stderr, "Cannot open %s\n", diff_files[side]);
+			return 2;
+		}
+		if (!restore_model(diff_files[side])) {
+			fprintf(stderr, "Cannot restore %s\n", diff_files[side]);
+			return 2;
+		}
+		diff.Capture(side);
+		diff.Add(side, "main_time", &main_time, sizeof(main_time), 64, 1);
+#ifdef SIM_SDRAM_DPI
+		// The SDRAM lives on the host side in this build
+		std::vector<uint8_t> ram(SimSDRAM::mem_size);
+		for (uint32_t a = 0; a < SimSDRAM::mem_size; a++) { ram[a] = sdram.Read(a); }
+		diff.Add(side, "sdram (host)", &ram[0], 1, 8, (int)ram.size());
+#endif
+	}
+	printf("--- %s\n+++ %s\n%s", diff_files[0], diff_files[1], diff.Report().c_str());
+	return diff.Differences() ? 1 : 0;
+}
 
-			// FST trace dump
-			if (Trace) {
-				if (!tfp->isOpen()) {
-					tfp->open(Trace_File); // open if not already
-				}
-				tfp->dump(main_time);
-			}
+// One control request. Commands:
+//   load {file, index=5}            queue an ioctl download
+//   run {frames | cycles, until, max_cycles=0}
+//   type {text}                     autotype
+//   save {file, delta=false}        VerilatedSave model state; delta (SDRAM=dpi)
+//                                   holds only the pages written since the last full save
+//   restore {file}
+//   read {addr, length=1}           SDRAM bytes as hex, physical address
+//   signal {name, index=0}          any signal or host variable by name
+//   screenshot {file}               current frame as PPM
+//   stats                           frame, time and download state
+//   quit
+void handle_control(SimControl_Request& req, SimControl_Reply& reply) {
+	std::string cmd = req.Get("cmd", "");
+	if (cmd == "load") {
+		std::string file = req.Get("file", "");
+		if (!file_exists(file)) {
+			reply.Error("cannot open " + file);
+			return;
+		}
+		bus.QueueDownload(file, (int)req.GetInt("index", 5), true);
+	}
+	else if (cmd == "run") {
+		// Every run needs a limit: a frame count, a cycle count or max_cycles
+		vluint64_t max_cycles = (vluint64_t)req.GetInt("max_cycles", 0);
+		if (!req.Has("cycles") && !req.Has("frames") && !max_cycles) {
+			reply.Error("run needs frames, cycles or max_cycles");
+			return;
+		}
+		if (req.Has("until") && !start_run_until(req.Get("until", ""))) {
+			reply.Error(run_until.error);
+			return;
+		}
+		bool ok = true;
+		if (req.Has("cycles")) {
+			vluint64_t end = main_time + (vluint64_t)req.GetInt("cycles", 0);
+			stop_requested = false;
+			while (main_time < end && !stop_requested) { verilate(); }
+		}
+		else {
+			ok = run_frames((int)req.GetInt("frames", 0x7FFFFFFF), max_cycles);
+		}
+		run_until_active = false;
+		reply.Set("result", watchdog.reason ? "hang" : ok ? (stop_requested ? "stopped" : "done") : "cycle limit");
+		if (watchdog.reason) {
+			reply.Set("hang", SimWatchdog::ReasonName(watchdog.reason));
+			reply.Set("detail", watchdog.report);
+			watchdog.Reset();
+		}
+		reply.Set("frame", video.count_frame);
+		reply.Set("main_time", (uint64_t)main_time);
+	}
+	else if (cmd == "type") { input.AutoType(req.Get("text", "")); }
+	else if (cmd == "save" || cmd == "restore") {
+		std::string file = req.Get("file", "");
+		if (file.empty()) {
+			reply.Error(cmd + " needs a file");
+			return;
+		}
+		if (cmd == "restore" && !file_exists(file)) {
+			reply.Error("cannot open " + file);
+			return;
+		}
+		if (cmd == "save") { save_model(file.c_str(), req.GetInt("delta", 0) != 0); }
+		else if (!restore_model(file.c_str())) {
+			reply.Error("cannot restore " + file + ", see the log");
+			return;
+		}
+		reply.Set("main_time", (uint64_t)main_time);
+	}
+	else if (cmd == "read") {
+		uint32_t addr = (uint32_t)req.GetInt("addr", 0);
+		long long length = req.GetInt("length", 1);
+		if (length < 1 || length > 65536) {
+			reply.Error("length must be 1-65536");
+			return;
+		}
+		static const char hex[] = "0123456789abcdef";
+		std::string data;
+		for (long long i = 0; i < length; i++) {
+			uint8_t b = peek_sdram(addr + (uint32_t)i);
+			data += hex[b >> 4];
+			data += hex[b & 15];
+		}
+		reply.Set("addr", (long long)addr);
+		reply.Set("data", data);
+	}
+	else if (cmd == "signal") {
+		std::string name = req.Get("name", "");
+		const SimSignal* sig = signals.Get(name);
+		if (!sig) {
+			reply.Error("unknown signal " + name);
+			return;
+		}
+		int index = (int)req.GetInt("index", 0);
+		if (index < 0 || index >= sig->elements) {
+			reply.Error("index out of range");
+			return;
+		}
+		reply.Set("value", (long long)sig->Read(index));
+		reply.Set("width", sig->width);
+	}
+	else if (cmd == "screenshot") {
+		std::string file = req.Get("file", "");
+		if (!video.SaveFrame(file)) {
+			reply.Error("cannot write " + file);
+			return;
+		}
+		reply.Set("frame", video.count_frame);
+	}
+	else if (cmd == "stats") {
+		reply.Set("frame", video.count_frame);
+		reply.Set("main_time", (uint64_t)main_time);
+		reply.Set("fps", (double)video.stats_fps);
+		reply.Set("downloading", bus.HasQueue() || *bus.ioctl_download != 0);
+	}
+	else if (cmd == "quit") { control_quit = true; }
+	else { reply.Error("unknown command \"" + cmd + "\""); }
+}
 
-			// Advance main_time here (so next rising edge is a new time)
-			main_time++;
+// Answer control requests, waiting up to timeout_ms for the first
+void serve_control(int timeout_ms) {
+	SimControl_Request req;
+	while (control.Poll(req, timeout_ms)) {
+		SimControl_Reply reply;
+		handle_control(req, reply);
+		control.Reply(reply, req);
+		timeout_ms = 0;
+		if (control_quit) {
+			control.Close();
+			return;
 		}
-		return 1;
 	}
+}
 
-	// If Verilator thinks we are finished, stop & cleanup
-	top->final();
-	tfp->close();
-	delete top;
-	exit(0);
+// Frame hashes, one per line as "hash XXXX" (a cache entry) or bare hex
+bool load_golden(const char* file) {
+	FILE* f = fopen(file, "rb");
+	if (!f) {
+		fprintf(stderr, "Cannot open golden hashes %s\n", file);
+		return false;
+	}
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		const char* p = strncmp(line, "hash ", 5) == 0 ? line + 5 : line;
+		char* end;
+		uint64_t h = strtoull(p, &end, 16);
+		if (end > p && (*end == '\n' || *end == '\r' || *end == 0)) { golden_hashes.push_back(h); }
+	}
+	fclose(f);
+	return true;
+}
+
+// Run phase of --bisect / --bisect-golden: the first cycle the condition
+// holds at, and the model saved one cycle before it
+int run_bisect() {
+	SimExpr condition;
+	if (bisect_text && !condition.Compile(bisect_text, resolve_signal)) {
+		report_line("bisect: %s\n", condition.error.c_str());
+		return 1;
+	}
+	int end_frame = video.count_frame + headless_run_frames;
+	vluint64_t limit = headless_max_cycles ? main_time + headless_max_cycles : 0;
+
+	SimBisect bisect(fork_jobs);
+	bisect.every = bisect_every ? bisect_every : 1;
+	bisect.time = &main_time;
+	bisect.frame = &video.count_frame;
+	bisect.snapshot = bisect_save;
+	bisect.runTo = [&](vluint64_t t) {
+		while (main_time < t) {
+			if (video.count_frame >= end_frame || (limit && main_time >= limit)) { return false; }
+			verilate();
+		}
+		return true;
+	};
+	bisect.holds = [&]() { return bisect_text ? condition.Eval() != 0 : golden_bad != 0; };
+	bisect.save = [](const std::string& file) { save_model(file.c_str()); };
+
+	double start = now_ms();
+	vluint64_t from = main_time;
+	if (!bisect.Run()) {
+		report_line("bisect: %s\n", bisect.error.c_str());
+		return 1;
+	}
+	if (!bisect.found) {
+		report_line("bisect: never true, frame=%d main_time=%llu\n", video.count_frame, (unsigned long long)main_time);
+		return 1;
+	}
+	if (golden_bad) { report_line("bisect: frame %d differs from %s\n", golden_bad, golden_file); }
+	if (bisect.first == from) {
+		report_line("bisect: true from the start, main_time=%llu\n", (unsigned long long)bisect.first);
+		return 0;
+	}
+	report_line("bisect: first true at main_time=%llu frame=%d, the cycle before saved to %s (%.1fs)\n",
+		(unsigned long long)bisect.first, bisect.firstFrame, bisect_save.c_str(), (now_ms() - start) / 1000.0);
 	return 0;
 }
 
+int simulate_headless() {
+	if (record_input) { input.StartRecording(record_input); }
+	if (play_input && !input.StartPlayback(play_input)) { return 1; }
+	if (!autotype_text.empty()) { input.AutoType(autotype_text); }
+
+	// Boot once
+	if (!run_frames(headless_boot_frames, headless_max_cycles)) {
+		report_line("boot: cycle limit before frame %d\n", headless_boot_frames);
+		return 1;
+	}
+	if (watchdog.reason) { return report_hang(""); }
+	report_line("boot: frame=%d main_time=%llu\n", video.count_frame, (unsigned long long)main_time);
+
+	if (bisect_text || golden_file) { return run_bisect(); }
+
+	// Debugger attached: run only while it has the target running
+	if (gdb.IsOpen()) {
+		printf("gdb: %s\n", gdb.status.c_str());
+		fflush(stdout);
+		while (gdb.IsOpen()) {
+			gdb.Poll(gdb.running ? 0 : -1);
+			stop_requested = false;
+			for (int i = 0; i < 100000 && gdb.running && !stop_requested; i++) { verilate(); }
+		}
+		return 0;
+	}
+
+	// Long lived: take requests until quit or the client closes stdin
+	if (control.IsOpen()) {
+		while (control.IsOpen()) { serve_control(-1); }
+		return 0;
+	}
+
+	// Then either fan out one child per variant, or just keep running
+	if (until_text && !start_run_until(until_text)) {
+		report_line("until: %s\n", run_until.error.c_str());
+		return 1;
+	}
+	if (fork_variants) {
+		SimForkServer server(fork_jobs);
+		if (!server.LoadVariants(fork_variants)) { return 1; }
+		int failed = server.Run(run_variant);
+		server.PrintSummary();
+		return failed ? 1 : 0;
+	}
+	bool ok = run_frames(headless_run_frames, headless_max_cycles);
+	input.StopRecording();
+	if (watchdog.reason) { return report_hang(""); }
+	if (lockstep.diverged) { report_line("%s", lockstep.report.c_str()); }
+	else if (lockstep.enabled) { report_line("lockstep: %llu instructions matched\n", (unsigned long long)lockstep.instructions); }
+	if (!fastfwd.report.empty()) { report_line("%s", fastfwd.report.c_str()); }
+	if (save_sna && fastfwd.Export(save_sna)) {
+		// Clock on to the next instruction boundary
+		for (int i = 0; i < 1000000 && fastfwd.ExportPending(); i++) { verilate(); }
+		report_line("sna: %s %s\n", save_sna, fastfwd.ExportPending() ? "not saved" : "saved");
+	}
+	report_line("run: %s frame=%d main_time=%llu\n", ok ? (stop_requested ? "stopped" : "done") : "cycle limit", video.count_frame, (unsigned long long)main_time);
+	// A lockstep run that never compared anything has not passed
+	if (lockstep.enabled && !lockstep.instructions) { return 1; }
+	return ok ? 0 : 1;
+}
+
+// Runs that only print a result can come from the cache; ones that talk to
+// a client, fork or write files have to be simulated
+bool cacheable() {
+	return cache_dir && !gdb_address && !control_path && !fork_variants && !record_input && !save_sna && !shm_name &&
+		!bisect_text && !golden_file;
+}
+
+// Options whose value is a file the run reads
+const char* cache_file_options[] = { "--load", "--play-input", "--load-sna" };
+
+// Everything that decides how the run ends: the sim binary, the command
+// line and the files it reads, queued downloads included
+void cache_key(int argc, char** argv) {
+	cache.AddExecutable(argv[0]);
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--cache" && i + 1 < argc) {
+			i++;
+			continue;
+		}
+		cache.Add(arg);
+		for (size_t o = 0; o < sizeof(cache_file_options) / sizeof(cache_file_options[0]); o++) {
+			if (arg == cache_file_options[o] && i + 1 < argc) {
+				cache.Add(argv[++i]);
+				if (!cache.AddFile(argv[i])) { cache.Add("missing"); }
+				break;
+			}
+		}
+	}
+	std::vector<std::string> files = bus.QueuedFiles();
+	for (size_t i = 0; i < files.size(); i++) {
+		cache.Add(files[i]);
+		if (!cache.AddFile(files[i])) { cache.Add("missing"); }
+	}
+}
+
+int run_headless(int argc, char** argv) {
+	if (video.InitialiseHeadless() == 1) { return 1; }
+	if (!cacheable()) { return simulate_headless(); }
+	if (!cache.Open(cache_dir)) { return 1; }
+	cache_key(argc, argv);
+
+	SimCache_Entry hit;
+	if (cache.Lookup(hit)) {
+		fputs(hit.report.c_str(), stdout);
+		printf("cache: hit %s, %d frames, %.2fs saved\n", cache.Key().c_str(), (int)hit.hashes.size(), hit.seconds);
+		return hit.status;
+	}
+	cache.recording = true;
+	double start = now_ms();
+	cache.entry.status = simulate_headless();
+	cache.entry.seconds = (now_ms() - start) / 1000.0;
+	cache.recording = false;
+	// A hang leaves <prefix>.sav and .ppm behind, which a replay would not
+	if (cache.entry.status != 3 && cache.Store()) { printf("cache: stored %s\n", cache.Key().c_str()); }
+	return cache.entry.status;
+}
+
+void parse_args(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--headless") { headless = true; }
+		else if (arg == "--boot-frames" && has_value) { headless_boot_frames = atoi(argv[++i]); }
+		else if (arg == "--frames" && has_value) { headless_run_frames = atoi(argv[++i]); }
+		else if (arg == "--max-cycles" && has_value) { headless_max_cycles = strtoull(argv[++i], NULL, 0); }
+		else if (arg == "--fork" && has_value) { fork_variants = argv[++i]; headless = true; }
+		else if (arg == "--jobs" && has_value) { fork_jobs = atoi(argv[++i]); }
+		else if (arg == "--load" && has_value) { load_files.push_back(argv[++i]); }
+		else if (arg == "--record-input" && has_value) { record_input = argv[++i]; }
+		else if (arg == "--play-input" && has_value) { play_input = argv[++i]; }
+		else if (arg == "--autotype" && has_value) { autotype_text = unescape_text(argv[++i]); }
+		else if (arg == "--until" && has_value) { until_text = argv[++i]; }
+		else if (arg == "--shm" && has_value) { shm_name = argv[++i]; }
+		else if (arg == "--shm-slots" && has_value) { shm_slots = atoi(argv[++i]); }
+		else if (arg == "--lockstep") { lockstep_start = true; }
+		else if (arg == "--fast-forward" && has_value) { fastfwd_text = argv[++i]; }
+		else if (arg == "--load-sna" && has_value) { load_sna = argv[++i]; }
+		else if (arg == "--save-sna" && has_value) { save_sna = argv[++i]; }
+		else if (arg == "--control" && has_value) { control_path = argv[++i]; }
+		else if (arg == "--gdb" && has_value) { gdb_address = argv[++i]; }
+		else if (arg == "--hang-vsync" && has_value) { watchdog.noVsyncCycles = strtoull(argv[++i], NULL, 0) * (AMSTRAD_CLK_SYS / 1000); }
+		else if (arg == "--hang-pc" && has_value) { watchdog.pcFrames = atoi(argv[++i]); }
+		else if (arg == "--hang-pc-range" && has_value) { watchdog.pcRange = atoi(argv[++i]); }
+		else if (arg == "--hang-frozen" && has_value) { watchdog.hashFrames = atoi(argv[++i]); }
+		else if (arg == "--hang-save" && has_value) { hang_save = argv[++i]; }
+		else if (arg == "--cache" && has_value) { cache_dir = argv[++i]; }
+		else if (arg == "--bisect" && has_value) { bisect_text = argv[++i]; headless = true; }
+		else if (arg == "--bisect-golden" && has_value) { golden_file = argv[++i]; headless = true; }
+		else if (arg == "--bisect-every" && has_value) { bisect_every = strtoull(argv[++i], NULL, 0); }
+		else if (arg == "--bisect-save" && has_value) { bisect_save = argv[++i]; }
+		else if (arg == "--diff" && i + 2 < argc) { diff_files[0] = argv[++i]; diff_files[1] = argv[++i]; }
+	}
+}
+
 //-----------------------------------------------------------------------
 // The main() function (mostly unchanged, except it calls the fixed verilate())
 //-----------------------------------------------------------------------
 int main(int argc, char** argv, char** env) {
 
 	// Prepare Verilator
-	Verilated::traceEverOn(true);
-	top = new Vtop("top");
+	amstrad.Create("top", true);
+	amstrad.rising = sim_rising;
+	top = amstrad.top;
 	top->trace(tfp, 99);  // up to 99 levels of hierarchy
-	Verilated::commandArgs(argc, argv);
+	amstrad.context->commandArgs(argc, argv);
+	parse_args(argc, argv);
+	if (golden_file && !load_golden(golden_file)) { return 1; }
 
 #ifdef WIN32
 	// Attach debug console
 	Verilated::setDebug(console);
 #endif
 
-	// Attach bus
-	bus.ioctl_addr    = &top->ioctl_addr;
-	bus.ioctl_index   = &top->ioctl_index;
-	bus.ioctl_wait    = &top->ioctl_wait;
-	bus.ioctl_download= &top->ioctl_download;
-	bus.ioctl_upload  = &top->ioctl_upload;
-	bus.ioctl_wr      = &top->ioctl_wr;
-	bus.ioctl_dout    = &top->ioctl_dout;
-	bus.ioctl_din     = &top->ioctl_din;
+	// Host variables for watch lists and run until
+	signals.AddHost("main_time", &main_time, sizeof(main_time));
+	signals.AddHost("video.count_frame", &video.count_frame, sizeof(video.count_frame));
+
+	// Model memories
+	asic_ram = find_memory("asic_inst.asic_ram", 0x4000);
+#ifndef SIM_SDRAM_DPI
+	model_ram = find_memory("sdram.ram", 0x800000);
+	if (!model_ram) {
+		fprintf(stderr, "sdram.ram is not public in this model\n");
+		return 1;
+	}
+#endif
+
+	// Snapshot diff needs nothing else
+	if (diff_files[0]) { return run_diff(); }
 
-	// Attach input
-	input.ps2_key     = &top->ps2_key;
+	// Attach breakpoints
+	breakpoints.time     = &main_time;
+	breakpoints.Attach(&signals);
+
+	// Attach logic analyzer
+	analyzer.signals = &signals;
+	analyzer.resolve = resolve_signal;
+	analyzer.time    = &main_time;
+
+	// Attach CPU lockstep
+	lockstep.signals = &signals;
+	lockstep.time    = &main_time;
+	if (lockstep_start && !lockstep.Enable()) { return 1; }
+
+	// Attach fast-forward, it runs on the SDRAM the RTL loaded
+	fastfwd.signals = &signals;
+	fastfwd.time    = &main_time;
+#ifdef SIM_SDRAM_DPI
+	fastfwd.sdram   = &sdram;
+#else
+	fastfwd.ram     = model_ram;
+#endif
+	if (fastfwd_text && !fastfwd.Arm(fastfwd_text)) { return 1; }
+	if (load_sna && !fastfwd.Import(load_sna)) { return 1; }
+
+	// Watch for hangs, if any --hang-* limit was given (ms of sim time, frames)
+	watchdog.signals = &signals;
+	watchdog.video   = &video;
+	watchdog.time    = &main_time;
+	watchdog.Arm();
+
+	// Attach the GDB stub, memory through the same SDRAM
+	gdb.signals = &signals;
+#ifdef SIM_SDRAM_DPI
+	gdb.sdram   = &sdram;
+#else
+	gdb.ram     = model_ram;
+#endif
 
 #ifndef DISABLE_AUDIO
-	audio.Initialise();
+	if (!headless) { audio.Initialise(); }
 #endif
 
-	input.Initialise();
+	if (!headless) { input.Initialise(); }
 
 #ifdef WIN32
 	input.SetMapping(input_up, DIK_UP);
@@ -267,7 +1067,11 @@ int main(int argc, char** argv, char** env) {
 #endif
 
 	// Setup video
-	if (video.Initialise(windowTitle) == 1) { return 1; }
+	if (!headless && video.Initialise(windowTitle) == 1) { return 1; }
+	if (!headless) { ImPlot::CreateContext(); }
+	if (shm_name && !video.shm.Open(shm_name, video.output_width, video.output_height, shm_slots)) { return 1; }
+	if (control_path && !control.Open(control_path)) { return 1; }
+	if (gdb_address && !gdb.Open(gdb_address)) { return 1; }
 
 	// Example downloads
 	//bus.QueueDownload("./OS6128.rom", 0, true);
@@ -276,6 +1080,8 @@ int main(int argc, char** argv, char** env) {
 	//bus.QueueDownload("./diagnostics.rom", 0, true);
 	//bus.QueueDownload("./CPC_PLUS.CPR", 5, true);
 
+	for (size_t i = 0; i < load_files.size(); i++) { queue_load(load_files[i]); }
+	if (load_files.empty())
 	bus.QueueDownload("./cpr/Barbarian II (1990)(Ocean).CPR", 5, true);	   		  // video + text
 	//bus.QueueDownload("./cpr/Batman the Movie (1990)(Ocean).CPR", 5, true);	  	  // black border, no protection detected
 	//bus.QueueDownload("./cpr/Batman the Movie (1990)(Ocean)[a].CPR", 5, true);  	  // black border, no protection detected
@@ -324,6 +1130,10 @@ int main(int argc, char** argv, char** env) {
 	//bus.QueueDownload("./cpr/World of Sports (1990)(Epyx).CPR", 5, true);           // black screen, no protection detected, ACID unlock sequence, sprite data downloading
 	//bus.QueueDownload("./cpr/World of Sports (1990)(Epyx)[a].CPR", 5, true);        // black screen, no protection detected, ACID unlock sequence, sprite data downloading
 
+	// No window: boot, optionally fork variants, and exit
+	if (headless) {
+		return run_headless(argc, argv);
+	}
 
 #ifdef WIN32
 	MSG msg;
@@ -344,6 +1154,10 @@ int main(int argc, char** argv, char** env) {
 		}
 #endif
 
+		double frame_start = now_ms();
+		if (gui_frame_start > 0) { gui_frame_ms = frame_start - gui_frame_start; }
+		gui_frame_start = frame_start;
+
 		video.StartFrame();
 		input.Read();
 		ImGui::NewFrame();
@@ -371,7 +1185,19 @@ int main(int argc, char** argv, char** env) {
 		ImGui::SameLine();
 		ImGui::Checkbox("RUN", &run_enable);
 
-		ImGui::SliderInt("Run batch size", &batchSize, 1, 250000);
+		ImGui::SetNextItemWidth(140);
+		ImGui::Combo("Batch", &batch_mode, batch_mode_names, IM_ARRAYSIZE(batch_mode_names));
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(200);
+		if (batch_mode == BATCH_FIXED) { ImGui::SliderInt("Run batch size", &batchSize, 1, 250000); }
+		if (batch_mode == BATCH_ADAPTIVE) { ImGui::SliderFloat("Target ms", &batch_target_ms, 4.0f, 50.0f, "%.1f"); }
+		if (batch_mode == BATCH_FRAMES) { ImGui::SliderInt("Frames per GUI frame", &batch_frames, 1, 10); }
+		if (batch_mode == BATCH_REALTIME) {
+			ImGui::Checkbox("Turbo (hold Tab)", &turbo_lock);
+			ImGui::SameLine();
+			ImGui::Text("%.1f fps  drift %+.1f ms  dropped %d", pacer.fps, pacer.drift_ms, pacer.dropped);
+		}
+		ImGui::Text("sim %.1f ms  GUI frame %.1f ms  batch %d", batch_sim_ms, gui_frame_ms, batchSize);
 
 		if (single_step == 1) { single_step = 0; }
 		if (ImGui::Button("Single Step")) { 
@@ -386,6 +1212,48 @@ int main(int argc, char** argv, char** env) {
 		}
 		ImGui::SliderInt("Multi step amount", &multi_step_amount, 8, 1024);
 
+		ImGui::Checkbox("Events", &showEvents);
+		ImGui::SameLine();
+		ImGui::Checkbox("Breakpoints", &showBreakpoints);
+		ImGui::SameLine();
+		ImGui::Checkbox("Watch", &showWatch);
+		ImGui::SameLine();
+		ImGui::Checkbox("Analyzer", &showAnalyzer);
+		ImGui::SameLine();
+		ImGui::Checkbox("Lockstep", &showLockstep);
+		ImGui::SameLine();
+		ImGui::Checkbox("Fast-forward", &showFastForward);
+
+		if (!input.IsRecording()) {
+			if (ImGui::Button("Record input")) { input.StartRecording(InputLog_File); }
+		}
+		else if (ImGui::Button("Stop recording")) { input.StopRecording(); }
+		ImGui::SameLine();
+		if (!input.IsPlaying()) {
+			if (ImGui::Button("Play input")) { input.StartPlayback(InputLog_File); }
+		}
+		else if (ImGui::Button("Stop playback")) { input.StopPlayback(); }
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(150);
+		ImGui::InputText("Input log", InputLog_File, IM_ARRAYSIZE(InputLog_File));
+
+		if (ImGui::Button("Type")) { input.AutoType(unescape_text(AutoType_Text)); }
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(200);
+		ImGui::InputText("Autotype", AutoType_Text, IM_ARRAYSIZE(AutoType_Text));
+		if (input.IsTyping()) { ImGui::SameLine(); ImGui::Text("typing..."); }
+
+		if (ImGui::Button("Run until")) {
+			if (start_run_until(RunUntil_Text)) { run_enable = 1; }
+		}
+		ImGui::SameLine();
+		ImGui::SetNextItemWidth(260);
+		ImGui::InputText("##until", RunUntil_Text, IM_ARRAYSIZE(RunUntil_Text));
+		if (run_until_active) {
+			ImGui::SameLine();
+			if (ImGui::SmallButton("Cancel")) { run_until_active = false; }
+		}
+
 		if (ImGui::Button("Load ST2"))
     		ImGuiFileDialog::Instance()->OpenDialog("ChooseFileDlgKey", "Choose File", ".st2", ".");
 		ImGui::SameLine();
@@ -397,23 +1265,68 @@ int main(int argc, char** argv, char** env) {
 		console.Draw(windowTitle_DebugLog, &showDebugLog, ImVec2(500, 700));
 		ImGui::SetWindowPos(windowTitle_DebugLog, ImVec2(0, 160), ImGuiCond_Once);
 
+		// RTL event window
+		if (showEvents) {
+			events.Draw(windowTitle_Events, &showEvents, ImVec2(500, 300));
+		}
+
+		// Breakpoint window
+		if (showBreakpoints) {
+			breakpoints.Draw(windowTitle_Breakpoints, &showBreakpoints, ImVec2(500, 250));
+		}
+
+		// Watch window
+		if (showWatch) {
+			signals.DrawWatch(windowTitle_Watch, &showWatch, ImVec2(400, 250));
+		}
+
+		// Logic analyzer window
+		if (showAnalyzer) {
+			analyzer.Draw(windowTitle_Analyzer, &showAnalyzer, ImVec2(900, 400));
+		}
+
+		// CPU lockstep window
+		if (showLockstep) {
+			lockstep.Draw(windowTitle_Lockstep, &showLockstep, ImVec2(640, 420));
+		}
+
+		// Fast-forward window
+		if (showFastForward) {
+			fastfwd.Draw(windowTitle_FastForward, &showFastForward, ImVec2(420, 120));
+		}
+
 		// Memory editor window
 		ImGui::Begin("Memory Editor");
 		ImGui::SetWindowPos("Memory Editor", ImVec2(0, 160), ImGuiCond_Once);
 		ImGui::SetWindowSize("Memory Editor", ImVec2(500, 200), ImGuiCond_Once);
 		if (ImGui::BeginTabBar("##memory_editor")) {
+#ifdef SIM_SDRAM_DPI
 			if (ImGui::BeginTabItem("RAM (8MB)")) {
-				mem_edit.DrawContents(&top->top__DOT__sdram__DOT__ram[0], 8388608, 0); // 8MB
+				ImGui::Text("Resident pages: %d  Shared pages: %d  Dirty pages: %d", sdram.ResidentPages(), sdram.SharedPages(), sdram.DirtyPages());
+				mem_edit.ReadFn = sdram_read;
+				mem_edit.WriteFn = sdram_write;
+				mem_edit.DrawContents(&sdram, SimSDRAM::mem_size, 0); // 8MB
+				mem_edit.ReadFn = NULL;
+				mem_edit.WriteFn = NULL;
 				ImGui::EndTabItem();
 			}
+#else
+			if (ImGui::BeginTabItem("RAM (8MB)")) {
+				mem_edit.DrawContents(model_ram, 8388608, 0); // 8MB
+				ImGui::EndTabItem();
+			}
+#endif
 			if (ImGui::BeginTabItem("ASIC RAM (16K)")) {
-				mem_edit.DrawContents(&top->top__DOT__asic_inst__DOT__asic_ram[0], 16384, 0); // 16K
+				if (asic_ram) { mem_edit.DrawContents(asic_ram, 16384, 0); } // 16K
+				else { ImGui::TextDisabled("asic_inst.asic_ram is not public in this model"); }
 				ImGui::EndTabItem();
 			}
+#ifndef SIM_SDRAM_DPI
 			if (ImGui::BeginTabItem("VIDEO RAM (16K)")) {
-				mem_edit.DrawContents(&top->top__DOT__sdram__DOT__ram[0x3000], 16384, 0); // 16K
+				mem_edit.DrawContents(model_ram + 0x3000, 16384, 0); // 16K
 				ImGui::EndTabItem();
 			}
+#endif
 			ImGui::EndTabBar();
 		}
 		ImGui::End();
@@ -423,20 +1336,13 @@ int main(int argc, char** argv, char** env) {
 		ImGui::SetWindowPos("CPU Debug", ImVec2(0, 370), ImGuiCond_Once);
 		ImGui::SetWindowSize("CPU Debug", ImVec2(500, 200), ImGuiCond_Once);
 		ImGui::Text("Control Signals:");
-		ImGui::Text("M1_n:    0x%01X", top->top__DOT__motherboard__DOT__M1_n);
-		ImGui::Text("MREQ_n:  0x%01X", top->top__DOT__motherboard__DOT__MREQ_n);
-		ImGui::Text("IORQ_n:  0x%01X", top->top__DOT__motherboard__DOT__IORQ_n);
-		ImGui::Text("INT_n:   0x%01X", top->top__DOT__motherboard__DOT__INT_n);
-		ImGui::Text("RD_n:    0x%01X", top->top__DOT__motherboard__DOT__RD_n);
-		ImGui::Text("WR_n:    0x%01X", top->top__DOT__motherboard__DOT__WR_n);
+		signals.DrawList(cpu_control, IM_ARRAYSIZE(cpu_control));
 		ImGui::Separator();
 		ImGui::Text("Data Path:");
-		ImGui::Text("Address:     0x%04X", top->top__DOT__motherboard__DOT__cpu_addr);
-		ImGui::Text("Data Out:    0x%02X", top->top__DOT__motherboard__DOT__cpu_dout);
-		ImGui::Text("Data In:     0x%02X", top->top__DOT__motherboard__DOT__cpu_din);
+		signals.DrawList(cpu_data, IM_ARRAYSIZE(cpu_data));
 		ImGui::Separator();
 		ImGui::Text("CPU Status:");
-		ImGui::Text("Reset:    0x%01X", top->top__DOT__RESET);  
+		signals.DrawList(cpu_status, IM_ARRAYSIZE(cpu_status));
 		ImGui::End();
 		
 		/*
@@ -464,31 +1370,11 @@ int main(int argc, char** argv, char** env) {
 				ImGui::Text("VBlank:     0x%01X", top->VGA_VB);
 				ImGui::Separator();
 				ImGui::Text("CRTC Internal:");
-				ImGui::Text("RS:               0x%04X", top->top__DOT__motherboard__DOT__CRTC__DOT__RS);
-				ImGui::Text("Data OUT:         0x%04X", top->top__DOT__motherboard__DOT__CRTC__DOT__DO);
-				ImGui::Text("Data IN:          0x%04X", top->top__DOT__motherboard__DOT__CRTC__DOT__DI);
+				signals.DrawList(crtc_internal, IM_ARRAYSIZE(crtc_internal));
 				ImGui::EndTabItem();
 			}
 			if (ImGui::BeginTabItem("CRTC Registers")) {
-				ImGui::Text("R0_h_total:       0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R0_h_total);
-				ImGui::Text("R1_h_displayed:   0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R1_h_displayed);
-				ImGui::Text("R2_hsync_pos:     0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R2_h_sync_pos);
-				ImGui::Text("R3_sync_width:    0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R3_v_sync_width);
-				ImGui::Text("R3_h_sync_width:  0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R3_h_sync_width);
-				ImGui::Text("R4_v_total:       0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R4_v_total);
-				ImGui::Text("R5_v_total_adj:   0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R5_v_total_adj);
-	    		ImGui::Text("R6_v_displayed:   0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R6_v_displayed);
-				ImGui::Text("R7_vsync_pos:     0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R7_v_sync_pos);
-				ImGui::Text("R8_skew:          0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R8_skew);
-				ImGui::Text("R8_interlace:     0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R8_interlace);
-				ImGui::Text("R9_v_max_line:    0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R9_v_max_line);
-				ImGui::Text("R10_cursor_mode:  0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R10_cursor_mode);
-				ImGui::Text("R10_cursor_start: 0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R10_cursor_start);
-				ImGui::Text("R11_cursor_end:   0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R11_cursor_end);
-				ImGui::Text("R12_start_addr_h: 0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R12_start_addr_h);
-				ImGui::Text("R13_start_addr_l: 0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R13_start_addr_l);
-				ImGui::Text("R14_cursor_h:     0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R14_cursor_h);
-				ImGui::Text("R15_cursor_l:     0x%02X", top->top__DOT__motherboard__DOT__CRTC__DOT__R15_cursor_l);
+				signals.DrawList(crtc_regs, IM_ARRAYSIZE(crtc_regs));
 				ImGui::EndTabItem();
 			}
 			ImGui::EndTabBar();
@@ -502,73 +1388,39 @@ int main(int argc, char** argv, char** env) {
 		if (ImGui::BeginTabBar("ASIC")) {
 			if (ImGui::BeginTabItem("General")) {
 				ImGui::Text("ASIC General Status:");
-				ImGui::Text("rmr2:              0x%04X", top->top__DOT__asic_inst__DOT__rmr2);
-				ImGui::Text("plus_bios_valid:   0x%04X", top->top__DOT__asic_inst__DOT__plus_bios_valid);
-				ImGui::Text("pri_irq:           0x%04X", top->top__DOT__asic_inst__DOT__pri_irq);
-				ImGui::Text("asic_video_active: 0x%04X", top->top__DOT__asic_inst__DOT__asic_video_active);
-				ImGui::Text("config_mode:       0x%04X", top->top__DOT__asic_inst__DOT__config_mode);
-				ImGui::Text("mrer_mode:         0x%04X", top->top__DOT__asic_inst__DOT__mrer_mode);
-				ImGui::Text("asic_mode:         0x%04X", top->top__DOT__asic_inst__DOT__asic_mode);
-				ImGui::Text("asic_enabled:      0x%04X", top->top__DOT__asic_inst__DOT__asic_enabled);
+				signals.DrawList(asic_general, IM_ARRAYSIZE(asic_general));
 				ImGui::Separator();
 				ImGui::Text("ACID:");
-				ImGui::Text("state:             0x%04X", top->top__DOT__asic_inst__DOT__acid_inst__DOT__state);
-				ImGui::Text("seq_index:         0x%04X", top->top__DOT__asic_inst__DOT__acid_inst__DOT__seq_index);
-				ImGui::Text("status_reg:        0x%04X", top->top__DOT__asic_inst__DOT__acid_inst__DOT__status_reg);
-				ImGui::Text("next_byte:         0x%04X", top->top__DOT__asic_inst__DOT__acid_inst__DOT__next_byte);
-				ImGui::Text("unlock_addr:       0x%04X", top->top__DOT__asic_inst__DOT__acid_inst__DOT__unlock_addr);
+				signals.DrawList(asic_acid, IM_ARRAYSIZE(asic_acid));
 				ImGui::Separator();
 				ImGui::Text("DMA:");
-				ImGui::Text("dma_status_audio:  0x%04X", top->top__DOT__asic_inst__DOT__dma_status_audio);
-				ImGui::Text("dma_irq_audio:     0x%04X", top->top__DOT__asic_inst__DOT__dma_irq_audio);
+				signals.DrawList(asic_dma, IM_ARRAYSIZE(asic_dma));
 				ImGui::EndTabItem();
 			}
 			if (ImGui::BeginTabItem("Control Registers")) {
 				ImGui::Text("ASIC Control Registers (0x7F00-0x7F0F):");
-				ImGui::Text("asic_control:      0x%04X", top->top__DOT__asic_inst__DOT__asic_control);
-				ImGui::Text("asic_config:       0x%04X", top->top__DOT__asic_inst__DOT__asic_config);
-				ImGui::Text("asic_version:      0x%04X", top->top__DOT__asic_inst__DOT__asic_version);
+				signals.DrawList(asic_control_regs, IM_ARRAYSIZE(asic_control_regs));
 				ImGui::Separator();
 				ImGui::Text("Video Control Registers (0x7F10-0x7F1F):");
-				ImGui::Text("video_control:     0x%04X", top->top__DOT__asic_inst__DOT__video_control);
-				ImGui::Text("video_status:      0x%04X", top->top__DOT__asic_inst__DOT__video_status);
-				ImGui::Text("video_config:      0x%04X", top->top__DOT__asic_inst__DOT__video_config);
-				ImGui::Text("video_palette:     0x%04X", top->top__DOT__asic_inst__DOT__video_palette);
-				ImGui::Text("video_effect:      0x%04X", top->top__DOT__asic_inst__DOT__video_effect);
+				signals.DrawList(asic_video_regs, IM_ARRAYSIZE(asic_video_regs));
 				ImGui::Separator();
 				ImGui::Text("Sprite Control Registers (0x7F20-0x7F2F):");
-				ImGui::Text("sprite_control:    0x%04X", top->top__DOT__asic_inst__DOT__sprite_control);
-				ImGui::Text("sprite_status:     0x%04X", top->top__DOT__asic_inst__DOT__sprite_status);
-				ImGui::Text("sprite_config:     0x%04X", top->top__DOT__asic_inst__DOT__sprite_config);
-				ImGui::Text("sprite_priority:   0x%04X", top->top__DOT__asic_inst__DOT__sprite_priority);
-				ImGui::Text("sprite_collision   0x%04X", top->top__DOT__asic_inst__DOT__sprite_collision);
+				signals.DrawList(asic_sprite_regs, IM_ARRAYSIZE(asic_sprite_regs));
 				ImGui::Separator();
 				ImGui::Text("Audio Control Registers (0x7F30-0x7F3F):");
-				ImGui::Text("audio_control:     0x%04X", top->top__DOT__asic_inst__DOT__audio_control);
-				ImGui::Text("audio_config:      0x%04X", top->top__DOT__asic_inst__DOT__audio_config);
-				ImGui::Text("audio_volume:      0x%04X", top->top__DOT__asic_inst__DOT__audio_volume);
+				signals.DrawList(asic_audio_regs, IM_ARRAYSIZE(asic_audio_regs));
 				ImGui::EndTabItem();
 			}
 			/*
 			if (ImGui::BeginTabItem("Palette Registers")) {
+				// cart_inst.video_inst is gone from the RTL
+				const char* palette[] = { "cart_inst.video_inst.palette_pointer", "cart_inst.video_inst.selected_palette",
+					"cart_inst.video_inst.palette_latch_r", "cart_inst.video_inst.palette_latch_g", "cart_inst.video_inst.palette_latch_b",
+					"cart_inst.video_inst.pal_idx", "cart_inst.video_inst.pal_data", "cart_inst.video_inst.pal_base",
+					"cart_inst.video_inst.alt_palette_en", "cart_inst.video_inst.effect_en", "cart_inst.video_inst.raster_effect_en",
+					"cart_inst.video_inst.split_screen_cfg", "cart_inst.video_inst.palette_update_en", "cart_inst.video_inst.palette_bank_sel" };
 				ImGui::Text("Palette Registers:");
-				ImGui::Text("palette_pointer:       0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__palette_pointer);
-				ImGui::Text("selected_palette:      0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__selected_palette);
-				ImGui::Text("palette_latch_r:       0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__palette_latch_r);
-				ImGui::Text("palette_latch_g:       0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__palette_latch_g);
-				ImGui::Text("palette_latch_b:       0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__palette_latch_b);
-				ImGui::Separator();
-				ImGui::Text("Palette Data:");
-				ImGui::Text("pal_idx:               0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__pal_idx);
-				ImGui::Text("pal_data:              0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__pal_data);
-				ImGui::Text("pal_base:              0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__pal_base);
-				ImGui::Separator();
-				ImGui::Text("alt_palette_en:        0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__alt_palette_en);
-				ImGui::Text("effect_en:             0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__effect_en);
-				ImGui::Text("raster_effect_en:      0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__raster_effect_en);
-				ImGui::Text("split_screen_cfg:      0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__split_screen_cfg);
-				ImGui::Text("palette_update_en:     0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__palette_update_en);
-				ImGui::Text("palette_bank_sel:      0x%04X", top->top__DOT__cart_inst__DOT__video_inst__DOT__palette_bank_sel);
+				signals.DrawList(palette, IM_ARRAYSIZE(palette));
 				ImGui::EndTabItem();
 			}
 			*/
@@ -601,6 +1453,10 @@ int main(int argc, char** argv, char** env) {
 		ImGui::Separator();
 		if (ImGui::Button("Save Model")) { save_model(SaveModel_File); } ImGui::SameLine();
 		if (ImGui::Button("Load Model")) { restore_model(SaveModel_File); } 
+#ifdef SIM_SDRAM_DPI
+		ImGui::SameLine();
+		if (ImGui::Button("Save Delta")) { save_model(SaveModel_File, true); }
+#endif
 		ImGui::SameLine();
 		if (ImGui::InputText("SaveFilename", SaveModel_File_tmp, IM_ARRAYSIZE(SaveModel_File), ImGuiInputTextFlags_EnterReturnsTrue))
 		{
@@ -609,8 +1465,8 @@ int main(int argc, char** argv, char** env) {
 		ImGui::End();
 
 		int windowX = 550;
-		int windowWidth = (VGA_WIDTH * VGA_SCALE_X) + 24;
-		int windowHeight = (VGA_HEIGHT * VGA_SCALE_Y) + 90;
+		int windowWidth = (video.output_width * VGA_SCALE_X) + 24;
+		int windowHeight = (video.output_height * VGA_SCALE_Y) + 90;
 
 		// Video window
 		ImGui::Begin(windowTitle_Video);
@@ -625,7 +1481,7 @@ int main(int argc, char** argv, char** env) {
 		ImGui::SameLine();
 		ImGui::Checkbox("Flip V", &video.output_vflip);
 
-		ImGui::Text("main_time: %lu frame_count: %d sim FPS: %f", main_time, video.count_frame, video.stats_fps);
+		ImGui::Text("main_time: %lu frame_count: %d sim FPS: %f rows uploaded: %d", main_time, video.count_frame, video.stats_fps, video.stats_rowsUploaded);
 		ImGui::Image(video.texture_id, ImVec2(video.output_width * VGA_SCALE_X, video.output_height * VGA_SCALE_Y));
 		ImGui::End();
 
@@ -649,7 +1505,6 @@ int main(int argc, char** argv, char** env) {
 			audio.CollectDebug((signed short)top->AUDIO_L, (signed short)top->AUDIO_R);
 		}
 		int channelWidth = (windowWidth / 2) - 16;
-		ImPlot::CreateContext();
 		if (ImPlot::BeginPlot("Audio - L", ImVec2(channelWidth, 220), ImPlotFlags_NoLegend | ImPlotFlags_NoMenus | ImPlotFlags_NoTitle)) {
 			ImPlot::SetupAxes("T", "A", ImPlotAxisFlags_NoLabel | ImPlotAxisFlags_NoTickMarks, ImPlotAxisFlags_AutoFit | ImPlotAxisFlags_NoLabel | ImPlotAxisFlags_NoTickMarks);
 			ImPlot::SetupAxesLimits(0, 1, -1, 1, ImPlotCond_Once);
@@ -663,7 +1518,6 @@ int main(int argc, char** argv, char** env) {
 			ImPlot::PlotStairs("", audio.debug_positions, audio.debug_wave_r, audio.debug_max_samples, audio.debug_pos);
 			ImPlot::EndPlot();
 		}
-		ImPlot::DestroyContext();
 		ImGui::End();
 #endif
 
@@ -674,34 +1528,46 @@ int main(int argc, char** argv, char** env) {
 		video.UpdateTexture();
 
 		// Handle user inputs
-		top->inputs = 0;
+		unsigned int inputs = 0;
 		for (int i = 0; i < input.inputCount; i++) {
-			if (input.inputs[i]) { top->inputs |= (1 << i); }
+			if (input.inputs[i]) { inputs |= (1 << i); }
 		}
+		input.SetJoystick(inputs);
 
 		//----------------------------------------------------------
 		// Actually run the simulation in batches
 		//----------------------------------------------------------
+		if (control.IsOpen()) { serve_control(0); }
+		if (gdb.IsOpen()) {
+			gdb.Poll(0);
+			if (gdb.running) { run_enable = 1; }
+		}
+		stop_requested = false;
+		turbo = turbo_lock || (!ImGui::GetIO().WantCaptureKeyboard && ImGui::IsKeyDown(ImGuiKey_Tab));
+		if (!run_enable) { pacer.Stop(); }
 		if (run_enable) {
-			for (int step = 0; step < batchSize; step++) {
-				verilate();
-			}
+			run_batch();
 		}
 		else {
 			if (single_step) {
 				verilate();
 			}
 			if (multi_step) {
-				for (int step = 0; step < multi_step_amount; step++) {
+				for (int step = 0; step < multi_step_amount && !stop_requested; step++) {
 					verilate();
 				}
 			}
 		}
+		if (stop_requested) { run_enable = 0; }
+		// The console has the report; let the next run start watching afresh
+		if (watchdog.reason) { watchdog.Reset(); }
 	}
 
+	input.StopRecording();
 #ifndef DISABLE_AUDIO
 	audio.CleanUp();
 #endif
+	if (!headless) { ImPlot::DestroyContext(); }
 	video.CleanUp();
 	input.CleanUp();
 	